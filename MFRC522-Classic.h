@@ -0,0 +1,311 @@
+/*
+ * Name: MFRC522-Classic.h
+ * MIFARE Classic and Ultralight memory operations on top of MFRC522-RFID-SPI.h
+ * authenticate  ->  read / write  ->  value block increment, decrement, restore,
+ * transfer; Ultralight / NTAG21x GET_VERSION, FAST_READ and page write.
+ *
+ * Included by MFRC522-RFID-SPI.h when RC522_CLASSIC is set, see MFRC522-Modules.h.
+ */
+
+//prototype functions
+uchar MFRC522_AuthSend(uchar authMode, uchar BlockAddr, uchar *serNum);
+uchar MFRC522_Auth(uchar authMode, uchar BlockAddr, uchar *Sectorkey, uchar *serNum);
+uchar MFRC522_AuthRom(uchar authMode, uchar BlockAddr, const rom uchar *Sectorkey, uchar *serNum);
+uchar MFRC522_Read(uchar blockAddr, uchar *recvData);
+uchar MFRC522_Write(uchar blockAddr, uchar *writeData);
+void MFRC522_FormatValueBlock(long value, uchar blockAddr, uchar *block);
+uchar MFRC522_CheckValueBlock(uchar *block, long *value, uchar *blockAddr);
+uchar MFRC522_WriteValueBlock(uchar blockAddr, long value);
+uchar MFRC522_ReadValueBlock(uchar blockAddr, long *value);
+uchar MFRC522_ValueCommand(uchar command, uchar blockAddr, long operand);
+uchar MFRC522_Increment(uchar blockAddr, long delta);
+uchar MFRC522_Decrement(uchar blockAddr, long delta);
+uchar MFRC522_Restore(uchar blockAddr);
+uchar MFRC522_Transfer(uchar blockAddr);
+uchar MFRC522_Debit(uchar blockAddr, long amount);
+uchar MFRC522_UL_GetVersion(uchar *version);
+uchar MFRC522_UL_PageCount(uchar *version);
+uchar MFRC522_UL_FastRead(uchar startPage, uchar endPage, uchar *recvData);
+uchar MFRC522_UL_Write(uchar page, uchar *writeData);
+
+//------------------------------------------------------------------------------
+
+/* Description: Send the authentication frame *********************************
+ * The key is already in the PCD frame, bytes 2..7 (MFRC522_Auth, MFRC522_AuthRom).
+ * Input parameters: authMode, BlockAddr, serNum--as MFRC522_Auth
+ * return:return MI_OK if successed				*/
+uchar MFRC522_AuthSend(uchar authMode, uchar BlockAddr, uchar *serNum) {
+    uchar status;
+    uint recvBits;
+    uchar i;
+	uchar *buff;
+	buff = framePool[FRAME_PCD];
+	//Verify command + block address + buffer password + card SN
+    buff[0] = authMode;
+    buff[1] = BlockAddr;
+    for (i=0; i<4; i++){  	buff[i+8] = *(serNum+i);   	  }
+    MFRC522_SetTimeout(TIMEOUT_AUTH);
+    status = MFRC522_ToCard(PCD_AUTHENT, buff, 12, buff, &recvBits);
+    if ((status == MI_OK) && (!(Read_MFRC522(Status2Reg) & 0x08))){	 status = MI_AUTHERR;  }
+    else if (status == MI_NOTAGERR){	 status = MI_AUTHERR;  }		//card does not answer a wrong key
+    return status;																	   }
+
+/* Description:verify card password ********************************************
+ * Input parameters:authMode--password verify mode
+                 0x60 = verify A passowrd key 
+                 0x61 = verify B passowrd key 
+             BlockAddr--Block address
+             Sectorkey--Block password
+             serNum--Card serial number ,4 bytes
+ * return:return MI_OK if successed				*/
+
+uchar MFRC522_Auth(uchar authMode, uchar BlockAddr, uchar *Sectorkey, uchar *serNum) {
+    uchar i;
+    for (i=0; i<6; i++){	framePool[FRAME_PCD][i+2] = *(Sectorkey+i);   }
+    return MFRC522_AuthSend(authMode, BlockAddr, serNum);			}
+
+/* Description: verify card password with a key in program memory **************
+ * Input parameters: as MFRC522_Auth, Sectorkey--6 bytes in rom (keyDefault, Cfg_Key)
+ * return:return MI_OK if successed				*/
+uchar MFRC522_AuthRom(uchar authMode, uchar BlockAddr, const rom uchar *Sectorkey, uchar *serNum) {
+    uchar i;
+    for (i=0; i<6; i++){	framePool[FRAME_PCD][i+2] = Sectorkey[i];   }
+    return MFRC522_AuthSend(authMode, BlockAddr, serNum);			}
+
+/* Description: Read data ******************************************************
+ * The MFRC522 appends the CRC_A of the command and checks and removes the one
+ * of the answer (MFRC522_CrcOn), the 16 bytes are copied only when it matches.
+ * Input parameters: blockAddr--block address; recvData--the block data which are read (MAX_LEN)
+ * return: return MI_OK if successed, MI_CRCERR if the CRC does not match		*/
+uchar MFRC522_Read(uchar blockAddr, uchar *recvData) {
+    uchar status;
+    uint unLen;
+    uchar i;
+    uchar *buff;
+    buff = framePool[FRAME_PCD];
+    buff[0] = PICC_READ;
+    buff[1] = blockAddr;
+    MFRC522_SetTimeout(TIMEOUT_READ);
+    MFRC522_CrcOn(1);
+    status = MFRC522_ToCardLen(PCD_TRANSCEIVE, buff, 2, buff, FRAME_LEN, &unLen);
+    MFRC522_CrcOn(0);
+    if ((status == MI_OK) && (unLen != 0x80)) {  status = MI_ERR;  } 
+    if (status != MI_OK){  return status;  }
+    for (i=0; i<MAX_LEN; i++){  recvData[i] = buff[i];  }
+    return status;									}
+
+/* Description: write block data ***********************************************
+ * Input parameters: blockAddr--block address; writeData--Write 16 bytes data into block
+ * return: return MI_OK if successed						*/
+uchar MFRC522_Write(uchar blockAddr, uchar *writeData) {
+    uchar status;
+    uint recvBits;
+    uchar i;
+	uchar *buff;
+	buff = framePool[FRAME_PCD];
+    Cache_InvalidateBlock(blockAddr);
+    buff[0] = PICC_WRITE;
+    buff[1] = blockAddr;
+    CalulateCRC(buff, 2, &buff[2]);
+    MFRC522_SetTimeout(TIMEOUT_WRITE);
+    status = MFRC522_ToCard(PCD_TRANSCEIVE, buff, 4, buff, &recvBits);
+    if ((status != MI_OK) || (recvBits != 4) || ((buff[0] & 0x0F) != 0x0A)){  status = MI_ERR;    }
+    if (status == MI_OK){
+        for (i=0; i<16; i++){   buff[i] = *(writeData+i);   }	//Write 16 bytes data into FIFO
+        CalulateCRC(buff, 16, &buff[16]);
+        MFRC522_SetTimeout(TIMEOUT_NVM);
+        status = MFRC522_ToCard(PCD_TRANSCEIVE, buff, 18, buff, &recvBits);
+		if ((status != MI_OK) || (recvBits != 4) || ((buff[0] & 0x0F) != 0x0A)){  status = MI_ERR; }
+    }
+    return status;										}
+
+/* Description: Build a MIFARE value block image ******************************
+ * Input parameters: value--signed 32 bit value; blockAddr--address byte stored with the value
+ *			 block--16 bytes output: value, ~value, value, addr, ~addr, addr, ~addr
+ * return: null						*/
+void MFRC522_FormatValueBlock(long value, uchar blockAddr, uchar *block) {
+	uchar i;
+	for (i=0; i<4; i++){
+		block[i]   = (uchar)(value >> (8*i));			//value, LSB first
+		block[i+4] = ~block[i];							//inverted value
+		block[i+8] = block[i];	}						//copy of value
+	block[12] = blockAddr;
+	block[13] = ~blockAddr;
+	block[14] = blockAddr;
+	block[15] = ~blockAddr;						}
+
+/* Description: Validate a MIFARE value block image ****************************
+ * Input parameters: block--16 bytes read from card; value--returns the value
+ *			 blockAddr--returns the address byte (may be null)
+ * return: return MI_OK if the value, inverted and copy fields all agree		*/
+uchar MFRC522_CheckValueBlock(uchar *block, long *value, uchar *blockAddr) {
+	uchar i;
+	for (i=0; i<4; i++){
+		if ((block[i] != block[i+8]) || (block[i] != (uchar)~block[i+4])){  return MI_ERR;  }	}
+	if ((block[12] != block[14]) || (block[13] != block[15]) || (block[12] != (uchar)~block[13])){  return MI_ERR;  }
+	*value = 0;
+	for (i=4; i>0; i--){  *value = (*value << 8) | block[i-1];  }
+	if (blockAddr){  *blockAddr = block[12];  }
+	return MI_OK;								}
+
+/* Description: Format a block as value block **********************************
+ * Input parameters: blockAddr--block address (sector must be authenticated); value--initial value
+ * return: return MI_OK if successed						*/
+uchar MFRC522_WriteValueBlock(uchar blockAddr, long value) {
+	uchar *block;
+	block = framePool[FRAME_DATA];
+	MFRC522_FormatValueBlock(value, blockAddr, block);
+	return MFRC522_Write(blockAddr, block);		}
+
+/* Description: Read and validate a value block ********************************
+ * Input parameters: blockAddr--block address; value--returns the value
+ * return: return MI_OK if successed and the block has value block format	*/
+uchar MFRC522_ReadValueBlock(uchar blockAddr, long *value) {
+	uchar status;
+	uchar *block;
+	block = framePool[FRAME_DATA];
+	status = MFRC522_Read(blockAddr, block);
+	if (status == MI_OK){  status = MFRC522_CheckValueBlock(block, value, 0);  }
+	return status;								}
+
+/* Description: Two step value operation (increment, decrement, restore) *******
+ * The card acknowledges the command frame; the 4 byte operand frame is not
+ * acknowledged on success, so a timeout on the second frame means success.
+ * The operand goes as a probe: no resend, the silence is not in errorNoAnswer.
+ * The result stays in the card's internal register until MFRC522_Transfer.
+ * Input parameters: command--PICC_INCREMENT, PICC_DECREMENT or PICC_RESTORE
+ *			 blockAddr--source value block; operand--value sent in the second frame
+ * return: return MI_OK if successed						*/
+uchar MFRC522_ValueCommand(uchar command, uchar blockAddr, long operand) {
+	uchar status;
+	uint recvBits;
+	uchar i;
+	uchar *buff;
+	buff = framePool[FRAME_PCD];
+	buff[0] = command;
+	buff[1] = blockAddr;
+	CalulateCRC(buff, 2, &buff[2]);
+	MFRC522_SetTimeout(TIMEOUT_WRITE);
+	status = MFRC522_ToCard(PCD_TRANSCEIVE, buff, 4, buff, &recvBits);
+	if ((status != MI_OK) || (recvBits != 4) || ((buff[0] & 0x0F) != 0x0A)){  return MI_ERR;  }
+	for (i=0; i<4; i++){  buff[i] = (uchar)(operand >> (8*i));  }	//operand, LSB first
+	CalulateCRC(buff, 4, &buff[4]);
+	status = MFRC522_ToCardProbe(PCD_TRANSCEIVE, buff, 6, buff, &recvBits);
+	if (status == MI_NOTAGERR){  return MI_OK;  }					//no answer = accepted
+	if ((status == MI_OK) && (recvBits == 4) && ((buff[0] & 0x0F) == 0x0A)){  return MI_OK;  }
+	return MI_ERR;								}
+
+/* Description: Add delta to a value block into the card's internal register **
+ * Input parameters: blockAddr--value block address; delta--amount to add
+ * return: return MI_OK if successed						*/
+uchar MFRC522_Increment(uchar blockAddr, long delta) {
+	return MFRC522_ValueCommand(PICC_INCREMENT, blockAddr, delta);	}
+
+/* Description: Subtract delta from a value block into the internal register ***
+ * Input parameters: blockAddr--value block address; delta--amount to subtract
+ * return: return MI_OK if successed						*/
+uchar MFRC522_Decrement(uchar blockAddr, long delta) {
+	return MFRC522_ValueCommand(PICC_DECREMENT, blockAddr, delta);	}
+
+/* Description: Copy a value block into the card's internal register **********
+ * Input parameters: blockAddr--value block address
+ * return: return MI_OK if successed						*/
+uchar MFRC522_Restore(uchar blockAddr) {
+	return MFRC522_ValueCommand(PICC_RESTORE, blockAddr, 0);		}
+
+/* Description: Write the card's internal register into a value block *********
+ * Input parameters: blockAddr--destination block address
+ * return: return MI_OK if successed						*/
+uchar MFRC522_Transfer(uchar blockAddr) {
+	uchar status;
+	uint recvBits;
+	uchar *buff;
+	buff = framePool[FRAME_PCD];
+	Cache_InvalidateBlock(blockAddr);
+	buff[0] = PICC_TRANSFER;
+	buff[1] = blockAddr;
+	CalulateCRC(buff, 2, &buff[2]);
+	MFRC522_SetTimeout(TIMEOUT_NVM);
+	status = MFRC522_ToCard(PCD_TRANSCEIVE, buff, 4, buff, &recvBits);
+	if ((status != MI_OK) || (recvBits != 4) || ((buff[0] & 0x0F) != 0x0A)){  status = MI_ERR;  }
+	return status;								}
+
+/* Description: Debit a value block in place ***********************************
+ * Decrement and transfer under the authentication already done for the sector,
+ * no block read or 16 byte write is needed. Three frames: DECREMENT, its
+ * operand (no answer on success) and TRANSFER.
+ * Input parameters: blockAddr--value block address; amount--amount to debit
+ * return: return MI_OK if successed						*/
+uchar MFRC522_Debit(uchar blockAddr, long amount) {
+	uchar status;
+	status = MFRC522_Decrement(blockAddr, amount);
+	if (status == MI_OK){  status = MFRC522_Transfer(blockAddr);  }
+	return status;								}
+
+/* Description: Read Ultralight EV1 / NTAG21x product version ******************
+ * A plain Ultralight does not answer and falls back to IDLE, it must be
+ * selected again before the next command.
+ * Input parameters: version--return 8 bytes version (MAX_LEN buffer)
+ * return: return MI_OK if successed						*/
+uchar MFRC522_UL_GetVersion(uchar *version) {
+	uchar status;
+	uint recvBits;
+	version[0] = PICC_UL_GET_VERSION;
+	CalulateCRC(version, 1, &version[1]);
+	MFRC522_SetTimeout(TIMEOUT_READ);
+	status = MFRC522_ToCardProbe(PCD_TRANSCEIVE, version, 3, version, &recvBits);	//no resend to a silent card
+	if ((status != MI_OK) || (recvBits != 0x50)){  status = MI_ERR;  }	//8 bytes + CRC
+	return status;								}
+
+/* Description: Number of user addressable pages ******************************
+ * Input parameters: version--GET_VERSION answer, or null for a plain Ultralight
+ * return: total number of pages					*/
+uchar MFRC522_UL_PageCount(uchar *version) {
+	if (!version){  return UL_PAGES_DEFAULT;  }
+	switch (version[6]) {						//storage size byte
+		case 0x0B:	return 20;					//Ultralight EV1 MF0UL11
+		case 0x0E:	return 41;					//Ultralight EV1 MF0UL21
+		case 0x0F:	return 45;					//NTAG213
+		case 0x11:	return 135;					//NTAG215
+		case 0x13:	return 231;					//NTAG216
+		default:	break;	}
+	return UL_PAGES_DEFAULT;					}
+
+/* Description: Read a range of pages in one frame *****************************
+ * Input parameters: startPage, endPage--inclusive range, at most UL_FAST_READ_PAGES pages
+ *			 recvData--return (endPage-startPage+1)*4 bytes + 2 CRC bytes
+ * return: return MI_OK if successed and CRC matches			*/
+uchar MFRC522_UL_FastRead(uchar startPage, uchar endPage, uchar *recvData) {
+	uchar status;
+	uint unLen;
+	uchar len;
+	uchar crc[2];
+	len = (endPage - startPage + 1) * 4;
+	recvData[0] = PICC_UL_FAST_READ;
+	recvData[1] = startPage;
+	recvData[2] = endPage;
+	CalulateCRC(recvData, 3, &recvData[3]);
+	MFRC522_SetTimeout(TIMEOUT_READ);
+	status = MFRC522_ToCardLen(PCD_TRANSCEIVE, recvData, 5, recvData, len + 2, &unLen);
+	if ((status != MI_OK) || (unLen != (uint)(len + 2) * 8)){  return MI_ERR;  }
+	CalulateCRC(recvData, len, crc);
+	if ((crc[0] != recvData[len]) || (crc[1] != recvData[len+1])){  status = MI_CRCERR;  }
+	return status;								}
+
+/* Description: Write one Ultralight / NTAG page *******************************
+ * Input parameters: page--page address; writeData--4 bytes
+ * return: return MI_OK if successed						*/
+uchar MFRC522_UL_Write(uchar page, uchar *writeData) {
+	uchar status;
+	uint recvBits;
+	uchar i;
+	uchar *buff;
+	buff = framePool[FRAME_PCD];
+	buff[0] = PICC_UL_WRITE;
+	buff[1] = page;
+	for (i=0; i<4; i++){  buff[i+2] = writeData[i];  }
+	CalulateCRC(buff, 6, &buff[6]);
+	MFRC522_SetTimeout(TIMEOUT_NVM);
+	status = MFRC522_ToCard(PCD_TRANSCEIVE, buff, 8, buff, &recvBits);
+	if ((status != MI_OK) || (recvBits != 4) || ((buff[0] & 0x0F) != 0x0A)){  status = MI_ERR;  }
+	return status;								}
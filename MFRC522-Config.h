@@ -0,0 +1,504 @@
+/*
+ * Name: MFRC522-Config.h
+ * Configuration image on top of MFRC522-RFID-SPI.h
+ * begin  ->  data  ->  commit from host/rc522_config.c, Cfg_Load at setup
+ *
+ * A setting of a module left out of the build profile goes to a spare byte, so
+ * the same image loads on every profile. Included by MFRC522-RFID-SPI.h when
+ * RC522_CONFIG is set, see MFRC522-Modules.h.
+ */
+
+#include <flash.h>
+
+//configuration image: keys, tuning, settings and card templates in two flash banks,
+//sent over serial in A5 frames (see host/rc522_config.c). The valid bank with the
+//newest version is active; the header block of a bank is written last, so a reset
+//at any point leaves the old image or the new one
+#ifndef FLASH_WRITE_BLOCK
+#define FLASH_WRITE_BLOCK      32				//PIC18F4520 holding registers
+#endif
+#ifndef FLASH_ERASE_BLOCK
+#define FLASH_ERASE_BLOCK      64
+#endif
+#define CFG_BANK_ADDR          0x7C00			//banks at the top of the 32 KB flash, see cfgBanks
+#define CFG_BANK_SIZE          512
+#define CFG_BANKS              2
+#define CFG_NONE               0xFF				//no bank, no transfer
+#define CFG_RECORDS            FLASH_ERASE_BLOCK	//records start after the header erase block
+#define CFG_RECORDS_MAX        (CFG_BANK_SIZE-CFG_RECORDS)
+#define CFG_MAGIC              0xC5
+#define CFG_NEWER(a,b)         ((uint)((uint)((a)-(b)) - 1) < 0x7FFF)	//version a after b, serial numbers
+#define CFG_FORMAT             1
+//header: magic, format, version, records length, CRC-16/CCITT of the records (high bytes first)
+#define CFG_HEADER_LEN         8
+#define CFG_CHUNK              32				//largest data of a CFG_DATA frame
+#define CFG_SYNC               0xA5
+#define CFG_FRAME_MAX          (2+CFG_CHUNK)
+//frames from the host: A5 <type> <len> <payload> <crc16>, CRC of type, len and payload
+#define CFG_BEGIN              0x10				//version, length, CRC; + base version for a delta
+#define CFG_DATA               0x11				//offset in the records, bytes in ascending order
+#define CFG_COMMIT             0x12				//check the CRC and switch to the new image
+#define CFG_QUERY              0x13				//version of the active image, 0 = built-in
+#define CFG_REPORT             0x14				//report to send, | CFG_REP_CLEAR to clear its counters
+//reports of CFG_REPORT, answered K00<report> after the report lines, K03 when not in the build
+#define CFG_REP_ISR            0x00				//sendIsrReport
+#define CFG_REP_TXN            0x01				//sendTxnStats
+#define CFG_REP_CACHE          0x02				//sendCacheStats
+#define CFG_REP_READER         0x03				//sendReaderStats
+#define CFG_REP_RETRY          0x04				//sendRetryStats
+#define CFG_REP_MEMORY         0x05				//sendMemoryReport
+#define CFG_REP_BENCH          0x06				//sendFormatBench, FMT_BENCH 1
+#define CFG_REP_CLEAR          0x80
+//records: <type> <len> <data>, CFG_END or the records length ends the list
+#define CFG_END                0x00
+#define CFG_KEY                0x01				//sector (CFG_ANY every sector), 0x60/0x61, 6 key bytes
+#define CFG_TUNE               0x02				//reader, RFCfgReg, RxThresholdReg, CWGsPReg, ModGsPReg
+#define CFG_SETTINGS           0x03				//bytes for cfgSettings, in order
+#define CFG_TEMPLATE           0x04				//block, 16 bytes written by writeTagBlockMemory
+#define CFG_ANY                0xFF
+#define CFG_SETTINGS_LEN       (7+TIMEOUT_COUNT)
+//replies: K<code><value> line, value the next offset, or the version
+#define CFG_OK                 0x00
+#define CFG_ERR_FRAME          0x01				//frame CRC, resend it
+#define CFG_ERR_STATE          0x02				//data or commit without begin
+#define CFG_ERR_RANGE          0x03				//too long, offset out of order
+#define CFG_ERR_BASE           0x04				//delta on a version that is not active
+#define CFG_ERR_VERSION        0x05				//not newer than the active image
+#define CFG_ERR_CRC            0x06				//records do not match the CRC of begin
+#define CFG_ERR_FLASH          0x07				//flash does not read back as written
+#define CFG_RX_SYNC            0				//receive state of a frame
+#define CFG_RX_TYPE            1
+#define CFG_RX_LEN             2
+#define CFG_RX_DATA            3
+#define CFG_RX_CRC_H           4
+#define CFG_RX_CRC_L           5
+
+//prototype functions
+const rom uchar *Cfg_Bank(uchar bank);
+uchar Cfg_Valid(uchar bank);
+void Cfg_Load(void);
+const rom uchar *Cfg_Next(const rom uchar *data, uchar type);
+const rom uchar *Cfg_Key(uchar authMode, uchar blockAddr);
+void Cfg_Apply(void);
+uchar Cfg_WriteBlock(void);
+void Cfg_LoadBlock(void);
+uchar Cfg_Seek(uint addr);
+uchar Cfg_Begin(void);
+uchar Cfg_Data(void);
+uchar Cfg_Commit(void);
+uchar Cfg_Report(void);
+void Cfg_Reply(uchar code, uint value);
+void Cfg_Frame(void);
+void Cfg_Poll(void);
+
+//configuration image
+#ifndef FLASH_PTR
+#pragma romdata CONFIG_BANKS=0x7C00			//CFG_BANK_ADDR, the linker keeps code out of the banks
+const rom uchar cfgBanks[CFG_BANKS*CFG_BANK_SIZE];
+#pragma romdata
+#define FLASH_PTR(addr)        ((const rom uchar *)(addr))
+#endif
+uchar cfgBank = CFG_NONE;				//active bank
+uint  cfgVersion;						//its version, 0 = built-in settings
+uint  cfgLen;							//its records length
+uchar cfgStage = CFG_NONE;				//bank being written
+uint  cfgStageVersion, cfgStageLen, cfgStageCrc;
+uchar cfgDelta;							//1: records not sent are copied from the active bank
+uint  cfgNext;							//records offset after the last data received
+uint  cfgBlockAddr;						//bank offset of the write block in cfgBlock
+uchar cfgBlock[FLASH_WRITE_BLOCK];
+uchar cfgRxState, cfgRxType, cfgRxLen, cfgRxPos;
+uint  cfgRxCrc;
+uchar cfgRx[CFG_FRAME_MAX];
+uchar cfgSpare[2];						//settings of the modules left out
+#if RC522_DUMP
+extern uchar compactFlags, cacheFreshTaps;	//defined by MFRC522-Dump.h, included later
+#endif
+#if RC522_GATE
+extern uchar gateFirstBlock, gateLastBlock;	//defined by MFRC522-Gate.h
+#endif
+//bytes of a CFG_SETTINGS record, in order
+uchar * const rom cfgSettings[CFG_SETTINGS_LEN] = {
+	&timeoutMarginPct, &retryBackoff, &retryBackoffMax,
+#if RC522_DUMP
+	&compactFlags, &cacheFreshTaps,
+#else
+	&cfgSpare[0], &cfgSpare[1],
+#endif
+#if RC522_GATE
+	&gateFirstBlock, &gateLastBlock,
+#else
+	&cfgSpare[0], &cfgSpare[1],
+#endif
+	&retryLimit[0], &retryLimit[1], &retryLimit[2], &retryLimit[3],
+	&retryLimit[4], &retryLimit[5], &retryLimit[6], &retryLimit[7]};
+
+//------------------------------------------------------------------------------
+
+/* Description: Start of a configuration bank in program memory ****************
+ * Input parameters: bank--0..CFG_BANKS-1
+ * return: its first byte, the header 	*/
+const rom uchar *Cfg_Bank(uchar bank){
+	return FLASH_PTR(CFG_BANK_ADDR + (unsigned long)bank * CFG_BANK_SIZE);	}
+
+/* Description: Check the header and the records CRC of a bank *****************
+ * Input parameters: bank--0..CFG_BANKS-1
+ * return: 1 if the bank holds a complete image 	*/
+uchar Cfg_Valid(uchar bank){
+	const rom uchar *p;
+	uint len, i, crc;
+	uchar v;
+	p = Cfg_Bank(bank);
+	if ((p[0] != CFG_MAGIC) || (p[1] != CFG_FORMAT)){  return 0;  }
+	len = ((uint)p[4] << 8) | p[5];
+	if (len > CFG_RECORDS_MAX){  return 0;  }
+	for (i=0, crc=0xFFFF; i<len; i++){
+		v = p[CFG_RECORDS + i];
+		crc = CRC16_Update(crc, &v, 1);	}
+	return crc == (((uint)p[6] << 8) | p[7]);	}
+
+/* Description: Find the active configuration image and apply it **************
+ * The bank with the newest version is checked first, an incomplete one is
+ * passed over. Without a valid bank the built-in settings stay.
+ * Input parameters: null
+ * return: null 						*/
+void Cfg_Load(void){
+	const rom uchar *p;
+	uchar b, best, passed;
+	uint v, bestVersion;
+	passed = 0;
+	for(;;){
+		best = CFG_NONE;
+		for (b=0; b<CFG_BANKS; b++){
+			p = Cfg_Bank(b);
+			if ((passed & (1 << b)) || (p[0] != CFG_MAGIC)){  continue;  }
+			v = ((uint)p[2] << 8) | p[3];
+			if ((best == CFG_NONE) || CFG_NEWER(v, bestVersion)){
+				best = b;
+				bestVersion = v;	}	}
+		if ((best == CFG_NONE) || Cfg_Valid(best)){  break;  }
+		passed |= 1 << best;	}
+	cfgBank = best;
+	cfgVersion = 0;
+	cfgLen = 0;
+	if (best == CFG_NONE){  return;  }
+	p = Cfg_Bank(best);
+	cfgVersion = bestVersion;
+	cfgLen = ((uint)p[4] << 8) | p[5];
+	Cfg_Apply();							}
+
+/* Description: Next record of a type in the active image **********************
+ * Input parameters: data--data of the last record found, null to start;
+ *                   type--CFG_xxx record type
+ * return: data of the record, its length is data[-1]; null if none 	*/
+const rom uchar *Cfg_Next(const rom uchar *data, uchar type){
+	const rom uchar *p, *end;
+	if (cfgBank == CFG_NONE){  return 0;  }
+	p = Cfg_Bank(cfgBank) + CFG_RECORDS;
+	end = p + cfgLen;
+	if (data){  p = data + data[-1];  }
+	while ((p + 2 <= end) && (p[0] != CFG_END) && (p + 2 + p[1] <= end)){
+		if (p[0] == type){  return p + 2;  }
+		p += 2 + p[1];	}
+	return 0;								}
+
+/* Description: Key of a sector ************************************************
+ * The key of the image for the sector, else its key for every sector, else
+ * keyDefault.
+ * Input parameters: authMode--PICC_AUTHENT1A or PICC_AUTHENT1B; blockAddr--block
+ * return: 6 key bytes in program memory 	*/
+const rom uchar *Cfg_Key(uchar authMode, uchar blockAddr){
+	const rom uchar *d, *key;
+	key = keyDefault;
+	for (d = Cfg_Next(0, CFG_KEY); d; d = Cfg_Next(d, CFG_KEY)){
+		if ((d[-1] < 8) || (d[1] != authMode)){  continue;  }
+		if (d[0] == (blockAddr >> 2)){  return d + 2;  }
+		if ((d[0] == CFG_ANY) && (key == keyDefault)){  key = d + 2;  }	}
+	return key;								}
+
+/* Description: Apply the settings and tuning records of the active image *****
+ * A tuning profile is saved in EEPROM only when it differs from the saved one,
+ * the image is applied at every boot.
+ * Input parameters: null
+ * return: null 						*/
+void Cfg_Apply(void){
+	const rom uchar *d;
+	uchar profile[TUNE_REGS], saved[TUNE_REGS];
+	uchar i, n, cur, same;
+	d = Cfg_Next(0, CFG_SETTINGS);
+	if (d){
+		n = (d[-1] < CFG_SETTINGS_LEN) ? d[-1] : CFG_SETTINGS_LEN;
+		for (i=0; i<n; i++){  *cfgSettings[i] = d[i];  }
+		timeoutProfile = TIMEOUT_NONE;			//margin may have changed, program the timers again
+		for (i=0; i<READER_COUNT; i++){  readerTimeoutProfile[i] = TIMEOUT_NONE;  }	}
+	cur = readerCur;
+	for (d = Cfg_Next(0, CFG_TUNE); d; d = Cfg_Next(d, CFG_TUNE)){
+		if ((d[-1] < 1+TUNE_REGS) || (d[0] >= READER_COUNT)){  continue;  }
+		Reader_Select(d[0]);
+		same = (Tune_Read(saved) == MI_OK);
+		for (i=0; i<TUNE_REGS; i++){
+			profile[i] = d[1+i];
+			if (profile[i] != saved[i]){  same = 0;  }	}
+		if (!same){  Tune_Save(profile);  }
+		Tune_Apply(profile);
+		configFingerprint[readerCur] = Config_Fingerprint(1);	}
+	Reader_Select(cur);						}
+
+/* Description: Program the write block in cfgBlock into the staged bank *******
+ * The erase block is erased when its first write block is programmed, then the
+ * flash is read back.
+ * Input parameters: null
+ * return: CFG_OK, CFG_ERR_FLASH if it does not read back 	*/
+uchar Cfg_WriteBlock(void){
+	unsigned long addr;
+	const rom uchar *p;
+	uchar i, gie;
+	addr = CFG_BANK_ADDR + (unsigned long)cfgStage * CFG_BANK_SIZE + cfgBlockAddr;
+	gie = INTCONbits.GIEH;
+	INTCONbits.GIEH = 0;					//required sequence, no interrupt in between
+	if ((cfgBlockAddr % FLASH_ERASE_BLOCK) == 0){  EraseFlash(addr, addr + FLASH_ERASE_BLOCK - 1);  }
+	WriteBlockFlash(addr, 1, cfgBlock);
+	INTCONbits.GIEH = gie;
+	p = FLASH_PTR(addr);
+	for (i=0; i<FLASH_WRITE_BLOCK; i++){
+		if (p[i] != cfgBlock[i]){  return CFG_ERR_FLASH;  }	}
+	return CFG_OK;							}
+
+/* Description: Fill cfgBlock for the write block at cfgBlockAddr *************
+ * A delta starts from the bytes of the active bank, a full image from erased flash.
+ * Input parameters: null
+ * return: null 						*/
+void Cfg_LoadBlock(void){
+	const rom uchar *p;
+	uchar i;
+	p = Cfg_Bank(cfgBank) + cfgBlockAddr;
+	for (i=0; i<FLASH_WRITE_BLOCK; i++){  cfgBlock[i] = cfgDelta ? p[i] : 0xFF;  }	}
+
+/* Description: Move the staging window to the write block of a bank offset ****
+ * The blocks before it are programmed, the ones not sent too.
+ * Input parameters: addr--bank offset
+ * return: CFG_OK or the error of Cfg_WriteBlock 	*/
+uchar Cfg_Seek(uint addr){
+	uchar status;
+	addr &= ~(uint)(FLASH_WRITE_BLOCK - 1);
+	while (cfgBlockAddr < addr){
+		status = Cfg_WriteBlock();
+		if (status != CFG_OK){  return status;  }
+		cfgBlockAddr += FLASH_WRITE_BLOCK;
+		if (cfgBlockAddr < CFG_BANK_SIZE){  Cfg_LoadBlock();  }	}
+	return CFG_OK;							}
+
+/* Description: CFG_BEGIN frame, start staging an image ************************
+ * The image goes to the bank that is not active; its header block is erased
+ * first, so the bank is not valid until Cfg_Commit.
+ * Input parameters: null (cfgRx: version, length, CRC, base version of a delta)
+ * return: CFG_OK or CFG_ERR_xxx 	*/
+uchar Cfg_Begin(void){
+	unsigned long addr;
+	uint version;
+	uchar gie;
+	cfgStage = CFG_NONE;
+	if ((cfgRxLen != 6) && (cfgRxLen != 8)){  return CFG_ERR_RANGE;  }
+	version = ((uint)cfgRx[0] << 8) | cfgRx[1];
+	cfgStageLen = ((uint)cfgRx[2] << 8) | cfgRx[3];
+	cfgStageCrc = ((uint)cfgRx[4] << 8) | cfgRx[5];
+	if (cfgStageLen > CFG_RECORDS_MAX){  return CFG_ERR_RANGE;  }
+	if (!CFG_NEWER(version, cfgVersion)){  return CFG_ERR_VERSION;  }
+	cfgDelta = (cfgRxLen == 8);
+	if (cfgDelta && ((cfgBank == CFG_NONE) || ((((uint)cfgRx[6] << 8) | cfgRx[7]) != cfgVersion))){  return CFG_ERR_BASE;  }
+	cfgStage = (cfgBank == CFG_NONE) ? 0 : (cfgBank + 1) % CFG_BANKS;
+	cfgStageVersion = version;
+	addr = CFG_BANK_ADDR + (unsigned long)cfgStage * CFG_BANK_SIZE;
+	gie = INTCONbits.GIEH;
+	INTCONbits.GIEH = 0;
+	EraseFlash(addr, addr + FLASH_ERASE_BLOCK - 1);		//header block
+	INTCONbits.GIEH = gie;
+	cfgNext = 0;
+	cfgBlockAddr = CFG_RECORDS;
+	Cfg_LoadBlock();
+	return CFG_OK;							}
+
+/* Description: CFG_DATA frame, bytes of the records ***************************
+ * Offsets go up; the last frame sent again (its answer lost) is answered again.
+ * Input parameters: null (cfgRx: records offset, bytes)
+ * return: CFG_OK or CFG_ERR_xxx 	*/
+uchar Cfg_Data(void){
+	uint offset, addr;
+	uchar i, n, status;
+	if (cfgStage == CFG_NONE){  return CFG_ERR_STATE;  }
+	if (cfgRxLen < 2){  return CFG_ERR_RANGE;  }
+	offset = ((uint)cfgRx[0] << 8) | cfgRx[1];
+	n = cfgRxLen - 2;
+	if (n && (offset < cfgNext) && (offset + n == cfgNext)){  return CFG_OK;  }
+	if ((offset < cfgNext) || (offset > cfgStageLen) || (n > cfgStageLen - offset)){  return CFG_ERR_RANGE;  }
+	for (i=0; i<n; i++){
+		addr = CFG_RECORDS + offset + i;
+		status = Cfg_Seek(addr);
+		if (status != CFG_OK){
+			cfgStage = CFG_NONE;
+			return status;	}
+		cfgBlock[addr & (FLASH_WRITE_BLOCK - 1)] = cfgRx[2+i];	}
+	cfgNext = offset + n;
+	return CFG_OK;							}
+
+/* Description: CFG_COMMIT frame, switch to the staged image *******************
+ * The records are programmed and their CRC checked in flash, then the header is
+ * written: from that write on the staged bank is the newest valid one.
+ * Input parameters: null
+ * return: CFG_OK or CFG_ERR_xxx 	*/
+uchar Cfg_Commit(void){
+	const rom uchar *p;
+	uint i, crc;
+	uchar v, status;
+	if (cfgStage == CFG_NONE){  return CFG_ERR_STATE;  }
+	status = Cfg_Seek(CFG_RECORDS + cfgStageLen + FLASH_WRITE_BLOCK - 1);
+	p = Cfg_Bank(cfgStage) + CFG_RECORDS;
+	for (i=0, crc=0xFFFF; (status == CFG_OK) && (i<cfgStageLen); i++){
+		v = p[i];
+		crc = CRC16_Update(crc, &v, 1);	}
+	if ((status == CFG_OK) && (crc != cfgStageCrc)){  status = CFG_ERR_CRC;  }
+	if (status == CFG_OK){
+		for (i=0; i<FLASH_WRITE_BLOCK; i++){  cfgBlock[i] = 0xFF;  }
+		cfgBlock[0] = CFG_MAGIC;
+		cfgBlock[1] = CFG_FORMAT;
+		cfgBlock[2] = cfgStageVersion >> 8;
+		cfgBlock[3] = cfgStageVersion;
+		cfgBlock[4] = cfgStageLen >> 8;
+		cfgBlock[5] = cfgStageLen;
+		cfgBlock[6] = cfgStageCrc >> 8;
+		cfgBlock[7] = cfgStageCrc;
+		cfgBlockAddr = 0;
+		status = Cfg_WriteBlock();	}
+	cfgStage = CFG_NONE;
+	if (status == CFG_OK){  Cfg_Load();  }
+	return status;							}
+
+/* Description: Answer a configuration frame ***********************************
+ * Line K<code><value>: code CFG_OK or CFG_ERR_xxx, value the next records
+ * offset or the active version.
+ * Input parameters: code--CFG_xxx; value--16 bit value
+ * return: null 						*/
+void Cfg_Reply(uchar code, uint value){
+	TX_Putc('K');
+	TX_PutHex(code);
+	TX_PutHex16(value);
+	TX_Putc('\r');
+	TX_Flush();								}
+
+/* Description: Send the report asked by a CFG_REPORT frame *******************
+ * Input parameters: null (cfgRx[0]: CFG_REP_xxx, | CFG_REP_CLEAR)
+ * return: CFG_OK, CFG_ERR_RANGE for a report left out of the build	*/
+uchar Cfg_Report(void){
+	uchar clear;
+	if (cfgRxLen != 1){  return CFG_ERR_RANGE;  }
+	clear = cfgRx[0] & CFG_REP_CLEAR;
+	switch (cfgRx[0] & ~CFG_REP_CLEAR){
+		case CFG_REP_ISR:
+			sendIsrReport();
+			if (clear){  Isr_ResetStats();  }
+			break;
+#if RC522_TRANSPORT
+		case CFG_REP_TXN:
+			sendTxnStats();
+			if (clear){  TXN_ResetStats();  }
+			break;
+#endif
+#if RC522_DUMP
+		case CFG_REP_CACHE:
+			sendCacheStats();
+			if (clear){  Cache_ResetStats();  }
+			break;
+#endif
+#if RC522_GATE
+		case CFG_REP_READER:
+			sendReaderStats();
+			if (clear){  Gate_ResetStats();  }
+			break;
+#endif
+		case CFG_REP_RETRY:
+			sendRetryStats();
+			if (clear){  Retry_ResetStats();  }
+			break;
+		case CFG_REP_MEMORY:
+			sendMemoryReport();
+			break;
+#if FMT_BENCH
+		case CFG_REP_BENCH:
+			sendFormatBench();
+			break;
+#endif
+		default:
+			return CFG_ERR_RANGE;	}
+	return CFG_OK;							}
+
+/* Description: Run a configuration frame received by Cfg_Poll ****************
+ * Input parameters: null (cfgRxType, cfgRxLen, cfgRx)
+ * return: null 						*/
+void Cfg_Frame(void){
+	uchar status;
+	switch (cfgRxType){
+		case CFG_BEGIN:
+			status = Cfg_Begin();
+			Cfg_Reply(status, cfgVersion);
+			break;
+		case CFG_DATA:
+			status = Cfg_Data();
+			Cfg_Reply(status, cfgNext);
+			break;
+		case CFG_COMMIT:
+			status = Cfg_Commit();
+			Cfg_Reply(status, cfgVersion);
+			break;
+		case CFG_QUERY:
+			Cfg_Reply(CFG_OK, cfgVersion);
+			break;
+		case CFG_REPORT:
+			status = Cfg_Report();
+			Cfg_Reply(status, cfgRx[0]);
+			break;
+		default:									//not a configuration frame
+#if RC522_PERSO
+			Line_Frame();							//encoding line frames, see MFRC522-Perso.h
+#endif
+			break;	}						}
+
+/* Description: Receive configuration frames from the host *********************
+ * Called from the polling loops; takes the bytes received so far and runs at
+ * most one frame. A frame with a bad CRC is answered CFG_ERR_FRAME.
+ * Input parameters: null
+ * return: null 						*/
+void Cfg_Poll(void){
+	uchar c;
+	while (RX_Getc(&c)){
+		switch (cfgRxState){
+			case CFG_RX_SYNC:
+				if (c == CFG_SYNC){
+					cfgRxCrc = 0xFFFF;
+					cfgRxState = CFG_RX_TYPE;	}
+				break;
+			case CFG_RX_TYPE:
+				cfgRxType = c;
+				cfgRxCrc = CRC16_Update(cfgRxCrc, &c, 1);
+				cfgRxState = CFG_RX_LEN;
+				break;
+			case CFG_RX_LEN:
+				cfgRxLen = c;
+				cfgRxCrc = CRC16_Update(cfgRxCrc, &c, 1);
+				cfgRxPos = 0;
+				cfgRxState = (c > CFG_FRAME_MAX) ? CFG_RX_SYNC : (c ? CFG_RX_DATA : CFG_RX_CRC_H);
+				break;
+			case CFG_RX_DATA:
+				cfgRx[cfgRxPos++] = c;
+				cfgRxCrc = CRC16_Update(cfgRxCrc, &c, 1);
+				if (cfgRxPos == cfgRxLen){  cfgRxState = CFG_RX_CRC_H;  }
+				break;
+			case CFG_RX_CRC_H:
+				cfgRxCrc ^= (uint)c << 8;
+				cfgRxState = CFG_RX_CRC_L;
+				break;
+			default:								//CFG_RX_CRC_L
+				cfgRxCrc ^= c;
+				cfgRxState = CFG_RX_SYNC;
+				if (cfgRxCrc){  Cfg_Reply(CFG_ERR_FRAME, cfgNext);  }
+				else{  Cfg_Frame();  }
+				return;	}	}				}
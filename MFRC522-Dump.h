@@ -0,0 +1,650 @@
+/*
+ * Name: MFRC522-Dump.h
+ * Dump and format modes on top of MFRC522-Classic.h
+ * showSerialNumber (SW1), readDataHEX (SW2), readDataASCII (SW3) and the compact
+ * dump readDataCompact (SW4), with the card cache and the access bits read planner.
+ *
+ * Included by MFRC522-RFID-SPI.h when RC522_DUMP is set, see MFRC522-Modules.h.
+ */
+
+//block buffers of the dump pipeline, power of 2
+#define DUMP_BUFFERS 2
+
+//compact dump records, one per line, hex fields (see host/rc522_expand.c)
+//	I<flags><uid>		card start
+//	B<block><rle data>	block contents, *<n-1><byte> = n times byte
+//	R<block><count>		count data blocks from block repeat the last data block
+//	C<sector><crc16>	sector unchanged since the last dump, CRC-16 of its 64 bytes
+//	N<block>			block not read, its access bits forbid it (zeros in the CRC)
+//	X<block>			no data from block on (transaction stopped)
+//	E<crc16>			card end, CRC-16/CCITT of the 16 sector CRCs, high byte first
+#define COMPACT_ELIDE_TRAILERS 0x01			//default trailers are not sent
+#define COMPACT_RLE_MIN        3				//shortest run worth a * token
+
+//card cache: per-sector digests of the last cards dumped, least recently used replaced
+#define CACHE_ENTRIES          4
+#define CACHE_MISS             0xFF
+#define CACHE_SENTINEL         1				//block of each sector read to check it did not change
+#define CACHE_ALL_SECTORS      0xFFFF			//valid bits of a complete entry
+#define CACHE_FRESH_TAPS       0				//taps served without reading, 0 = always check
+
+//read planner: key of each block from the access bits of its sector trailer,
+//2 bits per block, block 0 in bits 1..0
+#define PLAN_SKIP              0				//the access bits forbid reading it with the keys
+#define PLAN_KEY_A             1
+#define PLAN_KEY_B             2
+#define PLAN_BLOCK(plan, i)    (((plan) >> (2*(i))) & 0x03)
+
+//prototype functions
+void readDataHEX(void);
+void readDataASCII(void);
+void readUltralight(uchar ascii);
+void sendPageToSerial(uchar page, uchar ascii, uchar *str);
+void readDataCompact(void);
+void Compact_Begin(uchar *uid, uchar uidLen);
+void Compact_FlushRun(void);
+void Compact_EndSector(void);
+void Compact_Block(uchar block, uchar *data);
+void Compact_Cached(uchar sector, uint digest);
+void Compact_Stop(uchar block);
+void Compact_End(void);
+uchar Cache_Find(uchar *uid, uchar uidLen);
+uchar Cache_Lookup(uchar *uid, uchar uidLen);
+void Cache_StoreSector(uchar entry, uchar sector, uint sentinel, uint digest);
+void Cache_Invalidate(uchar *uid, uchar uidLen);
+void Cache_InvalidateBlock(uchar blockAddr);
+void Cache_ResetStats(void);
+uchar Access_Decode(uchar *trailer, uchar *cond);
+uchar Access_Plan(uchar *trailer);
+uchar Plan_Sector(uchar entry, uchar sector);
+uchar Plan_Read(uchar blockAddr, uchar *recvData);
+void sendCacheStats(void);
+void sendToSerialASCII(int sector, int block, uchar status, uchar *str);
+void sendToSerialHEX(int block, uchar status, uchar *str);
+void showSerialNumber(void);
+
+//dump pipeline: the RF side reads block j while block j-1 is formatted and sent
+uchar dumpBlock[DUMP_BUFFERS][MAX_LEN];
+uchar dumpStatus[DUMP_BUFFERS];			//MI_OK or MI_NOACCESS of each buffer
+
+//compact dump encoder
+uchar compactFlags = COMPACT_ELIDE_TRAILERS;
+uchar compactLast[MAX_LEN];				//last data block sent
+uchar compactRunStart;					//first block of the pending run
+uchar compactRunCount;					//data blocks in the pending run, 0 if none
+uchar compactHaveLast;
+uint  compactCrc;						//CRC-16/CCITT of the image so far
+//sector trailer of a transport card as read with key A (key A reads as 0)
+const rom uchar compactTrailer[MAX_LEN] = {0x00,0x00,0x00,0x00,0x00,0x00,0xFF,0x07,0x80,0x69,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};
+uint  compactSectorCrc;					//CRC-16/CCITT of the current sector
+uint  compactSectorDigest;				//CRC of the last sector completed
+
+//card cache, one row per card; sector s is valid when bit s of cacheValid is set
+uchar cacheUid[CACHE_ENTRIES][MAX_UID_LEN];
+uchar cacheUidLen[CACHE_ENTRIES];		//0 = free entry
+uint  cacheStamp[CACHE_ENTRIES];		//cacheClock at last use
+uint  cacheValid[CACHE_ENTRIES];
+uchar cacheFresh[CACHE_ENTRIES];		//taps left to serve without reading
+uint  cacheSentinel[CACHE_ENTRIES][16];	//CRC of block CACHE_SENTINEL of each sector
+uint  cacheDigest[CACHE_ENTRIES][16];	//CRC of each sector
+uchar cachePlan[CACHE_ENTRIES][16];		//read plan of each sector, PLAN_BLOCK
+uint  cachePlanValid[CACHE_ENTRIES];	//sector s planned when bit s is set
+uint  cacheClock;
+uchar cacheCurrent = CACHE_MISS;		//entry of the selected card
+uchar cacheFreshTaps = CACHE_FRESH_TAPS;
+uint  cacheHits, cacheMisses;			//card lookups
+uint  cacheSectorsSkipped, cacheSectorsRead;
+uint  cacheInvalidations;
+uint  planTrailers;						//trailers read to plan a sector
+uint  planSkipped;						//blocks not read because of their access bits
+uint  planRestarts;						//reads lost under Crypto1: select and auth again
+
+//read planner of the sector being dumped
+uchar planCur;							//plan of the sector
+uchar planKey;							//key authenticated in the sector, PLAN_SKIP if none
+uchar planTrailer;						//trailer already read into framePool[FRAME_APP]
+const rom uchar accessRead[8] = {		//keys that read a data block, by C1C2C3: bit0 A, bit1 B
+	0x03, 0x03, 0x03, 0x02, 0x03, 0x02, 0x03, 0x00};
+
+//------------------------------------------------------------------------------
+
+/* Description: Send data read to serial monitor HEX format ********************
+ * Input parameter: null
+ * Return: null					 */
+void readDataHEX(void){
+	uchar j;
+	uchar status;
+	uchar entry;
+    //Select operation buck address  0 - 63
+	setup();
+	for(;;){
+		//Track the card in the field, dump it once
+		if (MFRC522_Presence() != PRESENCE_ARRIVE){  continue;  }
+		TX_Putrs("\nTAG's data in HEX format: ");TX_Putc('\r');Delay10KTCYx(10);
+		if (MFRC522_GetCardType(presenceSak) == PICC_TYPE_ULTRALIGHT){
+			readUltralight(0);
+			TX_Flush();
+			MFRC522_Halt();
+			continue;					}
+		//Sector by sector, trailer first, stop at the first stage that fails
+		entry = Cache_Lookup(presenceUid, presenceUidLen);
+		TXN_Begin();
+		status = MI_OK;
+		for(j=0; (j<64) && (status==MI_OK); j++){
+			if ((j & 0x03) == 0){  status = Plan_Sector(entry, j>>2);  }	//sector j/4
+			if (status == MI_OK){
+				status = Plan_Read(j, dumpBlock[j & (DUMP_BUFFERS-1)]);
+				dumpStatus[j & (DUMP_BUFFERS-1)] = status;
+				if (status == MI_NOACCESS){  status = MI_OK;  }	}
+			if (j){  sendToSerialHEX(j-1, dumpStatus[(j-1) & (DUMP_BUFFERS-1)], dumpBlock[(j-1) & (DUMP_BUFFERS-1)]);  }	}	//previous block streams during this read
+		if (status == MI_OK){  sendToSerialHEX(j-1, dumpStatus[(j-1) & (DUMP_BUFFERS-1)], dumpBlock[(j-1) & (DUMP_BUFFERS-1)]);  }
+		TX_Flush();
+		if (TXN_End() != MI_OK){  sendTxnResult();  }
+		MFRC522_Halt();						}}
+
+/* Description: Send data read to serial monitor ASCII format *******************
+ * Input parameter: null
+ * Return: null					 */
+void readDataASCII(void){
+	uchar j;
+	uchar status;
+	uchar entry;
+	setup();
+	for(;;){
+		//Track the card in the field, dump it once
+		if (MFRC522_Presence() != PRESENCE_ARRIVE){  continue;  }
+		//putsUSART(msg1);putcUSART('\r');Delay10KTCYx(10);
+		TX_Putrs("\n TAG's data in ASCII format:");TX_Putc('\r');Delay10KTCYx(10);
+		if (MFRC522_GetCardType(presenceSak) == PICC_TYPE_ULTRALIGHT){
+			readUltralight(1);
+			TX_Flush();
+			MFRC522_Halt();
+			continue;					}
+		//Sector by sector, trailer first, stop at the first stage that fails
+		entry = Cache_Lookup(presenceUid, presenceUidLen);
+		TXN_Begin();
+		status = MI_OK;
+		for(j=0; (j<64) && (status==MI_OK); j++){
+			if ((j & 0x03) == 0){  status = Plan_Sector(entry, j>>2);  }	//sector j/4
+			if (status == MI_OK){
+				status = Plan_Read(j, dumpBlock[j & (DUMP_BUFFERS-1)]);
+				dumpStatus[j & (DUMP_BUFFERS-1)] = status;
+				if (status == MI_NOACCESS){  status = MI_OK;  }	}
+			if (j){  sendToSerialASCII((j-1)>>2, j-1, dumpStatus[(j-1) & (DUMP_BUFFERS-1)], dumpBlock[(j-1) & (DUMP_BUFFERS-1)]);  }	}	//previous block streams during this read
+		if (status == MI_OK){  sendToSerialASCII((j-1)>>2, j-1, dumpStatus[(j-1) & (DUMP_BUFFERS-1)], dumpBlock[(j-1) & (DUMP_BUFFERS-1)]);  }
+		TX_Flush();
+		if (TXN_End() != MI_OK){  sendTxnResult();  }
+		MFRC522_Halt();	} }
+
+/* Description: Send Ultralight / NTAG pages to serial monitor *****************
+ * Uses FAST_READ (15 pages per frame) when the card answers GET_VERSION,
+ * otherwise the 4 pages READ. The card must be selected.
+ * Input parameter: ascii--0 HEX format, 1 ASCII format
+ * Return: null					 */
+void readUltralight(uchar ascii){
+	static uchar frame[MAX_FRAME_LEN];
+	uchar uidLen, sak;
+	uchar pages, page, last, i;
+	uchar status;
+	pages = UL_PAGES_DEFAULT;
+	if (MFRC522_UL_GetVersion(frame) == MI_OK){  pages = MFRC522_UL_PageCount(frame);  }
+	else{											//plain Ultralight: select again
+		MFRC522_Request(PICC_REQALL, frame);
+		if (MFRC522_SelectCard(framePool[FRAME_APP], &uidLen, &sak) != MI_OK){  return;  }
+		for (page=0; page<pages; page+=4){
+			status = MFRC522_Read(page, frame);
+			if (status != MI_OK){  return;  }
+			for (i=0; i<4; i++){  sendPageToSerial(page+i, ascii, &frame[4*i]);  }	}
+		return;	}
+	for (page=0; page<pages; page+=UL_FAST_READ_PAGES){
+		last = page + UL_FAST_READ_PAGES - 1;
+		if (last >= pages){  last = pages - 1;  }
+		status = MFRC522_UL_FastRead(page, last, frame);
+		if (status != MI_OK){  return;  }
+		for (i=0; i<=last-page; i++){  sendPageToSerial(page+i, ascii, &frame[4*i]);  }	}	}
+
+/* Description: Send one 4 bytes page to serial monitor ************************
+ * Input parameter: page number, ascii--0 HEX format, 1 ASCII format, pointer to page data
+ * Return: null					 */
+void sendPageToSerial(uchar page, uchar ascii, uchar *str){
+	uchar i;
+	if (ascii){
+		TX_Putrs("Page ");
+		TX_PutDec(page, 3);
+		TX_Putrs(": ");
+		for(i=0;i<4;i++){  TX_PutAscii(str[i]);  }	}
+	else{
+		TX_PutDec(page, 3);
+		TX_Putc(':');
+		for(i=0;i<4;i++){  TX_Putc(' ');  TX_PutHex(str[i]);  }	}
+	TX_Putc('\r');							}
+
+/* Description: Send data read to serial monitor in compact format *************
+ * Identical blocks are folded into runs, default trailers elided and block
+ * contents run length encoded; host/rc522_expand.c restores the 1 KB image.
+ * A card already in the cache only has its sentinel block read per sector;
+ * sectors that did not change are sent as C records and the host takes them
+ * from its last image of the card. Blocks the access bits of their trailer
+ * forbid are not read and are sent as N records.
+ * Input parameter: null
+ * Return: null					 */
+void readDataCompact(void){
+	uchar i,j,s;
+	uchar blk;
+	uchar status;
+	uchar entry;
+	uint sentinel;
+	setup();
+	for(;;){
+		//Track the card in the field, dump it once
+		if (MFRC522_Presence() != PRESENCE_ARRIVE){  continue;  }
+		if (MFRC522_GetCardType(presenceSak) == PICC_TYPE_ULTRALIGHT){
+			MFRC522_Halt();
+			continue;					}
+		Compact_Begin(presenceUid, presenceUidLen);
+		entry = Cache_Lookup(presenceUid, presenceUidLen);
+		TXN_Begin();
+		status = MI_OK;
+		if (cacheFresh[entry] && (cacheValid[entry] == CACHE_ALL_SECTORS)){	//recent enough, no reads
+			cacheFresh[entry]--;
+			for (s=0; s<16; s++){  Compact_Cached(s, cacheDigest[entry][s]);  }
+			cacheSectorsSkipped += 16;	}
+		//Sector by sector, stop at the first stage that fails
+		else for(s=0; (s<16) && (status==MI_OK); s++){
+			j = 4*s;
+			blk = j;
+			status = Plan_Sector(entry, s);						//trailer first unless planned
+			if ((status == MI_OK) && (cacheValid[entry] & ((uint)1 << s))){
+				status = Plan_Read(j+CACHE_SENTINEL, dumpBlock[0]);
+				if ((status == MI_OK) && (CRC16_Update(0xFFFF, dumpBlock[0], MAX_LEN) == cacheSentinel[entry][s])){
+					Compact_Cached(s, cacheDigest[entry][s]);
+					cacheSectorsSkipped++;
+					continue;	}
+				if (status == MI_NOACCESS){  status = MI_OK;  }
+				cacheValid[entry] &= ~((uint)1 << s);	}	//changed, read it all
+			for(i=0; (i<4) && (status==MI_OK); i++){
+				blk = j+i;
+				status = Plan_Read(blk, dumpBlock[i & (DUMP_BUFFERS-1)]);
+				dumpStatus[i & (DUMP_BUFFERS-1)] = status;
+				if (status == MI_NOACCESS){  status = MI_OK;  }
+				else if (i == CACHE_SENTINEL){  sentinel = CRC16_Update(0xFFFF, dumpBlock[i & (DUMP_BUFFERS-1)], MAX_LEN);  }
+				if (i){  Compact_Block(blk-1, (dumpStatus[(i-1) & (DUMP_BUFFERS-1)] == MI_OK) ? dumpBlock[(i-1) & (DUMP_BUFFERS-1)] : 0);  }	}	//previous block streams during this read
+			if (status == MI_OK){
+				Compact_Block(blk, (dumpStatus[3 & (DUMP_BUFFERS-1)] == MI_OK) ? dumpBlock[3 & (DUMP_BUFFERS-1)] : 0);
+				if (PLAN_BLOCK(planCur, CACHE_SENTINEL) != PLAN_SKIP){		//else no sentinel, read it every time
+					Cache_StoreSector(entry, s, sentinel, compactSectorDigest);	}
+				cacheSectorsRead++;	}	}
+		if (status == MI_OK){
+			if (cacheValid[entry] == CACHE_ALL_SECTORS){  cacheFresh[entry] = cacheFreshTaps;  }	}
+		else{  Compact_Stop(blk);  }
+		Compact_End();
+		TX_Flush();
+		if (TXN_End() != MI_OK){  sendTxnResult();  }
+		MFRC522_Halt();						}}
+
+/* Description: Start the compact dump of a card *******************************
+ * Input parameters: uid--card UID, uidLen--its length
+ * return: null 						*/
+void Compact_Begin(uchar *uid, uchar uidLen){
+	uchar i;
+	compactRunCount = 0;
+	compactHaveLast = 0;
+	compactCrc = 0xFFFF;
+	compactSectorCrc = 0xFFFF;
+	TX_Putc('I');
+	TX_PutHex(compactFlags);
+	for (i=0; i<uidLen; i++){  TX_PutHex(uid[i]);  }
+	TX_Putc('\r');							}
+
+/* Description: Send the pending run of repeated blocks *************************
+ * Input parameters: null
+ * return: null 						*/
+void Compact_FlushRun(void){
+	if (!compactRunCount){  return;  }
+	TX_Putc('R');
+	TX_PutHex(compactRunStart);
+	TX_PutHex(compactRunCount);
+	TX_Putc('\r');
+	compactRunCount = 0;					}
+
+/* Description: Close the sector CRC and add it to the card CRC ****************
+ * Input parameters: null
+ * return: null 						*/
+void Compact_EndSector(void){
+	uchar digest[2];
+	compactSectorDigest = compactSectorCrc;
+	digest[0] = compactSectorCrc >> 8;
+	digest[1] = compactSectorCrc & 0xFF;
+	compactCrc = CRC16_Update(compactCrc, digest, 2);
+	compactSectorCrc = 0xFFFF;				}
+
+/* Description: Add one block to the compact dump ******************************
+ * Input parameters: block--block address, in order; data--16 bytes read, or
+ *                   null if the read plan skipped the block
+ * return: null 						*/
+void Compact_Block(uchar block, uchar *data){
+	uchar i, n;
+	uchar same;
+	compactSectorCrc = CRC16_Update(compactSectorCrc, data, MAX_LEN);
+	if (!data){
+		Compact_FlushRun();
+		TX_Putc('N');
+		TX_PutHex(block);
+		TX_Putc('\r');
+		if ((block & 0x03) == 3){  Compact_EndSector();  }
+		return;	}
+	if ((block & 0x03) == 3){								//sector trailer
+		Compact_EndSector();
+		for (i=0, same=1; (i<MAX_LEN) && same; i++){  same = (data[i] == compactTrailer[i]);  }
+		if (same && (compactFlags & COMPACT_ELIDE_TRAILERS)){  return;  }
+		Compact_FlushRun();	}
+	else{
+		for (i=0, same=compactHaveLast; (i<MAX_LEN) && same; i++){  same = (data[i] == compactLast[i]);  }
+		if (same){
+			if (!compactRunCount){  compactRunStart = block;  }
+			compactRunCount++;
+			return;	}
+		Compact_FlushRun();
+		for (i=0; i<MAX_LEN; i++){  compactLast[i] = data[i];  }
+		compactHaveLast = 1;	}
+	TX_Putc('B');
+	TX_PutHex(block);
+	for (i=0; i<MAX_LEN; i+=n){
+		for (n=1; (i+n<MAX_LEN) && (data[i+n] == data[i]); n++);
+		if (n >= COMPACT_RLE_MIN){
+			TX_Putc('*');
+			TX_Putc(hexDigit[n-1]);	}
+		else{  n = 1;  }
+		TX_PutHex(data[i]);	}
+	TX_Putc('\r');							}
+
+/* Description: Add a sector unchanged since the last dump *********************
+ * Input parameters: sector--sector number, in order; digest--its cached CRC
+ * return: null 						*/
+void Compact_Cached(uchar sector, uint digest){
+	Compact_FlushRun();
+	TX_Putc('C');
+	TX_PutHex(sector);
+	TX_PutHex(digest >> 8);
+	TX_PutHex(digest & 0xFF);
+	TX_Putc('\r');
+	compactSectorCrc = digest;
+	Compact_EndSector();					}
+
+/* Description: Mark the rest of the card as not read **************************
+ * Input parameters: block--first block without data
+ * return: null 						*/
+void Compact_Stop(uchar block){
+	Compact_FlushRun();
+	TX_Putc('X');
+	TX_PutHex(block);
+	TX_Putc('\r');
+	for (; block<64; block++){
+		compactSectorCrc = CRC16_Update(compactSectorCrc, 0, MAX_LEN);
+		if ((block & 0x03) == 3){  Compact_EndSector();  }	}	}
+
+/* Description: End the compact dump of a card *********************************
+ * Input parameters: null
+ * return: null 						*/
+void Compact_End(void){
+	Compact_FlushRun();
+	TX_Putc('E');
+	TX_PutHex(compactCrc >> 8);
+	TX_PutHex(compactCrc & 0xFF);
+	TX_Putc('\r');							}
+
+/* Description: Find a card in the cache ***************************************
+ * Input parameters: uid--card UID, uidLen--its length
+ * return: entry, CACHE_MISS if the card is not cached	*/
+uchar Cache_Find(uchar *uid, uchar uidLen){
+	uchar e, i;
+	uchar same;
+	for (e=0; e<CACHE_ENTRIES; e++){
+		if (cacheUidLen[e] != uidLen){  continue;  }
+		for (i=0, same=1; (i<uidLen) && same; i++){  same = (cacheUid[e][i] == uid[i]);  }
+		if (same){  return e;  }	}
+	return CACHE_MISS;						}
+
+/* Description: Get the cache entry of a card **********************************
+ * On a miss the least recently used entry is given to the card, with no
+ * valid sector. The entry becomes the one of the selected card.
+ * Input parameters: uid--card UID, uidLen--its length
+ * return: entry 						*/
+uchar Cache_Lookup(uchar *uid, uchar uidLen){
+	uchar e, i;
+	e = Cache_Find(uid, uidLen);
+	if (e != CACHE_MISS){  cacheHits++;  }
+	else{
+		cacheMisses++;
+		for (e=0, i=1; i<CACHE_ENTRIES; i++){				//free entry or oldest stamp
+			if (!cacheUidLen[e]){  break;  }
+			if (!cacheUidLen[i] || ((uint)(cacheClock - cacheStamp[i]) > (uint)(cacheClock - cacheStamp[e]))){  e = i;  }	}
+		for (i=0; i<uidLen; i++){  cacheUid[e][i] = uid[i];  }
+		cacheUidLen[e] = uidLen;
+		cacheValid[e] = 0;
+		cachePlanValid[e] = 0;
+		cacheFresh[e] = 0;	}
+	cacheStamp[e] = ++cacheClock;
+	cacheCurrent = e;
+	return e;								}
+
+/* Description: Keep the digests of one sector just read ***********************
+ * Input parameters: entry--cache entry; sector--sector number;
+ *                   sentinel--CRC of its block CACHE_SENTINEL; digest--CRC of the sector
+ * return: null 						*/
+void Cache_StoreSector(uchar entry, uchar sector, uint sentinel, uint digest){
+	cacheSentinel[entry][sector] = sentinel;
+	cacheDigest[entry][sector] = digest;
+	cacheValid[entry] |= (uint)1 << sector;	}
+
+/* Description: Forget a card **************************************************
+ * Input parameters: uid--card UID, uidLen--its length
+ * return: null 						*/
+void Cache_Invalidate(uchar *uid, uchar uidLen){
+	uchar e;
+	e = Cache_Find(uid, uidLen);
+	if (e == CACHE_MISS){  return;  }
+	cacheUidLen[e] = 0;
+	cacheValid[e] = 0;
+	cachePlanValid[e] = 0;
+	cacheFresh[e] = 0;
+	cacheInvalidations++;					}
+
+/* Description: Forget the sector of a block of the selected card **************
+ * Called by the operations that write the card. Writing a trailer also
+ * drops the read plan of its sector.
+ * Input parameters: blockAddr--block written
+ * return: null 						*/
+void Cache_InvalidateBlock(uchar blockAddr){
+	if (cacheCurrent == CACHE_MISS){  return;  }
+	cacheValid[cacheCurrent] &= ~((uint)1 << ((blockAddr >> 2) & 0x0F));
+	if ((blockAddr & 0x03) == 3){  cachePlanValid[cacheCurrent] &= ~((uint)1 << ((blockAddr >> 2) & 0x0F));  }
+	cacheFresh[cacheCurrent] = 0;
+	cacheInvalidations++;					}
+
+/* Description: Clear the cache counters ***************************************
+ * Input parameters: null
+ * return: null 						*/
+void Cache_ResetStats(void){
+	cacheHits = 0;
+	cacheMisses = 0;
+	cacheSectorsSkipped = 0;
+	cacheSectorsRead = 0;
+	cacheInvalidations = 0;
+	planTrailers = 0;
+	planSkipped = 0;
+	planRestarts = 0;						}
+
+/* Description: Decode the access bits of a sector trailer *********************
+ * Bytes 6..8 hold C1, C2, C3 of the 4 blocks and their inverted copies:
+ * byte 6 = ~C2 | ~C1, byte 7 = C1 | ~C3, byte 8 = C3 | C2 (high | low nibble).
+ * Input parameters: trailer--16 bytes of block 3; cond--4 bytes, C1C2C3 of
+ *                   blocks 0..3 as bits 2..0
+ * return: MI_OK, MI_ERR if a copy does not match (sector blocked) */
+uchar Access_Decode(uchar *trailer, uchar *cond){
+	uchar i;
+	uchar b6, b7, b8;
+	b6 = trailer[6];
+	b7 = trailer[7];
+	b8 = trailer[8];
+	if ((((b6 & 0x0F) ^ (b7 >> 4)) != 0x0F) || (((b6 >> 4) ^ (b8 & 0x0F)) != 0x0F)
+		|| (((b7 & 0x0F) ^ (b8 >> 4)) != 0x0F)){  return MI_ERR;  }
+	for (i=0; i<4; i++){
+		cond[i] = (((b7 >> (4+i)) & 0x01) << 2) | (((b8 >> i) & 0x01) << 1) | ((b8 >> (4+i)) & 0x01);	}
+	return MI_OK;							}
+
+/* Description: Plan the reads of a sector from its trailer ********************
+ * Key A when it may read the block, else key B when the trailer lets it
+ * authenticate (key B not readable: C1C2C3 of the trailer 011, 1xx), else
+ * the block is skipped. The trailer itself is read with key A. Both keys
+ * come from Cfg_Key.
+ * Input parameters: trailer--16 bytes of block 3
+ * return: plan, PLAN_BLOCK(plan, i) of block i 	*/
+uchar Access_Plan(uchar *trailer){
+	uchar cond[4];
+	uchar i, plan, keyB, keys;
+	plan = PLAN_KEY_A << 6;
+	if (Access_Decode(trailer, cond) != MI_OK){  return plan;  }	//data blocks no longer readable
+	keyB = (cond[3] > 2);
+	for (i=0; i<3; i++){
+		keys = accessRead[cond[i]];
+		if (keys & 0x01){  plan |= PLAN_KEY_A << (2*i);  }
+		else if ((keys & 0x02) && keyB){  plan |= PLAN_KEY_B << (2*i);  }	}
+	return plan;							}
+
+/* Description: Get the read plan of a sector of the selected card *************
+ * Taken from the card cache, or the trailer is authenticated with key A and
+ * read first into framePool[FRAME_APP]; Plan_Read then does not read it again.
+ * Input parameters: entry--cache entry of the card; sector--sector number
+ * return: status of the auth or read, TXN_Check already done 	*/
+uchar Plan_Sector(uchar entry, uchar sector){
+	uchar status;
+	uchar trailer;
+	planKey = PLAN_SKIP;
+	planTrailer = 0;
+	if (cachePlanValid[entry] & ((uint)1 << sector)){
+		planCur = cachePlan[entry][sector];
+		return MI_OK;	}
+	trailer = 4*sector + 3;
+	status = TXN_Check(STAGE_AUTH, MFRC522_AuthRom(PICC_AUTHENT1A,trailer,Cfg_Key(PICC_AUTHENT1A,trailer),&presenceUid[presenceUidLen-4]));
+	if (status == MI_OK){  status = TXN_Check(STAGE_READ, MFRC522_Read(trailer, framePool[FRAME_APP]));  }
+	if (status != MI_OK){  return status;  }
+	planKey = PLAN_KEY_A;
+	planTrailer = 1;
+	planTrailers++;
+	planCur = Access_Plan(framePool[FRAME_APP]);
+	cachePlan[entry][sector] = planCur;
+	cachePlanValid[entry] |= (uint)1 << sector;
+	return MI_OK;							}
+
+/* Description: Read one block of the sector planned by Plan_Sector ************
+ * Authenticates again only when the block needs the other key. A read lost to
+ * noise is not resent under Crypto1 (the card dropped to IDLE): the card is
+ * selected and authenticated again, then read once more.
+ * Input parameters: blockAddr--block address; recvData--16 bytes read
+ * return: status, MI_NOACCESS if the plan skips the block (no TXN_Check) */
+uchar Plan_Read(uchar blockAddr, uchar *recvData){
+	uchar i;
+	uchar key, mode, status, attempt;
+	key = PLAN_BLOCK(planCur, blockAddr & 0x03);
+	if (key == PLAN_SKIP){
+		planSkipped++;
+		return MI_NOACCESS;	}
+	if (((blockAddr & 0x03) == 3) && planTrailer){
+		for (i=0; i<MAX_LEN; i++){  recvData[i] = framePool[FRAME_APP][i];  }
+		return MI_OK;	}
+	for (attempt=0; ; attempt++){
+		if (key != planKey){
+			mode = (key == PLAN_KEY_B) ? PICC_AUTHENT1B : PICC_AUTHENT1A;
+			status = TXN_Check(STAGE_AUTH, MFRC522_AuthRom(mode,blockAddr,Cfg_Key(mode,blockAddr),&presenceUid[presenceUidLen-4]));
+			if (status != MI_OK){  return status;  }
+			planKey = key;	}
+		status = MFRC522_Read(blockAddr, recvData);
+		if ((status == MI_OK) || attempt || ((status != MI_CRCERR) && !Retry_Wanted(status))){  break;  }
+		planKey = PLAN_SKIP;						//no key authenticated any more
+		planRestarts++;
+		if (MFRC522_Reselect() != MI_OK){  break;  }	}
+	return TXN_Check(STAGE_READ, status);	}
+
+/* Description: Send the cache counters to serial ******************************
+ * Input parameters: null
+ * return: null 						*/
+void sendCacheStats(void){
+	TX_Putrs("Cache hits ");
+	TX_PutDec(cacheHits, 0);
+	TX_Putrs(" misses ");
+	TX_PutDec(cacheMisses, 0);
+	TX_Putrs("\rSectors cached ");
+	TX_PutDec(cacheSectorsSkipped, 0);
+	TX_Putrs(" read ");
+	TX_PutDec(cacheSectorsRead, 0);
+	TX_Putrs("\rInvalidated ");
+	TX_PutDec(cacheInvalidations, 0);
+	TX_Putrs("\rTrailers planned ");
+	TX_PutDec(planTrailers, 0);
+	TX_Putrs(" blocks without access ");
+	TX_PutDec(planSkipped, 0);
+	TX_Putrs("\rReads restarted ");
+	TX_PutDec(planRestarts, 0);
+	TX_Putc('\r');
+	TX_Flush();								}
+
+/* Description: Send data read to serial monitor ASCII format ******************
+ * Input parameter: sector, block, status and pointer to string read
+ * Return: null					 */
+void sendToSerialASCII(int sector, int block, uchar status, uchar *str){
+	int i;
+	if(status == MI_OK){
+		TX_Putrs("Sector ");
+		TX_PutDec(sector, 2);
+		TX_Putrs(", block ");
+		TX_PutDec(block, 2);
+		TX_Putrs(": ");
+		for(i=0;i<16;i++)		{
+			TX_PutAscii(str[i]);	}
+		TX_Putc('\r');	   }
+	else if(status == MI_NOACCESS){
+		TX_Putrs("Sector ");
+		TX_PutDec(sector, 2);
+		TX_Putrs(", block ");
+		TX_PutDec(block, 2);
+		TX_Putrs(": no access\r");	}}
+
+/* Description: Send data read to serial monitor HEX format ********************
+ * Input parameter: sector, block, status and pointer to string read
+ * Return: null					 */
+void sendToSerialHEX(int block, uchar status, uchar *str){
+	uchar i;
+	if(status == MI_OK){
+		TX_PutDec(block, 2);
+		TX_Putc(':');
+		for(i=0;i<16;i++){  TX_Putc(' ');  TX_PutHex(str[i]);  }
+		TX_Putc('\r');	}
+	else if(status == MI_NOACCESS){
+		TX_PutDec(block, 2);
+		TX_Putrs(": no access\r");	}}
+
+/* Description: Shows TAG's serial number **************************************
+ * Input parameter: null
+ * Return: null					 */
+void showSerialNumber(void){
+	uchar event;
+	uchar i;
+	setup();
+	for(;;){
+		//Track the card in the field, report arrival and removal once
+		event = MFRC522_Presence();
+		if (event == PRESENCE_ARRIVE){
+			TX_Putc('\r');
+	    	TX_Putrs("Card detected\r");	//Serial.println("Card detected");
+			TX_PutHex(presenceAtqa[0]);	//Serial.print(str[0],BIN);
+	        TX_Putrs(" , ");	//Serial.print(" , ");
+			TX_PutHex(presenceAtqa[1]);	//Serial.print(str[1],BIN);
+	        TX_Putrs("   ");	//Serial.println(" ");
+	    	TX_Putrs("The card's number is: \r");		//Serial.println("The card's number is  : ");
+			for (i=0; i<presenceUidLen; i++){
+				if (i){  TX_Putc(' ');  }
+				TX_PutHex(presenceUid[i]);	}
+			TX_Putc('\r');
+			MFRC522_Halt();		}
+		if (event == PRESENCE_LEAVE){  TX_Putrs("Card removed\r");  }	}}
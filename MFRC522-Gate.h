@@ -0,0 +1,241 @@
+/*
+ * Name: MFRC522-Gate.h
+ * Gate scan mode on top of MFRC522-RFID-SPI.h
+ * readDataGate (SW1+SW2): every reader of the SPI bus scans its field with one
+ * frame in flight, UID then blocks gateFirstBlock..gateLastBlock. Only needs the
+ * core: the access control profile links nothing else.
+ *
+ * Included by MFRC522-RFID-SPI.h when RC522_GATE is set, see MFRC522-Modules.h.
+ */
+
+//gate scan of each reader: UID, then blocks GATE_FIRST_BLOCK..GATE_LAST_BLOCK (defaults
+//of gateFirstBlock, gateLastBlock)
+#define GATE_FIRST_BLOCK       4
+#define GATE_LAST_BLOCK        6
+#define GATE_REQA              0				//gate scan state of a reader
+#define GATE_ANTICOLL          1
+#define GATE_SELECT            2
+#define GATE_AUTH              3
+#define GATE_READ              4
+#define GATE_HALT              5
+
+//prototype functions
+void Reader_Service(void);
+void Gate_Start(uchar r);
+void Gate_Finish(uchar r, uchar status, uint backLen);
+void Gate_SendBlock(uchar r);
+void Gate_ResetStats(void);
+void sendReaderStats(void);
+void readDataGate(void);
+
+//gate scan, one frame in flight per reader
+uchar readerBusy[READER_COUNT];
+uint  readerPolls[READER_COUNT];
+uchar readerState[READER_COUNT];		//GATE_xxx
+uchar readerLevel[READER_COUNT];		//cascade level being selected
+uchar readerBlock[READER_COUNT];		//next block to read
+uchar gateFirstBlock = GATE_FIRST_BLOCK;
+uchar gateLastBlock = GATE_LAST_BLOCK;
+uchar readerUid[READER_COUNT][MAX_UID_LEN];
+uchar readerUidLen[READER_COUNT];
+uchar readerFrame[READER_COUNT][MAX_LEN+2];
+uint  readerFrames[READER_COUNT];		//frames exchanged
+uint  readerBlocks[READER_COUNT];		//blocks read
+uint  readerErrors[READER_COUNT];		//scans stopped by an error
+
+//------------------------------------------------------------------------------
+
+/* Description: Run the gate scan of every reader *******************************
+ * Round robin: a reader with a frame in flight is only checked, so the air
+ * time of all readers overlaps and only the SPI accesses are serialized.
+ * Input parameters: null
+ * return: null 						*/
+void Reader_Service(void){
+	uchar r, done, status;
+	uint backLen;
+	Cfg_Poll();
+	Boot_Poll();
+	for (r=0; r<READER_COUNT; r++){
+		Reader_Select(r);
+		if (readerBusy[r]){
+			done = MFRC522_ToCardDone();
+			if (!done && --readerPolls[r]){  continue;  }
+			readerBusy[r] = 0;
+			backLen = 0;
+			status = MFRC522_ToCardFinish(done, readerFrame[r], MAX_LEN+2, &backLen);
+			readerFrames[r]++;
+			if (status == MI_TIMEOUT){						//the chip timer did not end it
+				Health_Check();
+				readerState[r] = GATE_REQA;	}
+			Gate_Finish(r, status, backLen);	}
+		Gate_Start(r);	}
+	TX_Poll();								}
+
+/* Description: Start the next frame of the gate scan of a reader **************
+ * Input parameters: r--reader, selected
+ * return: null 						*/
+void Gate_Start(uchar r){
+	uchar i, command;
+	uchar *frame;
+	const rom uchar *key;
+	frame = readerFrame[r];
+	command = PCD_TRANSCEIVE;
+	switch (readerState[r]){
+		case GATE_REQA:
+			Boot_FirstReqa();
+			ClearBitMask(Status2Reg, 0x08);					//MFCrypto1On=0
+			Write_MFRC522(BitFramingReg, 0x07);				//7 bits short frame
+			frame[0] = PICC_REQIDL;
+			MFRC522_SetTimeout(TIMEOUT_SHORT);
+			i = 1;
+			break;
+		case GATE_ANTICOLL:
+			Write_MFRC522(BitFramingReg, 0x00);
+			frame[0] = readerLevel[r];
+			frame[1] = 0x20;
+			MFRC522_SetTimeout(TIMEOUT_SELECT);
+			i = 2;
+			break;
+		case GATE_SELECT:											//frame holds the UID bytes and BCC
+			frame[0] = readerLevel[r];
+			frame[1] = 0x70;
+			CalulateCRC(frame, 7, &frame[7]);
+			MFRC522_SetTimeout(TIMEOUT_SELECT);
+			i = 9;
+			break;
+		case GATE_AUTH:
+			frame[0] = PICC_AUTHENT1A;
+			frame[1] = readerBlock[r];
+			key = Cfg_Key(PICC_AUTHENT1A, readerBlock[r]);
+			for (i=0; i<6; i++){  frame[i+2] = key[i];  }
+			for (i=0; i<4; i++){  frame[i+8] = readerUid[r][readerUidLen[r]-4+i];  }	//last 4 UID bytes
+			MFRC522_SetTimeout(TIMEOUT_AUTH);
+			command = PCD_AUTHENT;
+			i = 12;
+			break;
+		case GATE_READ:
+			frame[0] = PICC_READ;
+			frame[1] = readerBlock[r];
+			CalulateCRC(frame, 2, &frame[2]);
+			MFRC522_SetTimeout(TIMEOUT_READ);
+			i = 4;
+			break;
+		default:													//GATE_HALT
+			frame[0] = PICC_HALT;
+			frame[1] = 0;
+			CalulateCRC(frame, 2, &frame[2]);
+			MFRC522_SetTimeout(TIMEOUT_HALT);
+			i = 4;
+			break;	}
+	MFRC522_ToCardStart(command, frame, i);
+	readerPolls[r] = READER_POLLS;
+	readerBusy[r] = 1;						}
+
+/* Description: Take the answer of a gate scan frame and choose the next one ***
+ * Input parameters: r--reader, selected; status--MI_xxx; backLen--answer bits
+ * return: null 						*/
+void Gate_Finish(uchar r, uchar status, uint backLen){
+	uchar i, check;
+	uchar *frame;
+	frame = readerFrame[r];
+	switch (readerState[r]){
+		case GATE_REQA:
+			if ((status != MI_OK) || (backLen != 0x10)){				//no card, ask again
+				if (++healthIdle >= HEALTH_PERIOD){  healthIdle = 0;  Health_Check();  }
+				return;	}
+			readerLevel[r] = PICC_ANTICOLL;
+			readerUidLen[r] = 0;
+			readerState[r] = GATE_ANTICOLL;
+			return;
+		case GATE_ANTICOLL:
+			for (i=0, check=0; i<4; i++){  check ^= frame[i];  }
+			if ((status != MI_OK) || (check != frame[4])){  break;  }
+			for (i=0; i<4; i++){  readerUid[r][readerUidLen[r]+i] = frame[i];  }	//kept until the SAK tells their use
+			for (i=5; i>0; i--){  frame[i+1] = frame[i-1];  }		//UID bytes and BCC after SEL, NVB
+			readerState[r] = GATE_SELECT;
+			return;
+		case GATE_SELECT:
+			if ((status != MI_OK) || (backLen != 0x18)){  break;  }
+			if (frame[0] & 0x04){									//cascade tag, UID continues
+				if (readerLevel[r] == PICC_ANTICOLL_CL3){  break;  }
+				for (i=0; i<3; i++){  readerUid[r][readerUidLen[r]+i] = readerUid[r][readerUidLen[r]+i+1];  }
+				readerUidLen[r] += 3;
+				readerLevel[r] += 2;
+				readerState[r] = GATE_ANTICOLL;
+				return;	}
+			readerUidLen[r] += 4;
+			readerBlock[r] = gateFirstBlock;
+			readerState[r] = GATE_AUTH;
+			return;
+		case GATE_AUTH:
+			if ((status != MI_OK) || !(Read_MFRC522(Status2Reg) & 0x08)){  break;  }
+			readerState[r] = GATE_READ;
+			return;
+		case GATE_READ:
+			if ((status != MI_OK) || (backLen != 0x90)){  break;  }
+			Gate_SendBlock(r);
+			readerBlocks[r]++;
+			if (++readerBlock[r] > gateLastBlock){  readerState[r] = GATE_HALT;  }
+			else if ((readerBlock[r] & 0x03) == 0){  readerState[r] = GATE_AUTH;  }
+			return;
+		default:													//GATE_HALT, no answer expected
+			readerState[r] = GATE_REQA;
+			return;	}
+	readerErrors[r]++;
+	readerState[r] = GATE_HALT;				}
+
+/* Description: Send one block read by the gate scan to serial *****************
+ * One line per block, so the lines of several readers do not mix:
+ * <reader> <uid> <block>:<data>
+ * Input parameters: r--reader; the block is in readerFrame[r]
+ * return: null 						*/
+void Gate_SendBlock(uchar r){
+	uchar i;
+	TX_Putc('0' + r);
+	TX_Putc(' ');
+	for (i=0; i<readerUidLen[r]; i++){  TX_PutHex(readerUid[r][i]);  }
+	TX_Putc(' ');
+	TX_PutHex(readerBlock[r]);
+	TX_Putc(':');
+	for (i=0; i<MAX_LEN; i++){  TX_PutHex(readerFrame[r][i]);  }
+	TX_Putc('\r');							}
+
+/* Description: Clear the reader counters **************************************
+ * Input parameters: null
+ * return: null 						*/
+void Gate_ResetStats(void){
+	uchar r;
+	for (r=0; r<READER_COUNT; r++){
+		readerFrames[r] = 0;
+		readerBlocks[r] = 0;
+		readerErrors[r] = 0;	}			}
+
+/* Description: Send the reader counters to serial *****************************
+ * Input parameters: null
+ * return: null 						*/
+void sendReaderStats(void){
+	uchar r;
+	for (r=0; r<READER_COUNT; r++){
+		TX_Putrs("Reader ");
+		TX_PutDec(r, 0);
+		TX_Putrs(" frames ");
+		TX_PutDec(readerFrames[r], 0);
+		TX_Putrs(" blocks ");
+		TX_PutDec(readerBlocks[r], 0);
+		TX_Putrs(" errors ");
+		TX_PutDec(readerErrors[r], 0);
+		TX_Putc('\r');	}
+	TX_Flush();								}
+
+/* Description: Gate mode, every reader scans its field on its own ***************
+ * Each card is read once (it is halted), blocks gateFirstBlock..gateLastBlock
+ * are sent with Gate_SendBlock.
+ * Input parameter: null
+ * Return: null					 */
+void readDataGate(void){
+	uchar r;
+	setup();
+	for (r=0; r<READER_COUNT; r++){
+		readerState[r] = GATE_REQA;
+		readerBusy[r] = 0;	}
+	for(;;){  Reader_Service();  }			}
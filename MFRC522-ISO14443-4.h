@@ -0,0 +1,307 @@
+/*
+ * Name: MFRC522-ISO14443-4.h
+ * ISO14443-4 (T=CL) block protocol on top of MFRC522-RFID-SPI.h
+ * select card  ->  RATS  ->  PPS  ->  APDU exchange  ->  DESELECT
+ *
+ * Used by Mifare Pro(X), DESFire and smartcard credentials (SAK bit 0x20,
+ * PICC_TYPE_ISO14443_4). Included by MFRC522-RFID-SPI.h when RC522_TCL is set.
+ *
+ * - CRC_A is appended and checked by the MFRC522 (TxModeReg/RxModeReg CRCEn)
+ *   while a card is active, and switched off again on DESELECT.
+ * - Frames longer than the 64 bytes FIFO are streamed: the FIFO is refilled on
+ *   LoAlertIRq while sending and drained on HiAlertIRq while receiving, with
+ *   WaterLevelReg = TCL_WATER_LEVEL. Software SPI at Fcy 1 MHz moves a byte in
+ *   about 80 us, an air byte takes 85 us at 106 kbps: streaming only keeps up
+ *   at 106 kbps, so when a higher rate is asked FSD and the PCD blocks are kept
+ *   to the FIFO (TCL_FSDI_FIFO). A frame cut short by an empty FIFO is counted
+ *   in tclUnderruns and fails the block without a resend.
+ * - PPS switches TxModeReg/RxModeReg to 212, 424 or 848 kbps when the ATS
+ *   TA(1) byte allows it, up to the rate requested by the caller. A lost PPS
+ *   answer fails the activation: the card may already listen at the new rate.
+ * - I-block chaining in both directions, S(WTX) answered and the frame
+ *   waiting time extended by WTXM for that block only. No CID, no NAD.
+ */
+
+//PCD frame size: FSDI 7 = 128 bytes
+#define TCL_FSDI              7
+#define TCL_FSD               128
+#define TCL_FSDI_FIFO         5                  //64 bytes, above 106 kbps
+#define TCL_WATER_LEVEL       16                 //HiAlert at 48 bytes in FIFO, LoAlert at 16
+#define TCL_RETRIES           2                  //R(NAK) or I-block resends before giving up a block
+#define TCL_FWT_ACTIVATION_US 5287               //71680/fc, RATS answer time
+#define TCL_FWI_MAX           14                 //FWT 4949 ms, also the cap of a WTX extended FWT
+#define TCL_WTXM_MAX          59
+
+//ISO14443-4 command bits
+#define PICC_RATS             0xE0               //request answer to select
+#define PICC_PPS              0xD0               //protocol and parameter selection
+#define TCL_PCB_I             0x02               //I-block, bit0 block number
+#define TCL_PCB_CHAIN         0x10               //more I-blocks follow
+#define TCL_PCB_R_ACK         0xA2               //R-block ACK
+#define TCL_PCB_R_NAK         0xB2               //R-block NAK
+#define TCL_PCB_DESELECT      0xC2               //S-block DESELECT
+#define TCL_PCB_WTX           0xF2               //S-block waiting time extension
+
+//bit rates, as DSI/DRI codes and TxModeReg/RxModeReg TxSpeed/RxSpeed
+#define TCL_106KBPS           0
+#define TCL_212KBPS           1
+#define TCL_424KBPS           2
+#define TCL_848KBPS           3
+
+//prototype functions
+uchar MFRC522_TransceiveStream(uchar *sendData, uint sendLen, uchar *backData, uint backMax, uint *backLen);
+void MFRC522_SetBitRate(uchar txRate, uchar rxRate);
+unsigned long TCL_FwtUs(uchar fwi, uchar wtxm);
+uchar MFRC522_Rats(uchar fsdi, uchar *ats, uchar *atsLen);
+uchar MFRC522_Pps(uchar dsi, uchar dri);
+uchar MFRC522_TCL_Activate(uchar maxRate, uchar *ats, uchar *atsLen);
+uchar MFRC522_TCL_Block(uint sendLen, uint *backLen);
+uchar MFRC522_TCL_Exchange(uchar *apdu, uint apduLen, uchar *resp, uint respMax, uint *respLen);
+uchar MFRC522_TCL_Deselect(void);
+
+//frame size in bytes for FSCI / FSDI 0..8
+const rom uint tclFrameSize[9] = {16, 24, 32, 40, 48, 64, 96, 128, 256};
+//ModWidthReg for 106, 212, 424, 848 kbps
+const rom uchar tclModWidth[4] = {0x26, 0x15, 0x0A, 0x05};
+
+//active card parameters, from the ATS
+uchar tclFrame[TCL_FSD];				//shared send / receive frame
+uint  tclFsc;							//card frame size
+uint  tclFsd;							//PCD frame size asked in RATS
+uint  tclUnderruns;						//frames cut short, the FIFO ran empty while sending
+uchar tclFwi;							//frame waiting time integer
+uchar tclBlockNum;						//PCD block number
+
+//------------------------------------------------------------------------------
+
+/* Description: transceive a frame of any length through the 64 bytes FIFO ******
+ * Input parameter: sendData--data to send, sendLen--its length
+ *			 backData--received data, backMax--its size
+ *			 backLen--return the number of bytes received
+ * return: return MI_OK if successed, MI_NOTAGERR on timeout	*/
+uchar MFRC522_TransceiveStream(uchar *sendData, uint sendLen, uchar *backData, uint backMax, uint *backLen){
+	uchar status = MI_ERR;
+	uchar n, level;
+	uint sent, got, i;
+	Write_MFRC522(CommIEnReg, 0x77|0x80);	//Allow interruption
+	ClearBitMask(CommIrqReg, 0x80);			//Clear all the interrupt bits
+	SetBitMask(FIFOLevelReg, 0x80);			//FlushBuffer=1, FIFO initilizate
+	Write_MFRC522(CommandReg, PCD_IDLE);	//NO action;cancel current command
+	Write_MFRC522(WaterLevelReg, TCL_WATER_LEVEL);
+	Write_MFRC522(BitFramingReg, 0x00);		//whole bytes
+	for (sent=0; (sent<sendLen) && (sent<MAX_FRAME_LEN); sent++){  Write_MFRC522(FIFODataReg, sendData[sent]);  }
+	Write_MFRC522(CommandReg, PCD_TRANSCEIVE);
+	SetBitMask(BitFramingReg, 0x80);		//StartSend=1
+	got = 0;
+	i = 0xFFFF;								//guard only, the MFRC522 timer ends the wait
+	do {
+		//Set1 TxIRq RxIRq IdleIRq HiAlerIRq LoAlertIRq ErrIRq TimerIRq
+		n = Read_MFRC522(CommIrqReg);
+		TX_Poll();
+		if ((sent < sendLen) && (n & 0x40)){			//TxIRq with bytes left: the frame went out short
+			Write_MFRC522(CommandReg, PCD_IDLE);
+			ClearBitMask(BitFramingReg, 0x80);
+			tclUnderruns++;
+			return MI_ERR;	}
+		if ((sent < sendLen) && (n & 0x04)){			//LoAlert while sending: refill
+			level = Read_MFRC522(FIFOLevelReg) & 0x7F;
+			for (; (level < MAX_FRAME_LEN) && (sent < sendLen); level++){  Write_MFRC522(FIFODataReg, sendData[sent++]);  }
+			Write_MFRC522(CommIrqReg, 0x04);	}
+		if ((n & 0x40) && (n & 0x08)){					//HiAlert after TxIRq: drain
+			level = Read_MFRC522(FIFOLevelReg) & 0x7F;
+			for (; level; level--){
+				n = Read_MFRC522(FIFODataReg);
+				if (got < backMax){  backData[got] = n;  }
+				got++;	}
+			Write_MFRC522(CommIrqReg, 0x08);
+			n = 0x40;	}
+		i--;
+	}while ((i!=0) && !(n&0x31));				//RxIRq IdleIRq TimerIRq
+	ClearBitMask(BitFramingReg, 0x80);			//StartSend=0
+	if (i == 0){  return MI_ERR;  }
+	if ((n & 0x01) && !(n & 0x20)){  return MI_NOTAGERR;  }	//frame waiting time expired
+	if (Read_MFRC522(ErrorReg) & 0x1F){  return MI_ERR;  }	//BufferOvfl Collerr CRCErr ParityErr ProtecolErr
+	level = Read_MFRC522(FIFOLevelReg) & 0x7F;
+	for (; level; level--){
+		n = Read_MFRC522(FIFODataReg);
+		if (got < backMax){  backData[got] = n;  }
+		got++;	}
+	*backLen = got;
+	if (got <= backMax){  status = MI_OK;  }
+	return status;					}
+
+/* Description: set the air bit rate of both directions ************************
+ * Input parameter: txRate--PCD to PICC (DRI), rxRate--PICC to PCD (DSI), TCL_xxxKBPS
+ * Return: null					*/
+void MFRC522_SetBitRate(uchar txRate, uchar rxRate){
+	Write_MFRC522(TxModeReg, (Read_MFRC522(TxModeReg) & 0x8F) | (txRate << 4));
+	Write_MFRC522(RxModeReg, (Read_MFRC522(RxModeReg) & 0x8F) | (rxRate << 4));
+	Write_MFRC522(ModWidthReg, tclModWidth[txRate]);	}
+
+/* Description: frame waiting time in us **************************************
+ * FWT = 256*16/fc * 2^FWI = 302 us * 2^FWI, times WTXM, at most the FWT of
+ * TCL_FWI_MAX, plus timeoutMarginPct
+ * Input parameter: fwi--frame waiting time integer, wtxm--WTX multiplier 1..59 (1 if none)
+ * return: timeout for MFRC522_SetTimeoutUs		*/
+unsigned long TCL_FwtUs(uchar fwi, uchar wtxm){
+	unsigned long us;
+	us = (302UL << fwi) * wtxm;
+	if (us > (302UL << TCL_FWI_MAX)){  us = 302UL << TCL_FWI_MAX;  }
+	return us + us * timeoutMarginPct / 100;	}
+
+/* Description: request answer to select ***************************************
+ * Input parameter: fsdi--PCD frame size code, TCL_FSDI or TCL_FSDI_FIFO
+ *			 ats--return the ATS (TCL_FSD buffer), atsLen--its length
+ * return: return MI_OK if successed			*/
+uchar MFRC522_Rats(uchar fsdi, uchar *ats, uchar *atsLen){
+	uchar status;
+	uint len;
+	MFRC522_SetTimeoutUs(TCL_FWT_ACTIVATION_US + TCL_FWT_ACTIVATION_US * timeoutMarginPct / 100);
+	ats[0] = PICC_RATS;
+	ats[1] = (fsdi << 4) | 0;					//CID 0
+	status = MFRC522_TransceiveStream(ats, 2, ats, TCL_FSD, &len);
+	if ((status != MI_OK) || (len == 0) || (len != ats[0])){  return MI_ERR;  }	//TL = ATS length
+	*atsLen = len;
+	return MI_OK;					}
+
+/* Description: protocol and parameter selection *******************************
+ * Input parameter: dsi--PICC to PCD rate, dri--PCD to PICC rate, TCL_xxxKBPS
+ * return: return MI_OK if the card accepted, the new rate is then in use	*/
+uchar MFRC522_Pps(uchar dsi, uchar dri){
+	uchar status;
+	uint len;
+	uchar buff[3];
+	buff[0] = PICC_PPS;							//CID 0
+	buff[1] = 0x11;								//PPS1 follows
+	buff[2] = (dsi << 2) | dri;
+	status = MFRC522_TransceiveStream(buff, 3, buff, 3, &len);
+	if ((status != MI_OK) || (len != 1) || (buff[0] != PICC_PPS)){  return MI_ERR;  }
+	MFRC522_SetBitRate(dri, dsi);
+	return MI_OK;					}
+
+/* Description: enter ISO14443-4 on a selected card ****************************
+ * Input parameter: maxRate--highest bit rate wanted, TCL_xxxKBPS
+ *			 ats--return the ATS (TCL_FSD buffer), atsLen--its length
+ * return: return MI_OK if successed; a failed PPS leaves the card's rates
+ *	unknown, the card has to be taken out of the field (AntennaOff)	*/
+uchar MFRC522_TCL_Activate(uchar maxRate, uchar *ats, uchar *atsLen){
+	uchar status;
+	uchar t0, ta, i;
+	uchar ds, dr;
+	uint sfgt;
+	SetBitMask(TxModeReg, 0x80);				//TxCRCEn
+	SetBitMask(RxModeReg, 0x80);				//RxCRCEn
+	tclFsc = 32;								//defaults when not in ATS
+	tclFwi = 4;
+	tclBlockNum = 0;
+	tclFsd = maxRate ? tclFrameSize[TCL_FSDI_FIFO] : TCL_FSD;	//streaming only at 106 kbps
+	ta = 0;
+	status = MFRC522_Rats(maxRate ? TCL_FSDI_FIFO : TCL_FSDI, ats, atsLen);
+	if (status != MI_OK){
+		ClearBitMask(TxModeReg, 0x80);
+		ClearBitMask(RxModeReg, 0x80);
+		return status;	}
+	if (*atsLen > 1){
+		t0 = ats[1];
+		i = 2;
+		if ((t0 & 0x0F) < 9){  tclFsc = tclFrameSize[t0 & 0x0F];  }
+		if ((t0 & 0x10) && (i < *atsLen)){  ta = ats[i++];  }
+		if ((t0 & 0x20) && (i < *atsLen)){
+			tclFwi = ats[i] >> 4;
+			if (tclFwi == 15){  tclFwi = 4;  }
+			t0 = ats[i] & 0x0F;
+			if (t0 && t0 < 15){									//SFGT = 302us * 2^SFGI
+				for (sfgt=1u<<t0; sfgt; sfgt--){  Delay10TCYx(31);  }	}
+			i++;	}	}
+	MFRC522_SetTimeoutUs(TCL_FwtUs(tclFwi, 1));
+	//highest common rate per direction: TA(1) b7..b5 DS 8/4/2, b3..b1 DR 8/4/2
+	for (ds=maxRate; ds && !(ta & (0x08 << ds)); ds--);
+	for (dr=maxRate; dr && !(ta & (0x01 << (dr-1))); dr--);
+	if (ta & 0x80){  if (dr < ds){  ds = dr;  }  else{  dr = ds;  }  }	//same D both ways
+	if ((ds || dr) && (MFRC522_Pps(ds, dr) != MI_OK)){	//the card may have switched without an answer heard
+		ClearBitMask(TxModeReg, 0x80);
+		ClearBitMask(RxModeReg, 0x80);
+		return MI_ERR;	}
+	return MI_OK;					}
+
+/* Description: send one block from tclFrame and receive the answer in it *******
+ * Retransmission is asked with R(NAK) on timeout or transmission error, or
+ * with the same R(ACK) while receiving a chained response.
+ * Input parameter: sendLen--block length in tclFrame, backLen--return answer length
+ * return: return MI_OK if successed			*/
+uchar MFRC522_TCL_Block(uint sendLen, uint *backLen){
+	uchar status, retry, retryPcb;
+	uint underruns;
+	retryPcb = ((tclFrame[0] & 0xF6) == TCL_PCB_R_ACK) ? tclFrame[0] : (TCL_PCB_R_NAK | tclBlockNum);
+	underruns = tclUnderruns;
+	status = MFRC522_TransceiveStream(tclFrame, sendLen, tclFrame, TCL_FSD, backLen);
+	if (tclUnderruns != underruns){  return status;  }	//the card may have taken the short block
+	for (retry=0; (retry<TCL_RETRIES) && ((status != MI_OK) || (*backLen == 0)); retry++){
+		tclFrame[0] = retryPcb;
+		status = MFRC522_TransceiveStream(tclFrame, 1, tclFrame, TCL_FSD, backLen);	}
+	if ((status == MI_OK) && (*backLen == 0)){  status = MI_ERR;  }
+	return status;					}
+
+/* Description: exchange an APDU with the active card *************************
+ * Input parameter: apdu--command, apduLen--its length
+ *			 resp--response buffer, respMax--its size, respLen--return the response length
+ * return: return MI_OK if successed			*/
+uchar MFRC522_TCL_Exchange(uchar *apdu, uint apduLen, uchar *resp, uint respMax, uint *respLen){
+	uchar status, pcb, wtxm, retry;
+	uint chunk, maxInf, sent, got, len, i;
+	maxInf = ((tclFsc < tclFsd) ? tclFsc : tclFsd) - 3;		//PCB + CRC
+	sent = 0;
+	for (;;){									//send, chaining when longer than FSC
+		chunk = apduLen - sent;
+		pcb = TCL_PCB_I | tclBlockNum;
+		if (chunk > maxInf){  chunk = maxInf;  pcb |= TCL_PCB_CHAIN;  }
+		for (retry=0; ; retry++){
+			tclFrame[0] = pcb;
+			for (i=0; i<chunk; i++){  tclFrame[i+1] = apdu[sent+i];  }
+			status = MFRC522_TCL_Block(chunk + 1, &len);
+			if (status != MI_OK){  return status;  }
+			if (((tclFrame[0] & 0xF6) != TCL_PCB_R_ACK) || ((tclFrame[0] & 0x01) == tclBlockNum)){  break;  }
+			if (retry >= TCL_RETRIES){  return MI_ERR;  }	}	//R(ACK) of the previous block: send it again
+		sent += chunk;
+		if (!(pcb & TCL_PCB_CHAIN)){  break;  }
+		if ((tclFrame[0] & 0xF7) != (TCL_PCB_R_ACK | tclBlockNum)){  return MI_ERR;  }
+		tclBlockNum ^= 1;	}
+	got = 0;
+	for (;;){									//receive, answering WTX and chaining
+		pcb = tclFrame[0];
+		if ((pcb & 0xF7) == TCL_PCB_WTX){
+			wtxm = tclFrame[1] & 0x3F;
+			if ((wtxm == 0) || (wtxm > TCL_WTXM_MAX)){  return MI_ERR;  }	//protocol error
+			MFRC522_SetTimeoutUs(TCL_FwtUs(tclFwi, wtxm));
+			tclFrame[0] = TCL_PCB_WTX;
+			tclFrame[1] = wtxm;
+			status = MFRC522_TCL_Block(2, &len);
+			MFRC522_SetTimeoutUs(TCL_FwtUs(tclFwi, 1));
+			if (status != MI_OK){  return status;  }
+			continue;	}
+		if ((pcb & 0xE2) != TCL_PCB_I){  return MI_ERR;  }
+		for (i=1; i<len; i++){
+			if (got >= respMax){  return MI_ERR;  }
+			resp[got++] = tclFrame[i];	}
+		tclBlockNum ^= 1;
+		if (!(pcb & TCL_PCB_CHAIN)){  break;  }
+		tclFrame[0] = TCL_PCB_R_ACK | tclBlockNum;
+		status = MFRC522_TCL_Block(1, &len);
+		if (status != MI_OK){  return status;  }	}
+	*respLen = got;
+	return MI_OK;					}
+
+/* Description: leave ISO14443-4 and return the reader to 106 kbps *************
+ * Input parameter: null
+ * return: return MI_OK if the card acknowledged DESELECT	*/
+uchar MFRC522_TCL_Deselect(void){
+	uchar status;
+	uint len;
+	tclFrame[0] = TCL_PCB_DESELECT;
+	status = MFRC522_TransceiveStream(tclFrame, 1, tclFrame, TCL_FSD, &len);
+	if ((status == MI_OK) && ((len != 1) || ((tclFrame[0] & 0xF7) != TCL_PCB_DESELECT))){  status = MI_ERR;  }
+	MFRC522_SetBitRate(TCL_106KBPS, TCL_106KBPS);
+	ClearBitMask(TxModeReg, 0x80);				//TxCRCEn=0
+	ClearBitMask(RxModeReg, 0x80);				//RxCRCEn=0
+	MFRC522_SetTimeout(TIMEOUT_DEFAULT);
+	return status;					}
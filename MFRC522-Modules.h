@@ -0,0 +1,89 @@
+/*
+ * Name: MFRC522-Modules.h
+ * Build profile of the MFRC522 driver: the modules compiled into the image and
+ * the flash and RAM each one may take.
+ *
+ * Define RC522_PROFILE before including MFRC522-RFID-SPI.h to pick a profile,
+ * or RC522_<module> 0/1 to take one module out of it or add it.
+ *
+ *	module			header					modes and functions
+ *	core			MFRC522-RFID-SPI.h		registers, MFRC522 commands, timer, retries,
+ *											watchdog, readers, serial, ISRs, EEPROM, setup
+ *	RC522_TRANSPORT	MFRC522-Transport.h		REQA, anticollision, select, HALT, presence
+ *											tracker, transaction runner
+ *	RC522_CLASSIC	MFRC522-Classic.h		auth, read, write, value blocks, Ultralight pages
+ *	RC522_CONFIG	MFRC522-Config.h		configuration image over serial
+ *	RC522_DUMP		MFRC522-Dump.h			UID, hex, ASCII and compact dumps, card cache
+ *	RC522_PERSO		MFRC522-Perso.h			clear and write modes, encoding line (with
+ *											RC522_CONFIG)
+ *	RC522_TUNE		MFRC522-Tune.h			antenna tuning sweep
+ *	RC522_GATE		MFRC522-Gate.h			multi-reader gate scan
+ *	RC522_TCL		MFRC522-ISO14443-4.h	ISO14443-4 (T=CL) block protocol
+ *
+ * host/rc522_size.c reads the MPLINK map of a build (link with /m) and fails
+ * when a module takes more than its RC522_ROM_xxx / RC522_RAM_xxx budget.
+ */
+
+//profiles
+#define RC522_PROFILE_FULL     0				//every module, all the modes of main.c
+#define RC522_PROFILE_ACCESS   1				//gate scan and configuration image: access control unit
+#define RC522_PROFILE_READER   2				//dump modes
+#define RC522_PROFILE_ENCODER  3				//clear, write, encoding line and tuning modes
+#ifndef RC522_PROFILE
+#define RC522_PROFILE          RC522_PROFILE_FULL
+#endif
+
+//modules of the profile
+#ifndef RC522_TRANSPORT
+#define RC522_TRANSPORT        (RC522_PROFILE != RC522_PROFILE_ACCESS)
+#endif
+#ifndef RC522_CLASSIC
+#define RC522_CLASSIC          (RC522_PROFILE != RC522_PROFILE_ACCESS)
+#endif
+#ifndef RC522_DUMP
+#define RC522_DUMP             (RC522_PROFILE == RC522_PROFILE_FULL || RC522_PROFILE == RC522_PROFILE_READER)
+#endif
+#ifndef RC522_PERSO
+#define RC522_PERSO            (RC522_PROFILE == RC522_PROFILE_FULL || RC522_PROFILE == RC522_PROFILE_ENCODER)
+#endif
+#ifndef RC522_TUNE
+#define RC522_TUNE             (RC522_PROFILE == RC522_PROFILE_FULL || RC522_PROFILE == RC522_PROFILE_ENCODER)
+#endif
+#ifndef RC522_GATE
+#define RC522_GATE             (RC522_PROFILE == RC522_PROFILE_FULL || RC522_PROFILE == RC522_PROFILE_ACCESS)
+#endif
+#ifndef RC522_CONFIG
+#define RC522_CONFIG           1
+#endif
+#ifndef RC522_TCL
+#define RC522_TCL              (RC522_PROFILE == RC522_PROFILE_FULL)
+#endif
+
+//dependencies: the modes select and read cards with the lower modules
+#if (RC522_DUMP || RC522_PERSO || RC522_TUNE) && !(RC522_TRANSPORT && RC522_CLASSIC)
+#error "RC522_DUMP, RC522_PERSO and RC522_TUNE need RC522_TRANSPORT and RC522_CLASSIC"
+#endif
+
+//budgets, bytes: flash (code, rom tables, the configuration banks) and RAM of each
+//module. The flash budgets split the 30 KB above the bootloader, with 1 KB left for
+//main.c, the LCD and the C18 libraries. The RAM ones are ceilings and add up to more
+//than the 1536 bytes of the chip: rc522_size also checks the total of the build.
+//RAM of the core and the gate grows with READER_COUNT, budgets are for 4
+#define RC522_ROM_CORE         7424
+#define RC522_RAM_CORE         384
+#define RC522_ROM_TRANSPORT    2048
+#define RC522_RAM_TRANSPORT    64
+#define RC522_ROM_CLASSIC      2048
+#define RC522_RAM_CLASSIC      8
+#define RC522_ROM_CONFIG       4096
+#define RC522_RAM_CONFIG       112
+#define RC522_ROM_DUMP         5888
+#define RC522_RAM_DUMP         560
+#define RC522_ROM_PERSO        2304
+#define RC522_RAM_PERSO        96
+#define RC522_ROM_TUNE         1280
+#define RC522_RAM_TUNE         16
+#define RC522_ROM_GATE         1920
+#define RC522_RAM_GATE         192
+#define RC522_ROM_TCL          2560
+#define RC522_RAM_TCL          160
@@ -0,0 +1,261 @@
+/*
+ * Name: MFRC522-Perso.h
+ * Personalization modes on top of MFRC522-Classic.h
+ * clearTagsMemory zeroes the data blocks of each card presented, writeTagBlockMemory
+ * writes the templates of the configuration image, or the built-in sector 1 layout.
+ * encodeLine (SW2+SW3) writes a different image to each card, streamed by
+ * host/rc522_encode.c.
+ *
+ * Included by MFRC522-RFID-SPI.h when RC522_PERSO is set, see MFRC522-Modules.h.
+ */
+
+#if RC522_CONFIG
+//encoding line: the host sends the image of the next card in A5 frames of the
+//configuration receiver; each new card is written with it and read back, and its
+//C line lets the host send the following image while the operator swaps cards
+#ifndef LINE_BLOCKS
+#define LINE_BLOCKS            3				//blocks of a card image, 17 bytes of RAM each
+#endif
+#define LINE_REPORT            50				//cards between two R lines
+#define LINE_IMAGE             0x20				//image number, block index, blocks, block, 16 bytes
+#define LINE_STATS             0x21				//R line now
+#define LINE_IMAGE_LEN         (5+MAX_LEN)
+#define LINE_OK                0x00				//result of a card, C line
+#define LINE_ERR_AUTH          0x01				//key of the sector refused
+#define LINE_ERR_WRITE         0x02
+#define LINE_ERR_READ          0x03				//read back failed
+#define LINE_ERR_VERIFY        0x04				//read back differs from the image
+#define LINE_ERR_SAME          0x05				//card encoded last, presented again
+#define LINE_RESULTS           6
+#endif
+
+//prototype functions
+void clearTagsMemory(void);
+void writeTagBlockMemory(void);
+#if RC522_CONFIG
+uchar writeTagTemplates(void);
+void Line_Frame(void);
+uchar Line_Write(void);
+void Line_Result(uchar result);
+void sendLineStats(void);
+void encodeLine(void);
+#endif
+uchar writeTagBlockData(int block, const rom uchar *data);
+
+#if RC522_CONFIG
+//encoding line
+uchar lineImage[LINE_BLOCKS][1+MAX_LEN];	//block, 16 bytes
+uint  lineSeq;							//number of the image, given by the host
+uchar lineCount;						//blocks of the image, 0 = none
+uchar lineHave;							//blocks received, the image is ready at lineCount
+uchar lineLastUid[MAX_UID_LEN];			//card encoded last
+uchar lineLastUidLen;
+uint  lineResults[LINE_RESULTS];		//cards per LINE_xxx result
+uint  lineSeconds;						//since encodeLine started
+uint  lineTick;
+#endif
+
+//------------------------------------------------------------------------------
+
+/* Description: Clears all contents in user's data blocks **********************
+ * Input parameter: 
+ * Return: null					 */
+void clearTagsMemory(void){
+	uchar i,j;
+	uchar status;
+    //Select operation buck address  0 - 63
+	static const rom uchar dataXX[]={0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00};
+	//uchar dataXF[]={0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};
+	setup();
+	for(;;){
+		//Track the card in the field, clean it once
+		if (MFRC522_Presence() != PRESENCE_ARRIVE){  continue;  }
+		TX_Putrs("TAG's memory cleaning started");TX_Putc('\r');Delay10KTCYx(10);
+		//Sector by sector, stop at the first stage that fails
+		TXN_Begin();
+		status = MI_OK;
+		for(j=0; (j<16) && (status==MI_OK); j++){
+			status = TXN_Check(STAGE_AUTH, MFRC522_AuthRom(0x60,4*j,Cfg_Key(0x60,4*j),&presenceUid[presenceUidLen-4]));
+			for(i=(j ? 4*j : 1); (i<4*j+3) && (status==MI_OK); i++){	//skip block 0 and trailers
+				status = TXN_Check(STAGE_WRITE, writeTagBlockData(i,dataXX));	}	}
+		if (TXN_End() != MI_OK){  sendTxnResult();  }
+		MFRC522_Halt();						}}
+
+/* Description: write  TAG's memory bytes *****************************************
+ * Input parameter: null
+ * Return: null					 */
+void writeTagBlockMemory(void){
+	uchar status;
+	//built-in layout of sector 1, when the configuration image has no templates
+	static const rom uchar data04[]="License permit:B";
+	static const rom uchar data05[]="Penny Lane 63-C ";
+	static const rom uchar data06[]="London 59032    ";
+	setup();
+	for(;;){
+		//Track the card in the field, write it once
+		if (MFRC522_Presence() != PRESENCE_ARRIVE){  continue;  }
+		TXN_Begin();
+#if RC522_CONFIG
+		if (Cfg_Next(0, CFG_TEMPLATE)){  writeTagTemplates();  }	//blocks of the configuration image
+		else
+#endif
+		{
+			status = TXN_Check(STAGE_AUTH, MFRC522_AuthRom(0x60,4,Cfg_Key(0x60,4),&presenceUid[presenceUidLen-4]));	//sector 1
+			if(status==MI_OK){  status = TXN_Check(STAGE_WRITE, writeTagBlockData(4,data04));  }
+			if(status==MI_OK){  status = TXN_Check(STAGE_WRITE, writeTagBlockData(5,data05));  }
+			if(status==MI_OK){  status = TXN_Check(STAGE_WRITE, writeTagBlockData(6,data06));  }	}
+		if (TXN_End() != MI_OK){  sendTxnResult();  }
+		MFRC522_Halt();						}}
+
+#if RC522_CONFIG
+/* Description: Write the card templates of the configuration image ***********
+ * Blocks in image order, authenticated with Cfg_Key when the sector changes;
+ * block 0 and the sector trailers are never written. Stops at the first stage
+ * that fails, TXN_End gives the result.
+ * Input parameter: null
+ * Return: MI_OK if every block was written	*/
+uchar writeTagTemplates(void){
+	const rom uchar *d;
+	uchar status, sector;
+	status = MI_OK;
+	sector = 0xFF;
+	for (d = Cfg_Next(0, CFG_TEMPLATE); d && (status == MI_OK); d = Cfg_Next(d, CFG_TEMPLATE)){
+		if ((d[-1] < 1+MAX_LEN) || (d[0] == 0) || ((d[0] & 0x03) == 3) || (d[0] >= 64)){  continue;  }
+		if ((d[0] >> 2) != sector){
+			sector = d[0] >> 2;
+			status = TXN_Check(STAGE_AUTH, MFRC522_AuthRom(PICC_AUTHENT1A,d[0],Cfg_Key(PICC_AUTHENT1A,d[0]),&presenceUid[presenceUidLen-4]));
+			if (status != MI_OK){  break;  }	}
+		status = TXN_Check(STAGE_WRITE, writeTagBlockData(d[0],d+1));	}
+	return status;							}
+
+/* Description: LINE_IMAGE and LINE_STATS frames of the host *******************
+ * The blocks of an image come in order, index 0 starts a new image; a block
+ * already received is only answered again (the host lost its answer).
+ * Answer K<code><blocks received>.
+ * Input parameters: null (cfgRxType, cfgRxLen, cfgRx)
+ * return: null 						*/
+void Line_Frame(void){
+	uchar i, status;
+	uint seq;
+	if (cfgRxType == LINE_STATS){
+		sendLineStats();
+		Cfg_Reply(CFG_OK, lineResults[LINE_OK]);
+		return;	}
+	if (cfgRxType != LINE_IMAGE){  return;  }
+	seq = ((uint)cfgRx[0] << 8) | cfgRx[1];
+	status = CFG_OK;
+	if ((cfgRxLen != LINE_IMAGE_LEN) || (cfgRx[3] == 0) || (cfgRx[3] > LINE_BLOCKS) || (cfgRx[2] >= cfgRx[3])
+		|| (cfgRx[4] == 0) || ((cfgRx[4] & 0x03) == 3) || (cfgRx[4] >= 64)){  status = CFG_ERR_RANGE;  }
+	else if (cfgRx[2] == 0){					//first block of a new image
+		lineSeq = seq;
+		lineCount = cfgRx[3];
+		lineHave = 0;	}
+	else if ((seq != lineSeq) || (cfgRx[2] > lineHave)){  status = CFG_ERR_RANGE;  }
+	if ((status == CFG_OK) && (cfgRx[2] == lineHave)){
+		for (i=0; i<1+MAX_LEN; i++){  lineImage[lineHave][i] = cfgRx[4+i];  }
+		lineHave++;	}
+	Cfg_Reply(status, lineHave);			}
+
+/* Description: Write the image to the selected card and read it back *********
+ * Authenticated with Cfg_Key when the sector changes; each block is written,
+ * read and compared. Stops at the first block that fails.
+ * Input parameters: null
+ * return: LINE_OK or LINE_ERR_xxx 		*/
+uchar Line_Write(void){
+	uchar i, j, sector;
+	uchar *block, *buff;
+	buff = framePool[FRAME_APP];
+	sector = 0xFF;
+	for (i=0; i<lineCount; i++){
+		block = lineImage[i];
+		if ((block[0] >> 2) != sector){
+			sector = block[0] >> 2;
+			if (TXN_Check(STAGE_AUTH, MFRC522_AuthRom(PICC_AUTHENT1A,block[0],Cfg_Key(PICC_AUTHENT1A,block[0]),&presenceUid[presenceUidLen-4])) != MI_OK){
+				return LINE_ERR_AUTH;	}	}
+		if (TXN_Check(STAGE_WRITE, MFRC522_Write(block[0], block+1)) != MI_OK){  return LINE_ERR_WRITE;  }
+		if (TXN_Check(STAGE_READ, MFRC522_Read(block[0], buff)) != MI_OK){  return LINE_ERR_READ;  }
+		for (j=0; j<MAX_LEN; j++){
+			if (buff[j] != block[1+j]){
+				TXN_Check(STAGE_READ, MI_ERR);
+				return LINE_ERR_VERIFY;	}	}	}
+	return LINE_OK;							}
+
+/* Description: Answer a card to the host **************************************
+ * Line C<image><result><MI error><UID>. On LINE_OK the image is used up and the
+ * host sends the next one, else it stays for the next card.
+ * Input parameters: result--LINE_OK or LINE_ERR_xxx
+ * return: null 						*/
+void Line_Result(uchar result){
+	uchar i;
+	TX_Putc('C');
+	TX_PutHex16(lineSeq);
+	TX_PutHex(result);
+	TX_PutHex(txnError);
+	for (i=0; i<presenceUidLen; i++){  TX_PutHex(presenceUid[i]);  }
+	TX_Putc('\r');
+	lineResults[result]++;
+	if (result == LINE_OK){
+		lineCount = 0;
+		lineHave = 0;
+		for (i=0; i<presenceUidLen; i++){  lineLastUid[i] = presenceUid[i];  }
+		lineLastUidLen = presenceUidLen;
+		if ((lineResults[LINE_OK] % LINE_REPORT) == 0){  sendLineStats();  }	}
+	TX_Flush();								}
+
+/* Description: Send the rate of the encoding line *****************************
+ * Line R<seconds><cards><cards per minute><failed cards per LINE_ERR_xxx>,
+ * since encodeLine started.
+ * Input parameters: null
+ * return: null 						*/
+void sendLineStats(void){
+	uchar i;
+	TX_Putc('R');
+	TX_PutHex16(lineSeconds);
+	TX_PutHex16(lineResults[LINE_OK]);
+	TX_PutHex16(lineSeconds ? (uint)((unsigned long)lineResults[LINE_OK] * 60 / lineSeconds) : 0);
+	for (i=LINE_OK+1; i<LINE_RESULTS; i++){  TX_PutHex16(lineResults[i]);  }
+	TX_Putc('\r');
+	TX_Flush();								}
+
+/* Description: Encoding line, the next image of the host on each new card ****
+ * While the image is incomplete only the host frames are taken, a card put in
+ * the field waits for it. Each new card is written, answered with a C line and
+ * halted; the card encoded last is not written again.
+ * Input parameter: null
+ * Return: null					 */
+void encodeLine(void){
+	uchar i, result;
+	uint t;
+	setup();
+	lineTick = Tick_Read();
+	for(;;){
+		t = Tick_Read();
+		while ((uint)(t - lineTick) >= 1000){  lineTick += 1000;  lineSeconds++;  }
+		if ((lineCount == 0) || (lineHave < lineCount)){  Cfg_Poll();  continue;  }	//image of the next card
+		if (MFRC522_Presence() != PRESENCE_ARRIVE){  continue;  }
+		TXN_Begin();
+		result = (presenceUidLen == lineLastUidLen) ? LINE_ERR_SAME : LINE_OK;
+		for (i=0; (result == LINE_ERR_SAME) && (i<presenceUidLen); i++){
+			if (presenceUid[i] != lineLastUid[i]){  result = LINE_OK;  }	}
+		if (result == LINE_OK){  result = Line_Write();  }
+		TXN_End();
+		MFRC522_Halt();
+		Line_Result(result);	}}
+#endif
+
+/* Description: Write data to TAG's memory ************************************
+ * Input parameter: block to be written, dataArray
+ * Return: return MI_OK if successed					 */
+uchar writeTagBlockData(int block, const rom uchar *data) {
+	uchar status;
+	uchar i;
+	uchar *buff;
+	buff = framePool[FRAME_APP];
+	for (i=0; i<16; i++){  buff[i] = data[i];  }
+	status = MFRC522_Write(block, buff);
+	if(status == MI_OK){
+		TX_Putc('\r');
+		TX_Putrs("Sector ");
+		TX_PutDec(block, 2 | TX_DEC_ZERO);
+		TX_Putrs(" successfully written");	}
+	return status;								}	
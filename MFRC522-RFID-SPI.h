@@ -40,20 +40,121 @@
 
 #include <usart.h>
 #include <sw_spi.h>
+#include "MFRC522-Modules.h"			//build profile: modules and their budgets
 
 //#include "18F2550BOLT.h"			//universal library BOLT
 //#include "ADC-BOLT.h"				//Bolt-ADC-Channel-4 library  
 //#include "PUERTO-SERIAL-BOLT.h"
 
 #define	uchar	unsigned char
+#ifndef uint							//host builds (host/pic18) keep it 16 bit
 #define	uint	unsigned int
+#endif
 
 //data array maxium length
 #define MAX_LEN 16
+//longest frame the MFRC522 FIFO can hold
+#define MAX_FRAME_LEN 64
+//longest UID (triple size), bytes
+#define MAX_UID_LEN 10
+//serial transmit ring, power of 2
+#define TX_RING_SIZE 128
+#define TX_RING_MASK (TX_RING_SIZE-1)
+//shared frame buffers, one per call level that needs a frame at the same time
+#define FRAME_POOL 3
+#define FRAME_PCD  0						//frame built by a PICC command (Auth, Write, Halt...)
+#define FRAME_DATA 1						//data handed to a PICC command (anticollision, value block)
+#define FRAME_APP  2						//modes, presence tracker and tuning trial
+#define FRAME_LEN  (MAX_LEN+2)			//16 data bytes + CRC
+//TX_PutDec width flag: pad with '0' instead of ' '
+#define TX_DEC_ZERO 0x80
+//FMT_BENCH 1 adds sendFormatBench(), sprintf against TX_PutDec/TX_PutHex, sent as the
+//bench report of a CFG_REPORT frame (host/rc522_config.c -r bench)
+#ifndef FMT_BENCH
+#define FMT_BENCH 0
+#endif
+//software stack (STACK line of the linker script) and fill pattern of the usage report
+#define STACK_BASE  0x500
+#define STACK_SIZE  0x100
+#define STACK_PAINT 0xA5
+//interrupts, vectors in main.c: high priority MFRC522 IRQ and USART RX, low priority
+//TX drain and the tick; ISR_ENABLE 0 keeps the polled build of the host tools
+#ifndef ISR_ENABLE
+#define ISR_ENABLE 1
+#endif
+#define ISR_HIGH    0
+#define ISR_LOW     1
+//application work done from TX_Poll in the driver wait loops, e.g. the LCD of main.c
+#ifndef TX_POLL_HOOK
+#define TX_POLL_HOOK()
+#endif
+//serial receive ring, power of 2
+#define RX_RING_SIZE 16
+#define RX_RING_MASK (RX_RING_SIZE-1)
+//tick: Timer2 1:4, PR2+1 = 250 counts, 1 ms at Fcy 1 MHz
+#define TICK_PR2    249
+#define TICK_US_PER_COUNT 4
 
 //signal RST in RB4	 
 #define RST PORTBbits.RB4
 
+//readers on the shared SPI bus (SCK RB6, MOSI RB7, MISO RB3), each with its own
+//CS, RST and IRQ pins in readerPins; define READER_COUNT before the include
+#ifndef READER_COUNT
+#define READER_COUNT           1
+#endif
+#define READER_MAX             4
+#define READER_POLLS           2000				//polls of a frame in flight before giving up
+//antenna tuning profile of each reader, found by the sweep of MFRC522-Tune.h
+#define TUNE_EE_ADDR           0x00				//EEPROM profile of reader r at TUNE_EE_ADDR + r*TUNE_EE_SIZE
+#define TUNE_EE_SIZE           6				//magic, RFCfgReg, RxThresholdReg, CWGsPReg, ModGsPReg, checksum
+#define TUNE_EE_MAGIC          0xA5
+#define TUNE_REGS              4
+
+//frame retries: only frames that can be sent again without changing the card state
+#define RETRY_FRAME_MAX        18				//longest frame kept for a resend
+#define RETRY_ERRORS           0x93				//ErrorReg WrErr BufferOvfl ParityErr ProtocolErr: noise, resend
+#define RETRY_BACKOFF_10US     10				//wait before the first resend, x10 us, doubles each time
+#define RETRY_BACKOFF_MAX      100				//longest wait, x10 us
+//chip watchdog
+#define HEALTH_PERIOD          50				//polls without card between checks
+#define HEALTH_STARTUP_MS      50				//ms for the oscillator to start after a hard reset
+//boot timing: Timer0 16 bit, 1:256 prescaler, 256 us per tick at Fcy 1 MHz
+#define BOOT_TICK_US           256
+//SPI trace: every register access is queued as a T line, see host/rc522_replay.c
+//	T<seq><op><value><time>	seq 8 bit, op bit7 read, bits 5..0 register,
+//							op 0x40|r reader r selected; time Timer3 us, 16 bit
+#ifndef SPI_TRACE
+#define SPI_TRACE              0				//1: capture from the first access
+#endif
+#define TRACE_RECORDS          32				//power of 2
+#define TRACE_MASK             (TRACE_RECORDS-1)
+#define TRACE_READ             0x80
+#define TRACE_READER           0x40
+#define TRACE_LINE_LEN         12
+
+//MFRC522 timer prescaler: f(Timer) = 13.56MHz/(2*TPreScaler+1)
+#define TPRESCALER_10US       0x043              //9.96 us per tick, up to 652 ms
+#define TPRESCALER_500US      0xD3E              //0.5 ms per tick, up to 32 s
+
+//ISO14443-3 frame timing at 106 kbps, fc = 13.56 MHz
+#define FDT_MIN_US            92                 //1236/fc, PICC answer after the last PCD bit
+#define BIT_106_US            10                 //128/fc, one bit
+#define RX_START_US           (FDT_MIN_US + 5*BIT_106_US)	//timer stops after the 5th received bit
+
+//receive timeout profiles, selected by each command
+#define TIMEOUT_SHORT         0                  //REQA, WUPA
+#define TIMEOUT_SELECT        1                  //anticollision, select
+#define TIMEOUT_AUTH          2
+#define TIMEOUT_READ          3                  //READ, FAST_READ, GET_VERSION
+#define TIMEOUT_WRITE         4                  //command frame ACK, value operand
+#define TIMEOUT_NVM           5                  //ACK after EEPROM write: write data, transfer, page write
+#define TIMEOUT_HALT          6                  //no answer expected
+#define TIMEOUT_DEFAULT       7                  //value programmed by MFRC522_Init
+#define TIMEOUT_COUNT         8
+#define TIMEOUT_NONE          0xFF
+#define TIMEOUT_MARGIN_PCT    25                 //default margin added to every profile
+
 //MF522 command bits
 #define PCD_IDLE              0x00               //NO action; cancel current commands
 #define PCD_AUTHENT           0x0E               //verify password key
@@ -68,6 +169,9 @@
 #define PICC_REQALL           0x52               //Search all the cards in the antenna area
 #define PICC_ANTICOLL         0x93               //prevent conflict
 #define PICC_SElECTTAG        0x93               //select card
+#define PICC_ANTICOLL_CL2     0x95               //prevent conflict, cascade level 2
+#define PICC_ANTICOLL_CL3     0x97               //prevent conflict, cascade level 3
+#define PICC_CASCADE_TAG      0x88               //first UID byte when the UID continues on next level
 #define PICC_AUTHENT1A        0x60               //verify A password key
 #define PICC_AUTHENT1B        0x61               //verify B password key
 #define PICC_READ             0x30               //read 
@@ -78,10 +182,48 @@
 #define PICC_TRANSFER         0xB0               //Save data into buffer
 #define PICC_HALT             0x50               //sleep mode
 
+//Mifare Ultralight / NTAG21x command bits
+#define PICC_UL_WRITE         0xA2               //write one 4 byte page
+#define PICC_UL_GET_VERSION   0x60               //read product version (EV1, NTAG21x)
+#define PICC_UL_FAST_READ     0x3A               //read a range of pages in one frame (EV1, NTAG21x)
+#define UL_PAGES_DEFAULT      16                 //Ultralight without GET_VERSION
+#define UL_FAST_READ_PAGES    15                 //15 pages + CRC fit in the 64 bytes FIFO
+
+//card types decoded from SAK
+#define PICC_TYPE_UNKNOWN     0
+#define PICC_TYPE_ULTRALIGHT  1                  //Ultralight, Ultralight EV1/C, NTAG21x
+#define PICC_TYPE_MIFARE_MINI 2
+#define PICC_TYPE_MIFARE_1K   3
+#define PICC_TYPE_MIFARE_4K   4
+#define PICC_TYPE_ISO14443_4  5                  //Mifare Pro(X), DESFire
+#define PICC_TYPE_NOT_COMPLETE 6                 //cascade bit set, UID not complete
+
+//card presence events, returned by MFRC522_Presence
+#define PRESENCE_NONE         0                  //no card in the field
+#define PRESENCE_ARRIVE       1                  //new card selected, ready for a transaction
+#define PRESENCE_STAY         2                  //tracked card still in the field, halted
+#define PRESENCE_LEAVE        3                  //tracked card left the field
+#define PRESENCE_DEBOUNCE     2                  //missed WUPA answers before a card is gone
+
 //THe mistake code that return when communicate with MF522
 #define MI_OK                 0
-#define MI_NOTAGERR           1
+#define MI_NOTAGERR           1                  //no answer before the MFRC522 timer expired
 #define MI_ERR                2
+#define MI_CRCERR             3                  //CRC of the answer is wrong
+#define MI_COLLERR            4                  //bit collision, more than one card answered
+#define MI_AUTHERR            5                  //Crypto1 authentication refused
+#define MI_TIMEOUT            6                  //MFRC522 did not finish the command
+#define MI_NOACCESS           7                  //block not read, its access bits forbid it
+
+//transaction stages, for the per stage failure counters
+#define STAGE_REQUEST         0                  //REQA / WUPA
+#define STAGE_SELECT          1                  //anticollision and select
+#define STAGE_AUTH            2
+#define STAGE_READ            3
+#define STAGE_WRITE           4
+#define STAGE_VALUE           5                  //increment, decrement, restore, transfer
+#define STAGE_COUNT           6
+#define STAGE_NONE            0xFF
 
 //------------------MFRC522 register ----------------------
 //Page 0:Command and Status
@@ -154,12 +296,135 @@
 #define     Reserved34			  0x3F
 //---------------------------------------------------------
 
+//timeout, in us before margin, for TIMEOUT_SHORT..TIMEOUT_DEFAULT
+const rom unsigned long timeoutProfileUs[TIMEOUT_COUNT] = {
+	RX_START_US, RX_START_US, 1000, 2500, 2500, 10000, 1000, 15000};
+uchar timeoutMarginPct = TIMEOUT_MARGIN_PCT;	//tunable margin, percent
+uchar timeoutProfile = TIMEOUT_NONE;	//profile programmed in the MFRC522
+uint  timerPrescaler;					//TModeReg[3..0] + TPrescalerReg programmed
+uint  timerReload;						//TReloadReg programmed
+
+//serial transmit ring, drained by the low priority ISR, or by TX_Poll while the
+//driver waits for the card until the interrupts are on
+uchar txRing[TX_RING_SIZE];
+uchar txHead;							//next free byte
+volatile uchar txTail;					//next byte to send
+
+//serial receive ring, filled by the high priority ISR
+uchar rxRing[RX_RING_SIZE];
+volatile uchar rxHead;					//next free byte
+uchar rxTail;							//next byte to read
+uint  rxOverruns;						//bytes lost: ring full or USART overrun
+
+//interrupt service and its latency, Timer1 1:1 (us) in the ISRs
+uchar isrOn;							//Isr_Start done, the ISRs drain the transmit ring
+volatile uint tickCount;				//ms since Isr_Start, read with Tick_Read
+uint  isrCount[2];						//by ISR_HIGH, ISR_LOW
+uint  isrEntryMax[2];					//worst entry latency, us: CCP1 capture, Timer2 count
+uint  isrTimeMax[2];					//worst entry to exit, us
+uint  irqNoticeMax;						//worst MFRC522 IRQ edge to the driver seeing it, us
+volatile uchar readerIrqSeen[READER_COUNT];	//IRQ edge of the command in flight
+uint  readerIrqTime[READER_COUNT];		//its Timer1 time
+#if SPI_TRACE
+uchar txLineOpen;						//a line is being queued, trace lines wait
+
+//SPI trace ring, drained into the transmit ring between lines
+uchar traceOp[TRACE_RECORDS];
+uchar traceVal[TRACE_RECORDS];
+uchar traceSeq[TRACE_RECORDS];
+uint  traceTime[TRACE_RECORDS];
+uchar traceHead;						//next free record
+uchar traceTail;						//next record to send
+uchar traceNext;						//sequence number of the next access
+uchar traceReader = 0xFF;				//reader of the last record
+uchar traceFrozen;						//capture stopped, a driver line held the ring full
+uint  traceDropped;						//records lost once frozen
+#endif
+
+//frame pool shared by the driver instead of stack buffers
+uchar framePool[FRAME_POOL][FRAME_LEN];
+const rom uchar keyDefault[6] = {0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};	//transport key
+uint  stackPainted;						//bytes painted by Stack_Paint, 0 if not painted
+
+const rom char hexDigit[16] = {'0','1','2','3','4','5','6','7','8','9','A','B','C','D','E','F'};
+const rom uint decPlace[5] = {10000, 1000, 100, 10, 1};
+const rom unsigned long decPlaceLong[10] = {1000000000, 100000000, 10000000, 1000000, 100000, 10000, 1000, 100, 10, 1};
+
+//reader pins: LAT register and mask of CS and RST, PORT register and mask of the
+//IRQ pin (active low, push-pull); irqMask 0 = not wired, CommIrqReg is polled
+typedef struct {
+	volatile near uchar *csLat;
+	volatile near uchar *csTris;
+	uchar csMask;
+	volatile near uchar *rstLat;
+	volatile near uchar *rstTris;
+	uchar rstMask;
+	volatile near uchar *irqPort;
+	uchar irqMask;
+} READER_PINS;
+
+const rom READER_PINS readerPins[READER_MAX] = {
+	{&LATB, &TRISB, 0x04, &LATB, &TRISB, 0x10, &PORTB, 0x00},	//CS RB2, RST RB4, IRQ not wired
+	{&LATE, &TRISE, 0x01, &LATA, &TRISA, 0x01, &PORTB, 0x02},	//CS RE0, RST RA0, IRQ RB1
+	{&LATE, &TRISE, 0x02, &LATA, &TRISA, 0x02, &PORTC, 0x04},	//CS RE1, RST RA1, IRQ RC2
+	{&LATE, &TRISE, 0x04, &LATA, &TRISA, 0x04, &PORTC, 0x08}};	//CS RE2, RST RA2, IRQ RC3
+
+//reader handles: the driver works on readerCur, the shadow state of the others is kept here
+uchar readerCur;
+uchar readerTimeoutProfile[READER_COUNT];
+uint  readerTimerPrescaler[READER_COUNT];
+uint  readerTimerReload[READER_COUNT];
+#if RC522_DUMP
+uchar readerCacheCurrent[READER_COUNT];	//cacheCurrent of each reader
+#endif
+uchar readerWaitIRq[READER_COUNT];		//CommIrqReg bits that end the command in flight
+uchar readerVersion[READER_COUNT];		//VersionReg read by Reader_InitAll
+//tuning profile registers, in EEPROM order
+const rom uchar tuneRegs[TUNE_REGS] = {RFCfgReg, RxThresholdReg, CWGsPReg, ModGsPReg};
+
+//retry engine, per timeout profile; WRITE is not resent: the value operand has no answer on success.
+//Nothing is resent under Crypto1: a MIFARE Classic card that lost an encrypted frame went
+//back to IDLE, the caller selects and authenticates again (MFRC522_Reselect)
+uchar retryLimit[TIMEOUT_COUNT] = {0, 2, 0, 2, 0, 0, 0, 0};	//resends after the first try
+uchar retryBackoff = RETRY_BACKOFF_10US;
+uchar retryBackoffMax = RETRY_BACKOFF_MAX;
+uchar retryFrame[RETRY_FRAME_MAX];		//copy of the frame, sendData may be the answer buffer
+uchar errorRegLast;						//ErrorReg of the last frame
+uint  retryCount[TIMEOUT_COUNT];		//resends
+uint  retrySaved[TIMEOUT_COUNT];		//frames that passed after a resend
+uint  errorCount[8];					//frames with each ErrorReg bit set, bit 0 first
+uint  errorNoAnswer;					//answers expected but not received
+//chip watchdog counters
+uchar healthIdle;						//polls without card since the last check
+uint  healthChecks, healthFaults;
+uint  healthSoftResets, healthHardResets, healthDead;
+//warm start: a reader whose configuration fingerprint matches the expected one keeps
+//running without soft reset and antenna power cycle
+//configuration registers left by MFRC522_Init: register, mask, value; then the tuning profile
+const rom uchar configCheck[5][3] = {
+	{CommandReg,   0x30, 0x00},			//not powered down, receiver on
+	{TxControlReg, 0x03, 0x03},			//antenna on
+	{TxAutoReg,    0xFF, 0x40},			//100%ASK
+	{ModeReg,      0xFF, 0x3D},			//CRC preset 0x6363
+	{DivlEnReg,    0x80, 0x80}};		//IRQ pin push-pull
+//tuning registers after a reset: RFCfgReg, RxThresholdReg, CWGsPReg, ModGsPReg
+const rom uchar tuneDefault[TUNE_REGS] = {0x48, 0x84, 0x20, 0x20};
+uchar setupDone;						//peripherals opened
+uint  configFingerprint[READER_COUNT];	//expected fingerprint of each reader
+uchar readerWarm[READER_COUNT];			//1 if the last setup kept the configuration
+uint  bootTicks;						//boot to the first REQA, BOOT_TICK_US ticks, 0 until then
+uchar bootReported;						//sendBootReport done by Boot_Poll
+const rom char *rom timeoutName[TIMEOUT_COUNT] = {"reqa", "select", "auth", "read", "write", "nvm", "halt", "default"};
+const rom char *rom errorBitName[8] = {"protocol", "parity", "CRC", "collision", "overflow", "-", "temp", "write"};
 
 
 //prototype functions
 void delay1s(void);
 void setup(void);
 void MFRC522_Init(void);
+void MFRC522_SetTimer(uint reload);
+void MFRC522_SetTimeoutUs(unsigned long us);
+void MFRC522_SetTimeout(uchar profile);
 void Write_MFRC522(uchar addr, uchar val);
 uchar Read_MFRC522(uchar addr);
 void SetBitMask(uchar reg, uchar mask);
@@ -167,538 +432,223 @@ void ClearBitMask(uchar reg, uchar mask);
 void AntennaOn(void);
 void AntennaOff(void);
 void MFRC522_Reset(void);
-uchar MFRC522_Request(uchar reqMode, uchar *TagType);
 uchar MFRC522_ToCard(uchar command, uchar *sendData, uchar sendLen, uchar *backData, uint *backLen);
-uchar MFRC522_Anticoll(uchar *serNum);
+uchar MFRC522_ToCardLen(uchar command, uchar *sendData, uchar sendLen, uchar *backData, uchar backMax, uint *backLen);
+uchar MFRC522_ToCardProbe(uchar command, uchar *sendData, uchar sendLen, uchar *backData, uint *backLen);
+uchar MFRC522_ToCardTry(uchar command, uchar *sendData, uchar sendLen, uchar *backData, uchar backMax, uint *backLen, uchar probe);
+void MFRC522_ToCardStart(uchar command, uchar *sendData, uchar sendLen);
+uchar MFRC522_ToCardDone(void);
+uchar MFRC522_ToCardFinish(uchar done, uchar *backData, uchar backMax, uint *backLen);
+void Reader_Select(uchar r);
+void Reader_InitAll(void);
+uchar EEPROM_Read(uchar addr);
+void EEPROM_Write(uchar addr, uchar val);
+void Tune_Apply(uchar *profile);
+uchar Tune_Read(uchar *profile);
+uchar Tune_Load(void);
+uint Config_Fingerprint(uchar expected);
+uchar MFRC522_WarmStart(void);
+void Boot_Start(void);
+void Boot_FirstReqa(void);
+void Boot_Poll(void);
+void sendBootReport(void);
+void Tune_Save(uchar *profile);
+uchar Retry_Wanted(uchar status);
+void Retry_Backoff(uchar attempt);
+void Retry_ResetStats(void);
+void sendRetryStats(void);
+void Stack_Paint(void);
+uint Stack_Used(void);
+void sendMemoryReport(void);
+#if ISR_ENABLE
+void Isr_Start(void);
+uint Isr_Now(void);
+void Isr_Done(uchar level, uint start);
+void Isr_Tx(void);
+void Isr_Tick(uchar count);
+void Isr_ReaderEdge(uchar r, uint edge, uint start);
+#endif
+void Isr_Rx(void);
+void Isr_Notice(void);
+void Isr_ResetStats(void);
+void sendIsrReport(void);
+uint Tick_Read(void);
+uchar RX_Getc(uchar *c);
+uchar Health_Ok(void);
+uchar Health_Check(void);
 void CalulateCRC(uchar *pIndata, uchar len, uchar *pOutData);
-uchar MFRC522_SelectTag(uchar *serNum);
-uchar MFRC522_Auth(uchar authMode, uchar BlockAddr, uchar *Sectorkey, uchar *serNum);
-uchar MFRC522_Read(uchar blockAddr, uchar *recvData);
-uchar MFRC522_Write(uchar blockAddr, uchar *writeData);
-void MFRC522_Halt(void);
-void showSerialNumber(void);
-void sendToSerialASCII(int sector, int block, uchar status, uchar *str);
-void sendToSerialHEX(int block, uchar status, uchar *str);
-void readDataASCII(void);
-void readDataHEX(void);
-void clearTagsMemory(void);
-void writeTagBlockMemory(void);
+void MFRC522_CrcOn(uchar on);
 void witeDataToTagMemory(void);
-void writeTagBlockData(int block, uchar *data);
-
+void TX_Poll(void);
+void TX_Putc(char c);
+void TX_Puts(char *str);
+void TX_Flush(void);
+void TX_PutHex(uchar val);
+void TX_PutHex16(uint val);
+void TX_PutDec(uint val, uchar width);
+void TX_PutDecLong(unsigned long val, uchar width);
+void TX_PutAscii(uchar c);
+void TX_Putrs(const rom char *str);
+#if FMT_BENCH
+void sendFormatBench(void);
+#endif
+#if SPI_TRACE
+void Trace_Put(uchar op, uchar val);
+void Trace_Record(uchar op, uchar val);
+void Trace_Queue(char c);
+void Trace_Poll(void);
+#endif
+uint CRC16_Update(uint crc, uchar *data, uchar len);
+//module entry points used by the core and by lower modules; stand-ins when the
+//module is left out of the build profile
+#if RC522_DUMP
+extern uchar cacheCurrent;
+uchar Cache_Find(uchar *uid, uchar uidLen);
+void Cache_InvalidateBlock(uchar blockAddr);
+void Cache_ResetStats(void);
+void sendCacheStats(void);
+#else
+#define Cache_InvalidateBlock(blockAddr)
+#endif
+#if RC522_CONFIG
+void Cfg_Load(void);
+void Cfg_Poll(void);
+#else
+#define Cfg_Load()
+#define Cfg_Poll()
+#define Cfg_Next(data, type)           ((const rom uchar *)0)
+#define Cfg_Key(authMode, blockAddr)   keyDefault
+#endif
+#if RC522_PERSO && RC522_CONFIG
+void Line_Frame(void);
+#endif
+#if RC522_GATE
+void Gate_ResetStats(void);
+void sendReaderStats(void);
+#endif
 
 //------------------------------------------------------------------------------
 
-/* Description: Clears all contents in user's data blocks **********************
- * Input parameter: 
- * Return: null					 */
-void clearTagsMemory(void){
-	//4 bytes Serial number of card, the 5 bytes is verfiy bytes
-	uchar serNum[5];
-	//buffer A password, 16 buffer, the passowrd of every buffer is 6 byte 
-	uchar sectorX_KeyA[]={0xFF,0xFF,0xFF,0xFF,0xFF,0xFF}; 
-	uchar i,j;
-	uchar status;
-    uchar str[MAX_LEN];
-    //Select operation buck address  0 - 63
-	char msg1[]={"TAG's memory cleaning started"}; 	              
-	uchar dataXX[]={0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00};
-	//uchar dataXF[]={0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};
-	setup();
-	for(;;){
-		//Search card, return card types
-		status = MFRC522_Request(PICC_REQIDL, str);	
-		if (status == MI_OK){  }
-		//Prevent conflict, return the 4 bytes Serial number of the card
-		status = MFRC522_Anticoll(str);
-		for(i=0; i<5; i++){	 serNum[i]=str[i];  }	//memcpy(serNum, str, 5);
-		if (status == MI_OK){  
-			putsUSART(msg1);putcUSART('\r');Delay10KTCYx(10);    }
-		status = MFRC522_SelectTag(serNum);	
-		status = MFRC522_Auth(0x60,0,sectorX_KeyA,serNum);	//sector 0
-		if(status==MI_OK){   for(i=1;i<3;i++){   writeTagBlockData(i,dataXX);   }}
-		status = MFRC522_Auth(0x60,4,sectorX_KeyA,serNum);	//sector 1
-		if(status==MI_OK){   for(i=4;i<7;i++){   writeTagBlockData(i,dataXX);   }}
-		status = MFRC522_Auth(0x60,8,sectorX_KeyA,serNum);	//sector 2
-		if(status==MI_OK){   for(i=8;i<11;i++){   writeTagBlockData(i,dataXX);   }}
-		status = MFRC522_Auth(0x60,12,sectorX_KeyA,serNum);	//sector 3
-		if(status==MI_OK){   for(i=12;i<15;i++){   writeTagBlockData(i,dataXX);   }}
-		status = MFRC522_Auth(0x60,16,sectorX_KeyA,serNum);	//sector 4
-		if(status==MI_OK){   for(i=16;i<19;i++){   writeTagBlockData(i,dataXX);   }}
-		status = MFRC522_Auth(0x60,20,sectorX_KeyA,serNum);	//sector 5
-		if(status==MI_OK){   for(i=20;i<23;i++){   writeTagBlockData(i,dataXX);   }}
-		status = MFRC522_Auth(0x60,24,sectorX_KeyA,serNum);	//sector 6
-		if(status==MI_OK){   for(i=24;i<27;i++){   writeTagBlockData(i,dataXX);   }}
-		status = MFRC522_Auth(0x60,28,sectorX_KeyA,serNum);	//sector 7
-		if(status==MI_OK){   for(i=28;i<31;i++){   writeTagBlockData(i,dataXX);   }}
-		status = MFRC522_Auth(0x60,32,sectorX_KeyA,serNum);	//sector 8
-		if(status==MI_OK){   for(i=32;i<35;i++){   writeTagBlockData(i,dataXX);   }}
-		status = MFRC522_Auth(0x60,36,sectorX_KeyA,serNum);	//sector 9
-		if(status==MI_OK){   for(i=36;i<39;i++){   writeTagBlockData(i,dataXX);   }}
-		status = MFRC522_Auth(0x60,40,sectorX_KeyA,serNum);	//sector 10
-		if(status==MI_OK){   for(i=40;i<43;i++){   writeTagBlockData(i,dataXX);   }}
-		status = MFRC522_Auth(0x60,44,sectorX_KeyA,serNum);	//sector 11
-		if(status==MI_OK){   for(i=44;i<47;i++){   writeTagBlockData(i,dataXX);   }}
-		status = MFRC522_Auth(0x60,48,sectorX_KeyA,serNum);	//sector 12
-		if(status==MI_OK){   for(i=48;i<51;i++){   writeTagBlockData(i,dataXX);   }}
-		status = MFRC522_Auth(0x60,52,sectorX_KeyA,serNum);	//sector 13
-		if(status==MI_OK){   for(i=52;i<55;i++){   writeTagBlockData(i,dataXX);   }}
-		status = MFRC522_Auth(0x60,56,sectorX_KeyA,serNum);	//sector 14
-		if(status==MI_OK){   for(i=56;i<59;i++){   writeTagBlockData(i,dataXX);   }}
-		status = MFRC522_Auth(0x60,60,sectorX_KeyA,serNum);	//sector 15
-		if(status==MI_OK){   for(i=60;i<63;i++){   writeTagBlockData(i,dataXX);   }}		
-		MFRC522_Halt();
-		delay1s();							}}
-
-/* Description: write  TAG's memory bytes *****************************************
- * Input parameter: null
- * Return: null					 */
-void writeTagBlockMemory(void){
-	//4 bytes Serial number of card, the 5 bytes is verify bytes
-	uchar serNum[5];
-	//buffer A password, 16 buffer, the password of every buffer is 6 bytes 
-	uchar sectorX_KeyA[]={0xFF,0xFF,0xFF,0xFF,0xFF,0xFF}; 
-	uchar i,j;
-	uchar status;
-    uchar str[MAX_LEN];
-    //Select operation buck address  0 - 63
-	//char msg1[]={"Writing TAG's memory block"};
-  //SECTOR 00     //0123456789ABCDEF
-  //uchar data00[]="			    ";  //Do not write serial number or manufacturer data
-  //uchar data01[]="William Martinez";
-  //uchar data02[]="ID: 5602-8788-ME";
-  //uchar data03[]={0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0x07,0x80,0x69,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};	//Warning: only write sector trailer when you know what you're doing
-  //SECTOR 01
-  uchar data04[]="License permit:B";
-  uchar data05[]="Penny Lane 63-C ";
-  uchar data06[]="London 59032    ";
-  //uchar data07[]={0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0x07,0x80,0x69,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};	//Warning: only write sector trailer when you know what you're doing
-  //SECTOR 02
-//	uchar data08[]="Insurance data  ";
-//	uchar data09[]="2014-BA         ";
-//	uchar data10[]="Health service  ";
-    //uchar data11[]={0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0x07,0x80,0x69,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};	//Warning: only write sector trailer when you know what you're doing
-  //SECTOR 03
-//	uchar data12[]="Hola a todos hoy";
-//	uchar data13[]="hace un dia con ";
-//	uchar data14[]="  buen clima!   ";
-  //uchar data15[]={0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0x07,0x80,0x69,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};	//Warning: only write sector trailer when you know what you're doing
-  //SECTOR 04
-//	uchar data16[]="     _ /\ _     ";
-//	uchar data17[]="     \ oo /     ";
-//	uchar data18[]="     /    \     ";
-  //uchar data19[]={0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,x07,0x80,0x69,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};	//Warning: only write sector trailer when you know what you're doing
-  //SECTOR 05
-//	uchar data20[]="                ";
-//	uchar data21[]="                ";
-//	uchar data22[]="                ";
-  //uchar data23[]={0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,x07,0x80,0x69,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};	//Warning: only write sector trailer when you know what you're doing
-  //SECTOR 06
-//	uchar data24[]="                ";
-//	uchar data25[]="                ";
-//	uchar data26[]="                ";
-  //uchar data27[]={0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,x07,0x80,0x69,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};	//Warning: only write sector trailer when you know what you're doing
-  //SECTOR 07
-//	uchar data28[]="                ";
-//	uchar data29[]="                ";
-//	uchar data30[]="                ";
-  //uchar data31[]={0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFFx07,0x80,0x69,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};	//Warning: only write sector trailer when you know what you're doing
-  //SECTOR 08
-//	uchar data32[]="                ";
-//	uchar data33[]="                ";
-//	uchar data34[]="                ";
-  //uchar data35[]={0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,x07,0x80,0x69,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};	//Warning: only write sector trailer when you know what you're doing
-  //SECTOR 09
-//	uchar data36[]="                ";
-//	uchar data37[]="                ";
-//	uchar data38[]="                ";
-  //uchar data39[]={0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,x07,0x80,0x69,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};	//Warning: only write sector trailer when you know what you're doing
-  //SECTOR 10
-//	uchar data40[]="                ";
-//	uchar data41[]="                ";
-//	uchar data42[]="                ";
-  //uchar data43[]={0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,x07,0x80,0x69,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};	//Warning: only write sector trailer when you know what you're doing
-  //SECTOR 11
-//	uchar data44[]="                ";
-//	uchar data45[]="                ";
-//	uchar data46[]="                ";
-  //uchar data47[]={0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,x07,0x80,0x69,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};	//Warning: only write sector trailer when you know what you're doing
-  //SECTOR 12
-//	uchar data48[]="                ";
-//	uchar data49[]="                ";
-//	uchar data50[]="                ";
-  //uchar data51[]={0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,x07,0x80,0x69,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};	//Warning: only write sector trailer when you know what you're doing
-  //SECTOR 13
-//	uchar data52[]="                ";
-//	uchar data53[]="                ";
-//	uchar data54[]="                ";
-  //uchar data55[]={0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,x07,0x80,0x69,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};	//Warning: only write sector trailer when you know what you're doing
-  //SECTOR 14
-//	uchar data56[]="                ";
-//	uchar data57[]="                ";
-//	uchar data58[]="                ";
-  //uchar data59[]={0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,x07,0x80,0x69,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};	//Warning: only write sector trailer when you know what you're doing
-  //SECTOR 15
-//	uchar data60[]="                ";
-//	uchar data61[]="                ";
-//	uchar data62[]="                ";
-  //uchar data63[]={0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,x07,0x80,0x69,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};	//Warning: only write sector trailer when you know what you're doing
-	setup();
-	for(;;){
-		//Search card, return card types
-		status = MFRC522_Request(PICC_REQIDL, str);	
-		if (status == MI_OK){  }
-		//Prevent conflict, return the 4 bytes Serial number of the card
-		status = MFRC522_Anticoll(str);
-		for(i=0; i<5; i++){	 serNum[i]=str[i];  }	//memcpy(serNum, str, 5);
-		if (status == MI_OK){  }
-			//putsUSART(msg1);putcUSART('\r');Delay10KTCYx(10);    }
-		status = MFRC522_SelectTag(serNum);	
-	  //status = MFRC522_Auth(0x60,1,sectorX_KeyA,serNum);
-//		status = MFRC522_Auth(0x60,0,sectorX_KeyA,serNum);	//sector 0
-//		if(status==MI_OK){
-//			writeTagBlockData(1,data01);
-//			writeTagBlockData(2,data02);	}
-		status = MFRC522_Auth(0x60,4,sectorX_KeyA,serNum);	//sector 1
-		if(status==MI_OK){   
-			writeTagBlockData(4,data04);
-			writeTagBlockData(5,data05);
-			writeTagBlockData(6,data06);	}
-//		status = MFRC522_Auth(0x60,8,sectorX_KeyA,serNum);	//sector 2
-//		if(status==MI_OK){   
-//			writeTagBlockData(8,data08);
-//			writeTagBlockData(9,data09);
-//			writeTagBlockData(10,data10);	}
-//		status = MFRC522_Auth(0x60,12,sectorX_KeyA,serNum);	//sector 3
-//		if(status==MI_OK){   
-//			writeTagBlockData(12,data12);
-//			writeTagBlockData(13,data13);
-//			writeTagBlockData(14,data14);	}
-//		status = MFRC522_Auth(0x60,16,sectorX_KeyA,serNum);	//sector 4
-//		if(status==MI_OK){   
-//			writeTagBlockData(16,data16);
-//			writeTagBlockData(17,data17);
-//			writeTagBlockData(18,data18);	}
-//		status = MFRC522_Auth(0x60,20,sectorX_KeyA,serNum);	//sector 5
-//		if(status==MI_OK){   
-//			writeTagBlockData(20,data20);
-//			writeTagBlockData(21,data21);
-//			writeTagBlockData(22,data22);	}
-//		status = MFRC522_Auth(0x60,24,sectorX_KeyA,serNum);	//sector 6
-//		if(status==MI_OK){   
-//			writeTagBlockData(24,data24);
-//			writeTagBlockData(25,data25);
-//			writeTagBlockData(26,data26);	}
-//		status = MFRC522_Auth(0x60,28,sectorX_KeyA,serNum);	//sector 7
-//		if(status==MI_OK){   
-//			writeTagBlockData(28,data28);
-//			writeTagBlockData(29,data29);
-//			writeTagBlockData(30,data30);	}
-//		status = MFRC522_Auth(0x60,32,sectorX_KeyA,serNum);	//sector 8
-//		if(status==MI_OK){   
-//			writeTagBlockData(32,data32);
-//			writeTagBlockData(33,data33);
-//			writeTagBlockData(34,data34);	}							
-//		status = MFRC522_Auth(0x60,36,sectorX_KeyA,serNum);	//sector 9		
-//		if(status==MI_OK){   
-//			writeTagBlockData(36,data36);							
-//			writeTagBlockData(37,data37);
-//			writeTagBlockData(38,data38);	}
-//		status = MFRC522_Auth(0x60,40,sectorX_KeyA,serNum);	//sector 10
-//		if(status==MI_OK){   
-//			writeTagBlockData(41,data41);
-//			writeTagBlockData(42,data42);
-//			writeTagBlockData(43,data43);	}
-//		status = MFRC522_Auth(0x60,44,sectorX_KeyA,serNum);	//sector 11
-//		if(status==MI_OK){   
-//			writeTagBlockData(44,data44);								
-//			writeTagBlockData(45,data45);									
-//			writeTagBlockData(46,data46);	}							
-//		status = MFRC522_Auth(0x60,48,sectorX_KeyA,serNum);	//sector 12
-//		if(status==MI_OK){   
-//			writeTagBlockData(48,data48);
-//			writeTagBlockData(49,data49);
-//			writeTagBlockData(50,data50);	}
-//		status = MFRC522_Auth(0x60,52,sectorX_KeyA,serNum);	//sector 13
-//		if(status==MI_OK){   
-//			writeTagBlockData(52,data52);
-//			writeTagBlockData(53,data53);
-//			writeTagBlockData(54,data54);	}
-//		status = MFRC522_Auth(0x60,56,sectorX_KeyA,serNum);	//sector 14
-//		if(status==MI_OK){   
-//			writeTagBlockData(56,data56);
-//			writeTagBlockData(57,data57);
-//			writeTagBlockData(58,data58);	}
-//		status = MFRC522_Auth(0x60,60,sectorX_KeyA,serNum);	//sector 15
-//		if(status==MI_OK){   
-//			writeTagBlockData(60,data60);
-//			writeTagBlockData(61,data61);
-//			writeTagBlockData(62,data62);	}							
-		MFRC522_Halt();
-		delay1s();							}}
-
-/* Description: Write data to TAG's memory ************************************
- * Input parameter: block to be written, dataArray
- * Return: null					 */
-void writeTagBlockData(int block, uchar *data) {
-	uchar status;
-	char string[31];
-	sprintf(string, (const far rom char*)"Sector %02d successfully written", block);
-	status = MFRC522_Write(block, data);
-	if(status == MI_OK){putcUSART('\r');putsUSART(string);	}}	
-
-/* Description: Send data read to serial monitor HEX format ********************
- * Input parameter: null
- * Return: null					 */
-void readDataHEX(void){
-	//4 bytes Serial number of card, the 5 bytes is verfiy bytes
-	uchar serNum[5];
-	//buffer A password, 16 buffer, the passowrd of every buffer is 6 byte 
-	uchar sectorX_KeyA[]={0xFF,0xFF,0xFF,0xFF,0xFF,0xFF}; 
-	uchar i,j;
-	uchar status;
-    uchar str[MAX_LEN];
-    //Select operation buck address  0 - 63
-	char msg1[]={"\nTAG's data in HEX format: "};
-	setup();
-	for(;;){
-		//Search card, return card types
-		status = MFRC522_Request(PICC_REQIDL, str);	
-		if (status == MI_OK){  }//putsUSART(msg0);putcUSART('\r');Delay10KTCYx(10);   }
-		//Prevent conflict, return the 4 bytes Serial number of the card
-		status = MFRC522_Anticoll(str);
-		for(i=0; i<5; i++){	 serNum[i]=str[i];  }	//memcpy(serNum, str, 5);
-		if (status == MI_OK){  
-			putsUSART(msg1);putcUSART('\r');Delay10KTCYx(10);   	}
-		status = MFRC522_SelectTag(serNum);	
-		status = MFRC522_Auth(0x60,0,sectorX_KeyA,serNum);	//sector 0
-		for(j=0;j<4;j++)					{
-			status = MFRC522_Read(j, str);
-			sendToSerialHEX(j,status, str);	}
-		status = MFRC522_Auth(0x60,4,sectorX_KeyA,serNum);	//sector 1
-		for(j=4;j<8;j++)					{
-			status = MFRC522_Read(j, str);
-			sendToSerialHEX(j,status, str);	}
-		status = MFRC522_Auth(0x60,8,sectorX_KeyA,serNum);	//sector 2
-		for(j=8;j<12;j++)					{
-			status = MFRC522_Read(j, str);
-			sendToSerialHEX(j,status, str);	}
-		status = MFRC522_Auth(0x60,12,sectorX_KeyA,serNum);	//sector 3
-		for(j=12;j<16;j++)					{
-			status = MFRC522_Read(j, str);
-			sendToSerialHEX(j,status, str);	}
-		status = MFRC522_Auth(0x60,16,sectorX_KeyA,serNum);	//sector 4
-		for(j=16;j<20;j++)					{
-			status = MFRC522_Read(j, str);
-			sendToSerialHEX(j,status, str);	}
-		status = MFRC522_Auth(0x60,20,sectorX_KeyA,serNum);	//sector 5
-		for(j=20;j<24;j++)					{
-			status = MFRC522_Read(j, str);
-			sendToSerialHEX(j,status, str);	}
-		status = MFRC522_Auth(0x60,24,sectorX_KeyA,serNum);	//sector 6
-		for(j=24;j<28;j++)					{
-			status = MFRC522_Read(j, str);
-			sendToSerialHEX(j,status, str);	}
-		status = MFRC522_Auth(0x60,28,sectorX_KeyA,serNum);	//sector 7
-		for(j=28;j<32;j++)					{
-			status = MFRC522_Read(j, str);
-			sendToSerialHEX(j,status, str);	}
-		status = MFRC522_Auth(0x60,32,sectorX_KeyA,serNum);	//sector 8
-		for(j=32;j<36;j++)					{
-			status = MFRC522_Read(j, str);
-			sendToSerialHEX(j,status, str);	}
-		status = MFRC522_Auth(0x60,36,sectorX_KeyA,serNum);	//sector 9
-		for(j=36;j<40;j++)					{
-			status = MFRC522_Read(j, str);
-			sendToSerialHEX(j,status, str);	}
-		status = MFRC522_Auth(0x60,40,sectorX_KeyA,serNum);	//sector 10
-		for(j=40;j<44;j++)					{
-			status = MFRC522_Read(j, str);
-			sendToSerialHEX(j,status, str);	}
-		status = MFRC522_Auth(0x60,44,sectorX_KeyA,serNum);	//sector 11
-		for(j=44;j<48;j++)					{
-			status = MFRC522_Read(j, str);
-			sendToSerialHEX(j,status, str);	}
-		status = MFRC522_Auth(0x60,48,sectorX_KeyA,serNum);	//sector 12
-		for(j=48;j<52;j++)					{
-			status = MFRC522_Read(j, str);
-			sendToSerialHEX(j,status, str);	}
-		status = MFRC522_Auth(0x60,52,sectorX_KeyA,serNum);	//sector 13
-		for(j=52;j<56;j++)					{
-			status = MFRC522_Read(j, str);
-			sendToSerialHEX(j,status, str);	}
-		status = MFRC522_Auth(0x60,56,sectorX_KeyA,serNum);	//sector 14
-		for(j=56;j<60;j++)					{
-			status = MFRC522_Read(j, str);
-			sendToSerialHEX(j,status, str);	}
-		status = MFRC522_Auth(0x60,60,sectorX_KeyA,serNum);	//sector 15
-		for(j=60;j<64;j++)					{
-			status = MFRC522_Read(j, str);
-			sendToSerialHEX(j,status, str);	}
-		MFRC522_Halt();
-		delay1s();							}}
-
-/* Description: Send data read to serial monitor ASCII format *******************
- * Input parameter: null
- * Return: null					 */
-void readDataASCII(void){
-	//4 bytes Serial number of card, the 5 bytes is verfiy bytes
-	uchar serNum[5];
-	//buffer A password, 16 buffer, the passowrd of every buffer is 6 byte 
-	uchar sectorX_KeyA[]={0xFF,0xFF,0xFF,0xFF,0xFF,0xFF}; 
-	uchar i,j;
-	uchar status;
-    uchar str[MAX_LEN];
-	char msg2[]={"\n TAG's data in ASCII format:"};
-	setup();
-	for(;;){
-		//Search card, return card types
-		status = MFRC522_Request(PICC_REQIDL, str);	
-		if (status == MI_OK){  }//putsUSART(msg0);putcUSART('\r');Delay10KTCYx(10);   }
-		//Prevent conflict, return the 4 bytes Serial number of the card
-		status = MFRC522_Anticoll(str);
-		for(i=0; i<5; i++){	 serNum[i]=str[i];  }	//memcpy(serNum, str, 5);
-		if (status == MI_OK){  
-			//putsUSART(msg1);putcUSART('\r');Delay10KTCYx(10);
-			putsUSART(msg2);putcUSART('\r');Delay10KTCYx(10);   }
-		status = MFRC522_SelectTag(serNum);	
-		status = MFRC522_Auth(0x60,0,sectorX_KeyA,serNum);	//sector 0
-		for(j=0;j<4;j++)					{
-			status = MFRC522_Read(j, str);
-			sendToSerialASCII(0,j,status, str);	}
-		status = MFRC522_Auth(0x60,4,sectorX_KeyA,serNum);	//sector 1
-		for(j=4;j<8;j++)					{
-			status = MFRC522_Read(j, str);
-			sendToSerialASCII(1,j,status, str);	}
-		status = MFRC522_Auth(0x60,8,sectorX_KeyA,serNum);	//sector 2
-		for(j=8;j<12;j++)					{
-			status = MFRC522_Read(j, str);
-			sendToSerialASCII(2,j,status, str);	}
-		status = MFRC522_Auth(0x60,12,sectorX_KeyA,serNum);	//sector 3
-		for(j=12;j<16;j++)					{
-			status = MFRC522_Read(j, str);
-			sendToSerialASCII(3,j,status, str);	}
-		status = MFRC522_Auth(0x60,16,sectorX_KeyA,serNum);	//sector 4
-		for(j=16;j<20;j++)					{
-			status = MFRC522_Read(j, str);
-			sendToSerialASCII(4,j,status, str);	}
-		status = MFRC522_Auth(0x60,20,sectorX_KeyA,serNum);	//sector 5
-		for(j=20;j<24;j++)					{
-			status = MFRC522_Read(j, str);
-			sendToSerialASCII(5,j,status, str);	}
-		status = MFRC522_Auth(0x60,24,sectorX_KeyA,serNum);	//sector 6
-		for(j=24;j<28;j++)					{
-			status = MFRC522_Read(j, str);
-			sendToSerialASCII(6,j,status, str);	}
-		status = MFRC522_Auth(0x60,28,sectorX_KeyA,serNum);	//sector 7
-		for(j=28;j<32;j++)					{
-			status = MFRC522_Read(j, str);
-			sendToSerialASCII(7,j,status, str);	}
-		status = MFRC522_Auth(0x60,32,sectorX_KeyA,serNum);	//sector 8
-		for(j=32;j<36;j++)					{
-			status = MFRC522_Read(j, str);
-			sendToSerialASCII(8,j,status, str);	}
-		status = MFRC522_Auth(0x60,36,sectorX_KeyA,serNum);	//sector 9
-		for(j=36;j<40;j++)					{
-			status = MFRC522_Read(j, str);
-			sendToSerialASCII(9,j,status, str);	}
-		status = MFRC522_Auth(0x60,40,sectorX_KeyA,serNum);	//sector 10
-		for(j=40;j<44;j++)					{
-			status = MFRC522_Read(j, str);
-			sendToSerialASCII(10,j,status, str);	}
-		status = MFRC522_Auth(0x60,44,sectorX_KeyA,serNum);	//sector 11
-		for(j=44;j<48;j++)					{
-			status = MFRC522_Read(j, str);
-			sendToSerialASCII(11,j,status, str);	}
-		status = MFRC522_Auth(0x60,48,sectorX_KeyA,serNum);	//sector 12
-		for(j=48;j<52;j++)					{
-			status = MFRC522_Read(j, str);
-			sendToSerialASCII(12,j,status, str);	}
-		status = MFRC522_Auth(0x60,52,sectorX_KeyA,serNum);	//sector 13
-		for(j=52;j<56;j++)					{
-			status = MFRC522_Read(j, str);
-			sendToSerialASCII(13,j,status, str);	}
-		status = MFRC522_Auth(0x60,56,sectorX_KeyA,serNum);	//sector 14
-		for(j=56;j<60;j++)					{
-			status = MFRC522_Read(j, str);
-			sendToSerialASCII(14,j,status, str);	}
-		status = MFRC522_Auth(0x60,60,sectorX_KeyA,serNum);	//sector 15
-		for(j=60;j<64;j++)					{
-			status = MFRC522_Read(j, str);
-			sendToSerialASCII(15,j,status, str);	}
-		MFRC522_Halt();
-		delay1s();	} }
-
-/* Description: Send data read to serial monitor ASCII format ******************
- * Input parameter: sector, block, status and pointer to string read
- * Return: null					 */
-void sendToSerialASCII(int sector, int block, uchar status, uchar *str){
-	int i;
-	char string[22];
-	sprintf(string, (const far rom char*)"Sector %2d, block %2d: ", sector, block);
-	if(status == MI_OK){
-		putsUSART(string);
-		for(i=0;i<16;i++)		{
-			putcUSART(str[i]);
-			Delay10KTCYx(5);	}
-		putcUSART('\r');	   }}
-
-/* Description: Send data read to serial monitor HEX format ********************
- * Input parameter: sector, block, status and pointer to string read
- * Return: null					 */
-void sendToSerialHEX(int block, uchar status, uchar *str){
-	int i;
-	char string0[5];
-	char string1[49];
-	sprintf(string0, (const far rom char*)"%2d: ",block);
-	sprintf(string1, (const far rom char*)"%2x %2x %2x %2x %2x %2x %2x %2x %2x %2x %2x %2x %2x %2x %2x %2x", 
-		str[0], str[1], str[2], str[3], str[4], str[5], str[6], str[7], str[8], str[9], str[10], str[11], str[12], str[13], str[14], str[15]);
-	if(status == MI_OK){
-		putsUSART(string0);
-		putsUSART(string1);
-		//putsUSART(string2);
-		putcUSART('\r');	}}
-
-/* Description: Shows TAG's serial number **************************************
- * Input parameter: null
- * Return: null					 */
-void showSerialNumber(void){
-	//4 bytes Serial number of card, the 5 bytes is verfiy bytes
-	uchar serNum[5]; 
+/* Description: Send the next byte of the transmit ring if the USART is free ***
+ * Called from the MFRC522 wait loops, so the serial output of one block
+ * overlaps the RF exchange of the next one. Once Isr_Start is done the low
+ * priority ISR sends instead. TX_POLL_HOOK runs here too.
+ * Input parameters: null
+ * return: null 						*/
+void TX_Poll(void){
+	if (!isrOn && PIR1bits.TXIF && (txHead != txTail)){
+		TXREG = txRing[txTail];
+		txTail = (txTail + 1) & TX_RING_MASK;	}
+	TX_POLL_HOOK();
+#if SPI_TRACE
+	Trace_Poll();
+#endif
+	}
+
+/* Description: Queue one byte in the transmit ring *****************************
+ * Input parameters: c--byte to send; waits for a free slot when the ring is full
+ * return: null 						*/
+void TX_Putc(char c){
+	uchar next;
+	next = (txHead + 1) & TX_RING_MASK;
+	while (next == txTail){  TX_Poll();  }
+	txRing[txHead] = c;
+	txHead = next;
+	if (isrOn){  PIE1bits.TXIE = 1;  }		//after txHead: Isr_Tx turns it off on an empty ring
+#if SPI_TRACE
+	txLineOpen = (c != '\r');
+#endif
+	TX_Poll();								}
+
+/* Description: Queue a string in the transmit ring *****************************
+ * Input parameters: str--null terminated string
+ * return: null 						*/
+void TX_Puts(char *str){
+	while (*str){  TX_Putc(*str++);  }		}
+
+/* Description: Wait until the transmit ring is empty ***************************
+ * Call before writing to the USART directly, so the output keeps its order.
+ * Input parameters: null
+ * return: null 						*/
+void TX_Flush(void){
+	while (txHead != txTail){  TX_Poll();  }	}
+
+/* Description: Queue one byte as two hex digits in the transmit ring ***********
+ * Input parameters: val--byte to send
+ * return: null 						*/
+void TX_PutHex(uchar val){
+	TX_Putc(hexDigit[val >> 4]);
+	TX_Putc(hexDigit[val & 0x0F]);			}
+
+/* Description: Queue a 16 bit value as four hex digits in the transmit ring ***
+ * Input parameters: val--value to send
+ * return: null 						*/
+void TX_PutHex16(uint val){
+	TX_PutHex(val >> 8);
+	TX_PutHex(val & 0xFF);					}
+
+/* Description: Queue a value in decimal in the transmit ring ******************
+ * Digits by subtraction of the decPlace powers of ten, no division and no
+ * string buffer (sprintf %u takes a few hundred cycles more per field).
+ * Input parameters: val--value to send
+ *			 width--minimum width, space padded, | TX_DEC_ZERO to pad with '0'
+ * return: null 						*/
+void TX_PutDec(uint val, uchar width){
 	uchar i;
-	uchar status;
-    uchar str[MAX_LEN];
-	char string[22];
-	char msg0[]={"Card detected\r"};
-	char msg1[]={" , "};
-	char msg2[]={"   "};
-	char msg3[]={"The card's number is: \r"};	
-	char msg4[]={"Hello master!"};	
-	setup();
-	for(;;){
-		//Search card, return card types
-		status = MFRC522_Request(PICC_REQIDL, str);	
-		if (status == MI_OK){
-			putcUSART('\r');
-	    	putsUSART(msg0);	//Serial.println("Card detected");
-			putcUSART(str[0]);	//Serial.print(str[0],BIN);
-	        putsUSART(msg1);	//Serial.print(" , ");
-			putcUSART(str[1]);	//Serial.print(str[1],BIN);
-	        putsUSART(msg2);	//Serial.println(" ");
-		}
-		//Prevent conflict, return the 4 bytes Serial number of the card
-		status = MFRC522_Anticoll(str);
-		for(i=0; i<5; i++){	 serNum[i]=str[i];  }	//memcpy(serNum, str, 5);
-		if (status == MI_OK)	{
-	    	putsUSART(msg3);		//Serial.println("The card's number is  : ");
-			sprintf(string, (const far rom char*)"%2x %2x %2x %2x", str[0], str[1], str[2], str[3]);
-			putsUSART(msg0);
-			putcUSART('\r');
-			putsUSART(string);  
-			putcUSART('\r');
-			//putcUSART('\n');  	
-	        delay1s();			}	//delay(1000);
-		MFRC522_Halt();	}}
+	char digit, pad;
+	pad = (width & TX_DEC_ZERO) ? '0' : ' ';
+	width &= ~TX_DEC_ZERO;
+	for (i=0; i<5; i++){
+		digit = '0';
+		while (val >= decPlace[i]){  val -= decPlace[i];  digit++;  }
+		if ((digit != '0') || (pad == 0) || (i == 4)){  TX_Putc(digit);  pad = 0;  }	//pad 0: digits started
+		else if (5 - i <= width){  TX_Putc(pad);  }	}	}
+
+/* Description: Queue a 32 bit value in decimal in the transmit ring ***********
+ * Input parameters: val--value to send; width--as TX_PutDec
+ * return: null 						*/
+void TX_PutDecLong(unsigned long val, uchar width){
+	uchar i;
+	char digit, pad;
+	pad = (width & TX_DEC_ZERO) ? '0' : ' ';
+	width &= ~TX_DEC_ZERO;
+	for (i=0; i<10; i++){
+		digit = '0';
+		while (val >= decPlaceLong[i]){  val -= decPlaceLong[i];  digit++;  }
+		if ((digit != '0') || (pad == 0) || (i == 9)){  TX_Putc(digit);  pad = 0;  }
+		else if (10 - i <= width){  TX_Putc(pad);  }	}	}
+
+/* Description: Queue one byte of card data as printable text ******************
+ * 0x20..0x7E are sent as is, backslash as \\ and any other byte as \xHH, so
+ * card contents cannot send control codes to the terminal.
+ * Input parameters: c--byte to send
+ * return: null 						*/
+void TX_PutAscii(uchar c){
+	if (c == '\\'){  TX_Putc('\\');  TX_Putc('\\');  }
+	else if ((c >= 0x20) && (c <= 0x7E)){  TX_Putc(c);  }
+	else{
+		TX_Putc('\\');
+		TX_Putc('x');
+		TX_PutHex(c);	}					}
+
+/* Description: Queue a string from program memory in the transmit ring ********
+ * Input parameters: str--null terminated rom string
+ * return: null 						*/
+void TX_Putrs(const rom char *str){
+	while (*str){  TX_Putc(*str++);  }		}
+
+/* Description: CRC-16/CCITT (polynomial 0x1021, MSB first) ********************
+ * Input parameters: crc--CRC so far, 0xFFFF to start; data--bytes, or null
+ *                   for zeros; len--number of bytes
+ * return: updated CRC 						*/
+uint CRC16_Update(uint crc, uchar *data, uchar len){
+	uchar i, b;
+	for (i=0; i<len; i++){
+		crc ^= (uint)(data ? data[i] : 0) << 8;
+		for (b=0; b<8; b++){
+			if (crc & 0x8000){  crc = (crc << 1) ^ 0x1021;  }
+			else{  crc <<= 1;  }	}	}
+	return crc;								}
 
 /* Description: 1 s delay  *****************************************************
  * Input parameter: null
@@ -711,7 +661,9 @@ void delay1s(void){
  * Input parameter: null
  * Return: null					 */
 void setup(void) {
-	
+	if (setupDone){  return;  }				//modes call it on entry, open the peripherals once
+	setupDone = 1;
+	Stack_Paint();							//stack use report, see sendMemoryReport()
 	OpenCapture1( C1_EVERY_4_RISE_EDGE &
  	CAPTURE_INT_OFF );
  
@@ -720,61 +672,102 @@ void setup(void) {
 	T3_SOURCE_INT );
 
 	OpenUSART( USART_TX_INT_OFF &
-	USART_RX_INT_ON &
+	USART_RX_INT_OFF &
 	USART_ASYNCH_MODE &
 	USART_EIGHT_BIT &
 	USART_CONT_RX,
 	25);
 	
-	
-	IPR1bits.RCIP = 1;
-	RCONbits.IPEN = 1;
-	INTCONbits.GIEH = 1;
-	INTCONbits.GIEL = 1;
-	
+#if ISR_ENABLE
+	Isr_Start();					//priorities, sources and GIEH/GIEL
+#endif
 
 	OpenSWSPI();					//start the SPI library
-	ClearCSSWSPI();					//Activate the RFID reader
-	TRISBbits.TRISB4=0;				//Set digital pin, Not Reset and Power-Down
-	RST=1;							//digitalWrite(NRSTPD,HIGH);							
-	MFRC522_Init();				}
+	Reader_InitAll();				//CS, Not Reset and Power-Down pins, init every reader
+	Cfg_Load();					}	//keys, tuning and settings of the configuration image
 
 /* Description: initilize RC522 ************************************************
  * Input parameter: null
  * Return: null					 */
 void MFRC522_Init(void) {
-	RST=1;							//digitalWrite(NRSTPD,HIGH);
+	*readerPins[readerCur].rstLat |= readerPins[readerCur].rstMask;	//digitalWrite(NRSTPD,HIGH);
 	MFRC522_Reset(); 	
-	//Timer: TPrescaler*TreloadVal/6.78MHz = 24ms
-    Write_MFRC522(TModeReg, 	0x8D);			//Tauto=1; f(Timer) = 6.78MHz/TPreScaler
-    Write_MFRC522(TPrescalerReg,0x3E);			//TModeReg[3..0] + TPrescalerReg
-    Write_MFRC522(TReloadRegL, 	30	);           
-    Write_MFRC522(TReloadRegH, 	0	);	
+	//Timer: Tauto=1, prescaler and reload from the timeout profile
+	timerPrescaler = 0xFFFF;					//registers are at reset values
+	timerReload = 0xFFFF;
+	timeoutProfile = TIMEOUT_NONE;
+	MFRC522_SetTimeout(TIMEOUT_DEFAULT);
 	Write_MFRC522(TxAutoReg, 	0x40);			//100%ASK
 	Write_MFRC522(ModeReg, 		0x3D);			//CRC initilizate value 0x6363	
+	Write_MFRC522(DivlEnReg, 	0x80);			//IRQ pin push-pull
 	//ClearBitMask(Status2Reg, 	0x08);			//MFCrypto1On=0
 	//Write_MFRC522(RxSelReg, 	0x86);			//RxWait = RxSelReg[5..0]
-	//Write_MFRC522(RFCfgReg, 	0x7F);   		//RxGain = 48dB
+	Tune_Load();								//RxGain, thresholds and driver of tuneAntenna, if saved
 	AntennaOn();				}				//turn on antenna
 
+/* Description: set the receive timeout timer *********************************
+ * Input parameter: reload--TReloadReg value, in ticks of the programmed prescaler
+ * Return: null						*/
+void MFRC522_SetTimer(uint reload) {
+	if (reload == timerReload){  return;  }
+	timerReload = reload;
+	timeoutProfile = TIMEOUT_NONE;
+    Write_MFRC522(TReloadRegL, 	reload & 0xFF);
+    Write_MFRC522(TReloadRegH, 	reload >> 8);	}
+
+/* Description: set the receive timeout in us **********************************
+ * Uses 10 us ticks up to 652 ms and 0.5 ms ticks above, registers are only
+ * written when their value changes.
+ * Input parameter: us--time from the end of transmission to the start of the answer
+ * Return: null						*/
+void MFRC522_SetTimeoutUs(unsigned long us) {
+	uint prescaler;
+	unsigned long reload;
+	timeoutProfile = TIMEOUT_NONE;
+	if (us < 650000UL){  prescaler = TPRESCALER_10US;  reload = us / 10 + 1;  }
+	else{  prescaler = TPRESCALER_500US;  reload = us / 500 + 1;  }
+	if (reload > 0xFFFF){  reload = 0xFFFF;  }
+	if (prescaler != timerPrescaler){
+		timerPrescaler = prescaler;
+	    Write_MFRC522(TModeReg, 	0x80 | (prescaler >> 8));	//Tauto=1
+	    Write_MFRC522(TPrescalerReg,prescaler & 0xFF);	}
+	MFRC522_SetTimer((uint)reload);			}
+
+/* Description: select a receive timeout profile *******************************
+ * Input parameter: profile--TIMEOUT_xxx, timeoutMarginPct is added
+ * Return: null						*/
+void MFRC522_SetTimeout(uchar profile) {
+	unsigned long us;
+	if (profile == timeoutProfile){  return;  }
+	us = timeoutProfileUs[profile];
+	MFRC522_SetTimeoutUs(us + us * timeoutMarginPct / 100);
+	timeoutProfile = profile;				}
+
 /* Description: write a byte data into one register of MFRC522 *****************
  * Input parameter: addr--register address; val--the value that need to write in
  * Return: Null						*/
 void Write_MFRC522(uchar addr, uchar val) {
-	ClearCSSWSPI();					//digitalWrite(chipSelectPin, LOW);	
+	*readerPins[readerCur].csLat &= ~readerPins[readerCur].csMask;	//digitalWrite(chipSelectPin, LOW);	
 	WriteSWSPI((addr<<1)&0x7E);		//address format: 0XXXXXX0
 	WriteSWSPI(val);	
-	SetCSSWSPI();				}	//digitalWrite(chipSelectPin, HIGH);	
+	*readerPins[readerCur].csLat |= readerPins[readerCur].csMask;	//digitalWrite(chipSelectPin, HIGH);	
+#if SPI_TRACE
+	Trace_Record(addr, val);
+#endif
+	}
 
 /* Description: read a byte data into one register of MFRC522 ******************
  * Input parameter: addr--register address
  * Return: return the read value		*/
 uchar Read_MFRC522(uchar addr) {
 	uchar val;
-	ClearCSSWSPI();							//digitalWrite(chipSelectPin, LOW);
+	*readerPins[readerCur].csLat &= ~readerPins[readerCur].csMask;	//digitalWrite(chipSelectPin, LOW);
 	WriteSWSPI(((addr<<1)&0x7E) | 0x80);	//address format: 1XXXXXX0
 	val =WriteSWSPI(0x00);	
-	SetCSSWSPI();							//digitalWrite(chipSelectPin, HIGH);	
+	*readerPins[readerCur].csLat |= readerPins[readerCur].csMask;	//digitalWrite(chipSelectPin, HIGH);	
+#if SPI_TRACE
+	Trace_Record(addr | TRACE_READ, val);
+#endif
 	return val;					}
 
 /* Description: set RC522 register bit *****************************************
@@ -811,24 +804,6 @@ void AntennaOff(void){	ClearBitMask(TxControlReg, 0x03);  }
  * Return:null					*/
 void MFRC522_Reset(void){  Write_MFRC522(CommandReg, PCD_RESETPHASE);  }
 
-/* Description: Searching card, read card type *********************************
- * Input parameter: reqMode -- search methods,
- *			 TagType--return card types
- *			 	0x4400 = Mifare_UltraLight
- *				0x0400 = Mifare_One(S50)
- *				0x0200 = Mifare_One(S70)
- *				0x0800 = Mifare_Pro(X)
- *				0x4403 = Mifare_DESFire
- * return:return MI_OK if successed		*/
-uchar MFRC522_Request(uchar reqMode, uchar *TagType) {
-	uchar status;  
-	uint backBits;							//the data bits that received
-	Write_MFRC522(BitFramingReg, 0x07);		//TxLastBists = BitFramingReg[2..0]
-	TagType[0] = reqMode;
-	status = MFRC522_ToCard(PCD_TRANSCEIVE, TagType, 1, TagType, &backBits);
-	if ((status != MI_OK) || (backBits != 0x10)){  status = MI_ERR;  }
-	return status;				}
-
 /* Description: communicate between RC522 and ISO14443 *************************
  * Input parameter: command--MF522 command bits
  *			 sendData--send data to card via rc522
@@ -837,84 +812,141 @@ uchar MFRC522_Request(uchar reqMode, uchar *TagType) {
  *			 backLen--the length of return data
  * return: return MI_OK if successed				*/
 uchar MFRC522_ToCard(uchar command, uchar *sendData, uchar sendLen, uchar *backData, uint *backLen){
-    uchar status = MI_ERR;
-    uchar irqEn = 	0x00;
-    uchar waitIRq = 0x00;
-    uchar lastBits;
-    uchar n;
+	return MFRC522_ToCardLen(command, sendData, sendLen, backData, MAX_LEN, backLen);	}
+
+/* Description: communicate between RC522 and ISO14443, caller sized buffer ****
+ * Input parameter: as MFRC522_ToCard, plus
+ *			 backMax--size of backData, up to MAX_FRAME_LEN; longer answers are truncated
+ * return: return MI_OK if successed				*/
+uchar MFRC522_ToCardLen(uchar command, uchar *sendData, uchar sendLen, uchar *backData, uchar backMax, uint *backLen){
+	return MFRC522_ToCardTry(command, sendData, sendLen, backData, backMax, backLen, 0);	}
+
+/* Description: communicate between RC522 and ISO14443, answer optional *******
+ * For a frame the card may leave unanswered, GET_VERSION to a plain Ultralight
+ * or a value operand: sent once, no answer is not counted in errorNoAnswer.
+ * Input parameter: as MFRC522_ToCard
+ * return: return MI_OK if successed, MI_NOTAGERR if no answer		*/
+uchar MFRC522_ToCardProbe(uchar command, uchar *sendData, uchar sendLen, uchar *backData, uint *backLen){
+	return MFRC522_ToCardTry(command, sendData, sendLen, backData, MAX_LEN, backLen, 1);	}
+
+/* Description: communicate between RC522 and ISO14443, with resends ***********
+ * Input parameter: as MFRC522_ToCardLen, plus
+ *			 probe--1 for no resend and no errorNoAnswer count (MFRC522_ToCardProbe)
+ * return: return MI_OK if successed				*/
+uchar MFRC522_ToCardTry(uchar command, uchar *sendData, uchar sendLen, uchar *backData, uchar backMax, uint *backLen, uchar probe){
+    uchar done, status;
+    uchar attempt, limit;
     uint i;
+    limit = 0;
+    if (!probe && (timeoutProfile < TIMEOUT_COUNT) && (sendLen <= RETRY_FRAME_MAX)){  limit = retryLimit[timeoutProfile];  }
+    if (limit){
+    	for (i=0; i<sendLen; i++){  retryFrame[i] = sendData[i];  }
+    	sendData = retryFrame;	}
+    for (attempt=0; ; attempt++){
+	    MFRC522_ToCardStart(command, sendData, sendLen);
+		//waite receive data is finished
+		i = READER_POLLS;	//i should adjust according the clock, the maxium the waiting time should be 25 ms
+	    do {
+	        done = MFRC522_ToCardDone();
+	        TX_Poll();								//serial output streams while the card answers
+	        i--;
+	    }while ((i!=0) && !done);
+	    status = MFRC522_ToCardFinish(done, backData, backMax, backLen);
+	    if (status == MI_TIMEOUT){					//the chip timer did not end it: check the chip
+	    	Health_Check();
+	    	return status;	}
+	    if ((status == MI_NOTAGERR) && !probe && (timeoutProfile != TIMEOUT_SHORT) && (timeoutProfile != TIMEOUT_HALT)){  errorNoAnswer++;  }
+	    if ((attempt >= limit) || !Retry_Wanted(status)){  break;  }
+	    if (Read_MFRC522(Status2Reg) & 0x08){  break;  }	//MFCrypto1On: the card stream is lost
+	    retryCount[timeoutProfile]++;
+	    Retry_Backoff(attempt);	}
+    if (attempt && (status == MI_OK)){  retrySaved[timeoutProfile]++;  }
+    return status;							}
+
+/* Description: load the FIFO and start a command, do not wait ****************
+ * The IRQ pin of the reader goes low when one of the bits that end the command
+ * is set, so MFRC522_ToCardDone needs no SPI access when the pin is wired.
+ * Input parameter: command--PCD_AUTHENT or PCD_TRANSCEIVE
+ *			 sendData--send data to card via rc522; sendLen--send data length
+ * return: null						*/
+void MFRC522_ToCardStart(uchar command, uchar *sendData, uchar sendLen){
+    uchar waitIRq = 0x00;
+    uchar i;
     switch (command) {
         case PCD_AUTHENT: 	{	//verify card password		
-			irqEn = 0x12;
 			waitIRq = 0x10;
 			break;			}
 		case PCD_TRANSCEIVE:{	//send data in the FIFO
-			irqEn = 0x77;
 			waitIRq = 0x30;
 			break;			}
 		default:	break; 	}
-    Write_MFRC522(CommIEnReg, irqEn|0x80);	//Allow interruption
+	readerWaitIRq[readerCur] = waitIRq;
+    Write_MFRC522(CommIEnReg, waitIRq|0x81);	//IRQ pin on the end bits and TimerIRq, active low
     ClearBitMask(CommIrqReg, 0x80);			//Clear all the interrupt bits
+	readerIrqSeen[readerCur] = 0;			//IRQ pin released, wait for the edge of this command
     SetBitMask(FIFOLevelReg, 0x80);			//FlushBuffer=1, FIFO initilizate
 	Write_MFRC522(CommandReg, PCD_IDLE);	//NO action;cancel current command	
 	//write data into FIFO
     for (i=0; i<sendLen; i++){ 	 Write_MFRC522(FIFODataReg, sendData[i]);   }
 	//procceed it
 	Write_MFRC522(CommandReg, command);
-    if (command == PCD_TRANSCEIVE){   SetBitMask(BitFramingReg, 0x80);	} //StartSend=1,transmission of data starts  
-	//waite receive data is finished
-	i = 2000;	//i should adjust according the clock, the maxium the waiting time should be 25 ms
-    do {
-		//CommIrqReg[7..0]
-		//Set1 TxIRq RxIRq IdleIRq HiAlerIRq LoAlertIRq ErrIRq TimerIRq
-        n = Read_MFRC522(CommIrqReg);
-        i--;
-    }while ((i!=0) && !(n&0x01) && !(n&waitIRq));
+    if (command == PCD_TRANSCEIVE){   SetBitMask(BitFramingReg, 0x80);	} 	}	//StartSend=1,transmission of data starts  
+
+/* Description: check if the command started by MFRC522_ToCardStart is over ***
+ * Input parameter: null
+ * return: 1 when the answer arrived or the timer expired, 0 while in flight	*/
+uchar MFRC522_ToCardDone(void){
+	uchar n;
+	if (readerPins[readerCur].irqMask){
+		if (*readerPins[readerCur].irqPort & readerPins[readerCur].irqMask){  return 0;  }
+		Isr_Notice();
+		return 1;	}
+	//CommIrqReg[7..0]
+	//Set1 TxIRq RxIRq IdleIRq HiAlerIRq LoAlertIRq ErrIRq TimerIRq
+	n = Read_MFRC522(CommIrqReg);
+	return (n & 0x01) || (n & readerWaitIRq[readerCur]);	}
+
+/* Description: read the answer of the command started by MFRC522_ToCardStart **
+ * Input parameter: done--0 if the command did not end in time
+ *			 backData--the return data from card; backMax--size of backData
+ *			 backLen--the length of return data, in bits
+ * return: return MI_OK if successed				*/
+uchar MFRC522_ToCardFinish(uchar done, uchar *backData, uchar backMax, uint *backLen){
+    uchar status = MI_ERR;
+    uchar lastBits;
+    uchar n, err;
+    uchar i;
     ClearBitMask(BitFramingReg, 0x80);			//StartSend=0	
-    if (i != 0) {    
-        if(!(Read_MFRC522(ErrorReg) & 0x1B))	//BufferOvfl Collerr CRCErr ProtecolErr
+    errorRegLast = 0;
+    if (done) {    
+        err = Read_MFRC522(ErrorReg);
+        errorRegLast = err;
+        for (i=0; i<8; i++){  if (err & (1 << i)){  errorCount[i]++;  }  }
+        if(!(err & 0x1B))	//BufferOvfl Collerr ParityErr ProtecolErr
         {
             status = MI_OK;
-            if (n & irqEn & 0x01){ 	status = MI_NOTAGERR;	}
-            if (command == PCD_TRANSCEIVE){
+            if (Read_MFRC522(CommIrqReg) & 0x01){ 	status = MI_NOTAGERR;	}	//TimerIRq
+            if (readerWaitIRq[readerCur] & 0x20){	//PCD_TRANSCEIVE
                	n = Read_MFRC522(FIFOLevelReg);
               	lastBits = Read_MFRC522(ControlReg) & 0x07;
-                if (lastBits){ 	*backLen = (n-1)*8 + lastBits;   }
+                if (n == 0){  	*backLen = 0;   }		//no answer, or RxIRq on noise: lastBits is stale
+                else if (lastBits){ 	*backLen = (n-1)*8 + lastBits;   }
                 else{ 	*backLen = n*8;   }
-                if (n == 0){  	n = 1;   }
-                if (n > MAX_LEN){   n = MAX_LEN;   	}	
+                if (n > backMax){   n = backMax;   	}	
 				//read the data from FIFO
                 for (i=0; i<n; i++){   	backData[i] = Read_MFRC522(FIFODataReg); 	}
+                //CRCErr, set only with RxCRCEn; a 4 bit ACK/NAK has no CRC_A and sets it too
+                if ((status == MI_OK) && (err & 0x04)){  status = ((n == 1) && (lastBits == 4)) ? MI_ERR : MI_CRCERR;  }
             }
         }
+        else if (err & 0x08){	status = MI_COLLERR;  	}
         else{	status = MI_ERR;  	}     
     }	
+    else{	status = MI_TIMEOUT;  	}
     //SetBitMask(ControlReg,0x80);           	//timer stops
     //Write_MFRC522(CommandReg, PCD_IDLE); 
     return status;					}
 
-/* Description: Prevent conflict, read the card serial number ******************
- * Input parameter: serNum--return the 4 bytes card serial number, the 5th byte is recheck byte
- * return: return MI_OK if successed			*/
-uchar MFRC522_Anticoll(uchar *serNum){
-    uchar status;
-    uchar i;
-	uchar serNumCheck=0;
-    uint unLen;
-    //ClearBitMask(Status2Reg, 0x08);		//TempSensclear
-    //ClearBitMask(CollReg,0x80);			//ValuesAfterColl
-	Write_MFRC522(BitFramingReg, 0x00);		//TxLastBists = BitFramingReg[2..0]
-    serNum[0] = PICC_ANTICOLL;
-    serNum[1] = 0x20;
-    status = MFRC522_ToCard(PCD_TRANSCEIVE, serNum, 2, serNum, &unLen);
-    if (status == MI_OK){
-		//Verify card serial number
-		for (i=0; i<4; i++){	serNumCheck ^= serNum[i];	}
-		if (serNumCheck != serNum[i]){ 	status = MI_ERR;    }
-    }
-    //SetBitMask(CollReg, 0x80);		//ValuesAfterColl=1
-    return status;					} 				
-
 /* Description: Use MF522 to caculate CRC **************************************
  * Input parameter: pIndata--the CRC data need to be read,len--data length,pOutData-- the caculated result of CRC
  * return: Null
@@ -931,95 +963,676 @@ void CalulateCRC(uchar *pIndata, uchar len, uchar *pOutData){
     i = 0xFF;
     do {
         n = Read_MFRC522(DivIrqReg);
+        TX_Poll();
         i--;
     }while ((i!=0) && !(n&0x04));			//CRCIrq = 1
 	//read CRC caculation result
     pOutData[0] = Read_MFRC522(CRCResultRegL);
     pOutData[1] = Read_MFRC522(CRCResultRegM);				}
 
-/* Description: Select card, read card storage volume *************************
- * Input parameter :serNum--Send card serial number
- * return: return the card storage volume			 */
-uchar MFRC522_SelectTag(uchar *serNum) {
-    uchar i;
-	uchar status;
-	uchar size;
-    uint recvBits;
-    uchar buffer[9]; 
-	//ClearBitMask(Status2Reg, 0x08);			//MFCrypto1On=0
-    buffer[0] = PICC_SElECTTAG;
-    buffer[1] = 0x70;
-    for (i=0; i<5; i++){  buffer[i+2] = *(serNum+i);  }
-	CalulateCRC(buffer, 7, &buffer[7]);		
-    status = MFRC522_ToCard(PCD_TRANSCEIVE, buffer, 9, buffer, &recvBits);
-    if ((status == MI_OK) && (recvBits == 0x18)){ 	size = buffer[0]; 	}
-    else{ 	size = 0;  	}
-    return size;						}
-
-/* Description:verify card password ********************************************
- * Input parameters:authMode--password verify mode
-                 0x60 = verify A passowrd key 
-                 0x61 = verify B passowrd key 
-             BlockAddr--Block address
-             Sectorkey--Block password
-             serNum--Card serial number ,4 bytes
- * return:return MI_OK if successed				*/
-uchar MFRC522_Auth(uchar authMode, uchar BlockAddr, uchar *Sectorkey, uchar *serNum) {
-    uchar status;
-    uint recvBits;
-    uchar i;
-	uchar buff[12]; 
-	//Verify command + block address + buffer password + card SN
-    buff[0] = authMode;
-    buff[1] = BlockAddr;
-    for (i=0; i<6; i++){	buff[i+2] = *(Sectorkey+i);   }
-    for (i=0; i<4; i++){  	buff[i+8] = *(serNum+i);   	  }
-    status = MFRC522_ToCard(PCD_AUTHENT, buff, 12, buff, &recvBits);
-    if ((status != MI_OK) || (!(Read_MFRC522(Status2Reg) & 0x08))){	 status = MI_ERR;  }
-    return status;																	   }
-
-/* Description: Read data ******************************************************
- * Input parameters: blockAddr--block address; recvData--the block data which are read
- * return: return MI_OK if successed						*/
-uchar MFRC522_Read(uchar blockAddr, uchar *recvData) {
-    uchar status;
-    uint unLen;
-    recvData[0] = PICC_READ;
-    recvData[1] = blockAddr;
-    CalulateCRC(recvData,2, &recvData[2]);
-    status = MFRC522_ToCard(PCD_TRANSCEIVE, recvData, 4, recvData, &unLen);
-    if ((status != MI_OK) || (unLen != 0x90)) {  status = MI_ERR;  } 
-    return status;									}
-
-/* Description: write block data ***********************************************
- * Input parameters: blockAddr--block address; writeData--Write 16 bytes data into block
- * return: return MI_OK if successed						*/
-uchar MFRC522_Write(uchar blockAddr, uchar *writeData) {
-    uchar status;
-    uint recvBits;
-    uchar i;
-	uchar buff[18];     
-    buff[0] = PICC_WRITE;
-    buff[1] = blockAddr;
-    CalulateCRC(buff, 2, &buff[2]);
-    status = MFRC522_ToCard(PCD_TRANSCEIVE, buff, 4, buff, &recvBits);
-    if ((status != MI_OK) || (recvBits != 4) || ((buff[0] & 0x0F) != 0x0A)){  status = MI_ERR;    }
-    if (status == MI_OK){
-        for (i=0; i<16; i++){   buff[i] = *(writeData+i);   }	//Write 16 bytes data into FIFO
-        CalulateCRC(buff, 16, &buff[16]);
-        status = MFRC522_ToCard(PCD_TRANSCEIVE, buff, 18, buff, &recvBits);
-		if ((status != MI_OK) || (recvBits != 4) || ((buff[0] & 0x0F) != 0x0A)){  status = MI_ERR; }
-    }
-    return status;										}
-
-/* Description: Command the cards into sleep mode ******************************
+/* Description: let the MFRC522 append and check CRC_A ************************
+ * TxCRCEn appends the CRC_A to the frame sent; RxCRCEn checks the one of the
+ * answer and removes it from the FIFO, a wrong CRC_A sets CRCErr and
+ * MFRC522_ToCardFinish returns MI_CRCERR, or MI_ERR for a 4 bit NAK. Saves the
+ * CalulateCRC round trips, about 2 ms for a block read. Leave it off for REQA,
+ * anticollision and auth.
+ * Input parameter: on--1 to enable, 0 to disable
+ * return: null					*/
+void MFRC522_CrcOn(uchar on){
+	if (on){
+		SetBitMask(TxModeReg, 0x80);			//TxCRCEn
+		SetBitMask(RxModeReg, 0x80);	}		//RxCRCEn
+	else{
+		ClearBitMask(TxModeReg, 0x80);
+		ClearBitMask(RxModeReg, 0x80);	}		}
+
+/* Description: Make a reader the one the driver works on **********************
+ * The register shadows of the current reader are saved and the ones of r loaded.
+ * Input parameters: r--reader, 0..READER_COUNT-1
+ * return: null 						*/
+void Reader_Select(uchar r){
+	readerTimeoutProfile[readerCur] = timeoutProfile;
+	readerTimerPrescaler[readerCur] = timerPrescaler;
+	readerTimerReload[readerCur] = timerReload;
+#if RC522_DUMP
+	readerCacheCurrent[readerCur] = cacheCurrent;
+	cacheCurrent = readerCacheCurrent[r];
+#endif
+	readerCur = r;
+	timeoutProfile = readerTimeoutProfile[r];
+	timerPrescaler = readerTimerPrescaler[r];
+	timerReload = readerTimerReload[r];	}
+
+/* Description: Set the pins of every reader and initialize them ***************
+ * All CS go high first, so only one reader drives MISO. A reader that kept its
+ * configuration (PIC reset alone) is not reset. Reader 0 stays selected.
  * Input parameters: null
  * return: null 						*/
-void MFRC522_Halt(void){
-	uchar status;
-    uint unLen;
-    uchar buff[4]; 
-    buff[0] = PICC_HALT;
-    buff[1] = 0;
-    CalulateCRC(buff, 2, &buff[2]);
-    status = MFRC522_ToCard(PCD_TRANSCEIVE, buff, 4, buff,&unLen);			}
+void Reader_InitAll(void){
+	uchar r;
+	for (r=0; r<READER_COUNT; r++){
+		*readerPins[r].csLat |= readerPins[r].csMask;
+		*readerPins[r].csTris &= ~readerPins[r].csMask;
+		*readerPins[r].rstLat |= readerPins[r].rstMask;	//high before output: no reset pulse
+		*readerPins[r].rstTris &= ~readerPins[r].rstMask;	}
+	for (r=0; r<READER_COUNT; r++){
+		Reader_Select(r);
+		readerWarm[r] = MFRC522_WarmStart();
+		readerVersion[r] = Read_MFRC522(VersionReg);	}
+	Reader_Select(0);						}
+
+/* Description: Read one byte of the data EEPROM *******************************
+ * Input parameters: addr--EEPROM address
+ * return: byte read 						*/
+uchar EEPROM_Read(uchar addr){
+	EEADR = addr;
+	EECON1bits.EEPGD = 0;					//data EEPROM, not flash
+	EECON1bits.CFGS = 0;
+	EECON1bits.RD = 1;
+	return EEDATA;							}
+
+/* Description: Write one byte of the data EEPROM ******************************
+ * Skips the write when the byte already holds val, waits for the end (about 4 ms).
+ * Input parameters: addr--EEPROM address; val--byte to write
+ * return: null 						*/
+void EEPROM_Write(uchar addr, uchar val){
+	uchar gie;
+	if (EEPROM_Read(addr) == val){  return;  }
+	EEADR = addr;
+	EEDATA = val;
+	EECON1bits.EEPGD = 0;
+	EECON1bits.CFGS = 0;
+	EECON1bits.WREN = 1;
+	gie = INTCONbits.GIEH;
+	INTCONbits.GIEH = 0;					//required sequence, no interrupt in between
+	EECON2 = 0x55;
+	EECON2 = 0xAA;
+	EECON1bits.WR = 1;
+	INTCONbits.GIEH = gie;
+	while (EECON1bits.WR){  TX_Poll();  }
+	EECON1bits.WREN = 0;					}
+
+/* Description: Write a receiver and driver profile to the current reader ******
+ * Input parameters: profile--RFCfgReg, RxThresholdReg, CWGsPReg, ModGsPReg
+ * return: null 						*/
+void Tune_Apply(uchar *profile){
+	uchar i;
+	for (i=0; i<TUNE_REGS; i++){  Write_MFRC522(tuneRegs[i], profile[i]);  }	}
+
+/* Description: Apply the profile saved for the current reader *****************
+ * Input parameters: null
+ * return: MI_OK, MI_ERR if no valid profile is saved (registers left as they are) */
+uchar Tune_Load(void){
+	uchar profile[TUNE_REGS];
+	if (Tune_Read(profile) != MI_OK){  return MI_ERR;  }
+	Tune_Apply(profile);
+	return MI_OK;							}
+
+/* Description: Read the profile saved for the current reader ******************
+ * Input parameters: profile--return RFCfgReg, RxThresholdReg, CWGsPReg, ModGsPReg
+ * return: MI_OK, MI_ERR if no valid profile is saved	*/
+uchar Tune_Read(uchar *profile){
+	uchar addr, i, sum;
+	addr = TUNE_EE_ADDR + readerCur * TUNE_EE_SIZE;
+	if (EEPROM_Read(addr) != TUNE_EE_MAGIC){  return MI_ERR;  }
+	for (i=0, sum=TUNE_EE_MAGIC; i<TUNE_REGS; i++){
+		profile[i] = EEPROM_Read(addr + 1 + i);
+		sum += profile[i];	}
+	if (EEPROM_Read(addr + 1 + TUNE_REGS) != (uchar)~sum){  return MI_ERR;  }
+	return MI_OK;							}
+
+/* Description: Save the profile of the current reader *************************
+ * The magic byte is written last, so a reset in between leaves no valid profile.
+ * Input parameters: profile--RFCfgReg, RxThresholdReg, CWGsPReg, ModGsPReg
+ * return: null 						*/
+void Tune_Save(uchar *profile){
+	uchar addr, i, sum;
+	addr = TUNE_EE_ADDR + readerCur * TUNE_EE_SIZE;
+	EEPROM_Write(addr, 0xFF);
+	for (i=0, sum=TUNE_EE_MAGIC; i<TUNE_REGS; i++){
+		EEPROM_Write(addr + 1 + i, profile[i]);
+		sum += profile[i];	}
+	EEPROM_Write(addr + 1 + TUNE_REGS, ~sum);
+	EEPROM_Write(addr, TUNE_EE_MAGIC);		}
+
+/* Description: Decide if a failed frame is worth sending again ***************
+ * No answer or a noise error (RETRY_ERRORS) is resent; a collision, an
+ * authentication or a NAK is left to the caller.
+ * Input parameters: status--MI_xxx of the frame, errorRegLast its ErrorReg
+ * return: 1 to resend 						*/
+uchar Retry_Wanted(uchar status){
+	if (status == MI_NOTAGERR){  return 1;  }
+	if (status == MI_ERR){  return (errorRegLast & RETRY_ERRORS) != 0;  }
+	return 0;								}
+
+/* Description: Wait before a resend *******************************************
+ * retryBackoff x 10 us, doubled after each resend, at most retryBackoffMax.
+ * Input parameters: attempt--resends done so far
+ * return: null 						*/
+void Retry_Backoff(uchar attempt){
+	uint n;
+	n = (uint)retryBackoff << attempt;
+	if (n > retryBackoffMax){  n = retryBackoffMax;  }
+	while (n--){
+		Delay10TCYx(1);
+		TX_Poll();	}						}
+
+/* Description: Clear the retry, error and watchdog counters *******************
+ * Input parameters: null
+ * return: null 						*/
+void Retry_ResetStats(void){
+	uchar i;
+	for (i=0; i<TIMEOUT_COUNT; i++){
+		retryCount[i] = 0;
+		retrySaved[i] = 0;	}
+	for (i=0; i<8; i++){  errorCount[i] = 0;  }
+	errorNoAnswer = 0;
+	healthChecks = 0;
+	healthFaults = 0;
+	healthSoftResets = 0;
+	healthHardResets = 0;
+	healthDead = 0;							}
+
+/* Description: Send the retry, error and watchdog counters to serial **********
+ * Input parameters: null
+ * return: null 						*/
+void sendRetryStats(void){
+	uchar i;
+	for (i=0; i<TIMEOUT_COUNT; i++){
+		if (!retryCount[i]){  continue;  }
+		TX_Putrs(timeoutName[i]);
+		TX_Putrs(" resent ");
+		TX_PutDec(retryCount[i], 0);
+		TX_Putrs(" passed ");
+		TX_PutDec(retrySaved[i], 0);
+		TX_Putc('\r');	}
+	for (i=0; i<8; i++){
+		if (!errorCount[i]){  continue;  }
+		TX_Putrs(errorBitName[i]);
+		TX_Putrs(" errors ");
+		TX_PutDec(errorCount[i], 0);
+		TX_Putc('\r');	}
+	TX_Putrs("No answer ");
+	TX_PutDec(errorNoAnswer, 0);
+	TX_Putrs("\rChecks ");
+	TX_PutDec(healthChecks, 0);
+	TX_Putrs(" faults ");
+	TX_PutDec(healthFaults, 0);
+	TX_Putrs("\rResets soft ");
+	TX_PutDec(healthSoftResets, 0);
+	TX_Putrs(" hard ");
+	TX_PutDec(healthHardResets, 0);
+	TX_Putrs(" failed ");
+	TX_PutDec(healthDead, 0);
+	TX_Putc('\r');
+	TX_Flush();								}
+
+/* Description: Check that the current reader answers and kept its setup *******
+ * VersionReg as read at start, Status1Reg not stuck at 0xFF (MISO floating),
+ * antenna on and TModeReg as programmed (lost after a spontaneous reset).
+ * Input parameters: null
+ * return: 1 if healthy 					*/
+uchar Health_Ok(void){
+	uchar v;
+	v = Read_MFRC522(VersionReg);
+	if ((v == 0x00) || (v == 0xFF) || (v != readerVersion[readerCur])){  return 0;  }
+	if (Read_MFRC522(Status1Reg) == 0xFF){  return 0;  }
+	if (!(Read_MFRC522(TxControlReg) & 0x03)){  return 0;  }
+	if (Read_MFRC522(TModeReg) != (0x80 | (timerPrescaler >> 8))){  return 0;  }
+	return 1;								}
+
+/* Description: Watchdog of the current reader **********************************
+ * An unhealthy chip gets a soft reset (MFRC522_Init), then a hard reset
+ * through its RST pin (RB4 on reader 0) if that was not enough.
+ * Input parameters: null
+ * return: MI_OK if the chip is healthy, MI_ERR if both resets failed	*/
+uchar Health_Check(void){
+	uchar i;
+	healthChecks++;
+	if (Health_Ok()){  return MI_OK;  }
+	healthFaults++;
+	healthSoftResets++;
+	MFRC522_Init();
+	if (Health_Ok()){  return MI_OK;  }
+	healthHardResets++;
+	*readerPins[readerCur].rstLat &= ~readerPins[readerCur].rstMask;	//hard power-down
+	Delay10TCYx(1);
+	*readerPins[readerCur].rstLat |= readerPins[readerCur].rstMask;
+	Delay1KTCYx(HEALTH_STARTUP_MS);			//crystal start-up, then PowerDown clears when the chip is ready
+	for (i=HEALTH_STARTUP_MS; i && (Read_MFRC522(CommandReg) & 0x10); i--){  Delay1KTCYx(1);  }
+	MFRC522_Init();
+	if (Health_Ok()){  return MI_OK;  }
+	healthDead++;
+	return MI_ERR;							}
+
+/* Description: Fingerprint of the configuration of the current reader *********
+ * CRC-16 of the configCheck registers (masked) and the tuning registers.
+ * Input parameters: expected--1 for the values MFRC522_Init leaves, with the
+ *                   saved tuning profile or the reset values; 0 for the chip
+ * return: fingerprint 						*/
+uint Config_Fingerprint(uchar expected){
+	uchar i, v;
+	uchar profile[TUNE_REGS];
+	uint crc;
+	crc = 0xFFFF;
+	for (i=0; i<5; i++){
+		v = expected ? configCheck[i][2] : (Read_MFRC522(configCheck[i][0]) & configCheck[i][1]);
+		crc = CRC16_Update(crc, &v, 1);	}
+	if (expected){
+		if (Tune_Read(profile) != MI_OK){
+			for (i=0; i<TUNE_REGS; i++){  profile[i] = tuneDefault[i];  }	}	}
+	else{
+		for (i=0; i<TUNE_REGS; i++){  profile[i] = Read_MFRC522(tuneRegs[i]);  }	}
+	return CRC16_Update(crc, profile, TUNE_REGS);	}
+
+/* Description: Start the current reader, keep its configuration if valid *****
+ * When VersionReg answers and the configuration fingerprint matches, only the
+ * timer and the card state are set again: no soft reset, the antenna stays on.
+ * Otherwise a full MFRC522_Init.
+ * Input parameters: null
+ * return: 1 warm start, 0 full init 	*/
+uchar MFRC522_WarmStart(void){
+	uchar v;
+	configFingerprint[readerCur] = Config_Fingerprint(1);
+	v = Read_MFRC522(VersionReg);
+	if ((v == 0x00) || (v == 0xFF) || (Config_Fingerprint(0) != configFingerprint[readerCur])){
+		MFRC522_Init();
+		return 0;	}
+	Write_MFRC522(CommandReg, PCD_IDLE);		//cancel a command left running
+	ClearBitMask(Status2Reg, 0x08);				//MFCrypto1On=0
+	Write_MFRC522(BitFramingReg, 0x00);
+	timerPrescaler = 0xFFFF;					//unknown timer registers, write them
+	timerReload = 0xFFFF;
+	timeoutProfile = TIMEOUT_NONE;
+	MFRC522_SetTimeout(TIMEOUT_DEFAULT);
+	return 1;								}
+
+/* Description: Start the boot timer *******************************************
+ * Call first in main; MFRC522_Request keeps its value at the first REQA.
+ * Input parameters: null
+ * return: null 						*/
+void Boot_Start(void){
+	OpenTimer0(TIMER_INT_OFF & T0_16BIT & T0_SOURCE_INT & T0_PS_1_256);
+	WriteTimer0(0);
+	bootTicks = 0;
+	bootReported = 0;						}
+
+/* Description: Keep the boot time at the first REQA ***************************
+ * Only the timer is read: the report is queued later by Boot_Poll, so a full
+ * transmit ring cannot hold the REQA back.
+ * Input parameters: null
+ * return: null 						*/
+void Boot_FirstReqa(void){
+	if (bootTicks){  return;  }
+	bootTicks = ReadTimer0() | 1;			}	//0 is "not yet"
+
+/* Description: Send the boot report once the first REQA is out ***************
+ * Called from the mode loops, between frames.
+ * Input parameters: null
+ * return: null 						*/
+void Boot_Poll(void){
+	if (!bootTicks || bootReported){  return;  }
+	bootReported = 1;
+	sendBootReport();						}
+
+/* Description: Queue the boot time and the start of each reader ***************
+ * Goes through the transmit ring, from Boot_Poll after the first REQA.
+ * Input parameters: null
+ * return: null 						*/
+void sendBootReport(void){
+	uchar r;
+	TX_Putrs("Boot to first REQA ");
+	TX_PutDecLong((unsigned long)bootTicks * BOOT_TICK_US, 0);
+	TX_Putrs(" us\r");
+	for (r=0; r<READER_COUNT; r++){
+		TX_Putrs("Reader ");
+		TX_PutDec(r, 0);
+		if (readerWarm[r]){  TX_Putrs(" warm, config ");  }
+		else{  TX_Putrs(" cold, config ");  }
+		TX_PutHex16(configFingerprint[r]);
+		TX_Putc('\r');	}						}
+
+/* Description: Fill the free part of the software stack with STACK_PAINT *****
+ * Called once from setup(), while the stack is still shallow.
+ * Input parameters: null
+ * return: null 						*/
+void Stack_Paint(void){
+	uchar *p;
+	p = (uchar *)(unsigned long)(((uint)FSR1H << 8) | FSR1L);	//FSR1: next free stack byte
+	stackPainted = 0;
+	while (p < (uchar *)(unsigned long)(STACK_BASE + STACK_SIZE)){
+		*p++ = STACK_PAINT;
+		stackPainted++;	}					}
+
+/* Description: Deepest software stack use since Stack_Paint *******************
+ * Input parameters: null
+ * return: bytes of the stack written at least once, 0 if not painted	*/
+uint Stack_Used(void){
+	uchar *p;
+	uchar *first;
+	if (!stackPainted){  return 0;  }
+	first = (uchar *)(unsigned long)(STACK_BASE + STACK_SIZE - stackPainted);
+	p = (uchar *)(unsigned long)(STACK_BASE + STACK_SIZE);
+	while ((p > first) && (*(p-1) == STACK_PAINT)){  p--;  }
+	return (uint)((unsigned long)p - STACK_BASE);	}
+
+/* Description: Send the frame pool size and stack use to serial **************
+ * Static RAM per section is in the linker map, see host/rc522_mapreport.c.
+ * Input parameters: null
+ * return: null 						*/
+void sendMemoryReport(void){
+	TX_Putrs("Frame pool ");
+	TX_PutDec(sizeof(framePool), 0);
+	TX_Putrs(" bytes\rStack used ");
+	TX_PutDec(Stack_Used(), 0);
+	TX_Putrs(" of ");
+	TX_PutDec(STACK_SIZE, 0);
+	TX_Putc('\r');
+	TX_Flush();								}
+
+#if SPI_TRACE
+/* Description: Store one record in the trace ring ****************************
+ * A full ring stalls the driver until a record is sent, so the trace has no
+ * gap at any baud rate. With a driver line half queued the ring cannot drain:
+ * the capture stops there for good and the trace ends, contiguous from boot.
+ * Input parameters: op--register | TRACE_READ, or TRACE_READER | r; val--byte
+ * return: null 						*/
+void Trace_Put(uchar op, uchar val){
+	uchar next;
+	if (traceFrozen){  traceDropped++;  return;  }
+	next = (traceHead + 1) & TRACE_MASK;
+	while (next == traceTail){
+		if (txLineOpen){  traceFrozen = 1;  traceDropped++;  return;  }
+		TX_Poll();	}
+	traceOp[traceHead] = op;
+	traceVal[traceHead] = val;
+	traceSeq[traceHead] = traceNext++;
+	traceTime[traceHead] = ReadTimer3();
+	traceHead = next;						}
+
+/* Description: Record one register access ************************************
+ * Called by Write_MFRC522 and Read_MFRC522; a reader change is recorded first.
+ * Input parameters: op--register, | TRACE_READ for a read; val--byte written or read
+ * return: null 						*/
+void Trace_Record(uchar op, uchar val){
+	if (traceReader != readerCur){
+		traceReader = readerCur;
+		Trace_Put(TRACE_READER | readerCur, readerCur);	}
+	Trace_Put(op, val);						}
+
+/* Description: Queue one byte of a trace line in the transmit ring ************
+ * Input parameters: c--byte, the caller checked there is room
+ * return: null 						*/
+void Trace_Queue(char c){
+	txRing[txHead] = c;
+	txHead = (txHead + 1) & TX_RING_MASK;	}
+
+/* Description: Move trace records into the transmit ring *********************
+ * Called by TX_Poll; only between two lines of the driver output and when a
+ * whole line fits, so trace lines are never split. Output written directly
+ * to the USART must be preceded by TX_Flush, as for the transmit ring.
+ * Input parameters: null
+ * return: null 						*/
+void Trace_Poll(void){
+	uchar t;
+	while ((traceTail != traceHead) && !txLineOpen &&
+			(((txTail - txHead - 1) & TX_RING_MASK) >= TRACE_LINE_LEN)){
+		t = traceTail;
+		Trace_Queue('T');
+		Trace_Queue(hexDigit[traceSeq[t] >> 4]);
+		Trace_Queue(hexDigit[traceSeq[t] & 0x0F]);
+		Trace_Queue(hexDigit[traceOp[t] >> 4]);
+		Trace_Queue(hexDigit[traceOp[t] & 0x0F]);
+		Trace_Queue(hexDigit[traceVal[t] >> 4]);
+		Trace_Queue(hexDigit[traceVal[t] & 0x0F]);
+		Trace_Queue(hexDigit[traceTime[t] >> 12]);
+		Trace_Queue(hexDigit[(traceTime[t] >> 8) & 0x0F]);
+		Trace_Queue(hexDigit[(traceTime[t] >> 4) & 0x0F]);
+		Trace_Queue(hexDigit[traceTime[t] & 0x0F]);
+		Trace_Queue('\r');
+		traceTail = (traceTail + 1) & TRACE_MASK;	}	}
+#endif
+
+#if FMT_BENCH
+/* Description: Compare sprintf with the TX_ formatter on one HEX dump line ****
+ * Timer3 counts instruction cycles (1:1, Fcy); both paths queue the same line
+ * in the transmit ring, which is emptied first so no wait is counted.
+ * Input parameters: null
+ * return: null 						*/
+void sendFormatBench(void){
+	static const rom uchar line[16] = {0x00,0x01,0x0F,0x10,0x7F,0x80,0xA5,0xFF,'R','C','5','2','2',' ','\r',0x1B};
+	static char text[56];						//"%2d:" + 16 x " %02X" + \r + null
+	uchar i;
+	uint start, withSprintf, withTx;
+	TX_Flush();
+	start = ReadTimer3();
+	sprintf(text, (const far rom char*)"%2d: %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X\r",
+		63, line[0], line[1], line[2], line[3], line[4], line[5], line[6], line[7],
+		line[8], line[9], line[10], line[11], line[12], line[13], line[14], line[15]);
+	TX_Puts(text);
+	withSprintf = ReadTimer3() - start;
+	TX_Flush();
+	start = ReadTimer3();
+	TX_PutDec(63, 2);
+	TX_Putc(':');
+	for (i=0; i<16; i++){  TX_Putc(' ');  TX_PutHex(line[i]);  }
+	TX_Putc('\r');
+	withTx = ReadTimer3() - start;
+	TX_Flush();
+	TX_Putrs("HEX line cycles: sprintf ");
+	TX_PutDec(withSprintf, 0);
+	TX_Putrs(", TX_PutHex ");
+	TX_PutDec(withTx, 0);
+	TX_Putc('\r');
+	TX_Flush();								}
+#endif
+
+#if ISR_ENABLE
+/* Description: Turn the interrupts on ****************************************
+ * High priority: USART RX, MFRC522 IRQ of reader 1 (INT1, RB1) and reader 2
+ * (CCP1, RC2, the edge time captured from Timer1); reader 3 (RC3) is polled.
+ * Low priority: TX drain and the 1 ms Timer2 tick. The ISRs are in main.c.
+ * Input parameters: null
+ * return: null 						*/
+void Isr_Start(void){
+	OpenTimer1(TIMER_INT_OFF & T1_16BIT_RW & T1_SOURCE_INT & T1_PS_1_1 & T1_OSC1EN_OFF & T1_SYNC_EXT_OFF);
+	T3CONbits.T3CCP2 = 0;					//Timer1 is the time base of CCP1
+	T3CONbits.T3CCP1 = 0;
+	IPR1bits.RCIP = 1;
+	PIE1bits.RCIE = 1;
+#if READER_COUNT > 1
+	INTCON2bits.INTEDG1 = 0;				//IRQ is active low
+	INTCON3bits.INT1IP = 1;
+	INTCON3bits.INT1IF = 0;
+	INTCON3bits.INT1IE = 1;
+#endif
+#if READER_COUNT > 2
+	OpenCapture1(C1_EVERY_FALL_EDGE & CAPTURE_INT_ON);
+	IPR1bits.CCP1IP = 1;
+	PIR1bits.CCP1IF = 0;
+#endif
+	IPR1bits.TXIP = 0;						//TXIE is set by TX_Putc
+	OpenTimer2(TIMER_INT_ON & T2_PS_1_4 & T2_POST_1_1);
+	PR2 = TICK_PR2;
+	IPR1bits.TMR2IP = 0;
+	isrOn = 1;
+	RCONbits.IPEN = 1;
+	INTCONbits.GIEH = 1;
+	INTCONbits.GIEL = 1;
+	if (txHead != txTail){  PIE1bits.TXIE = 1;  }	}	//queued before, TX_Poll no longer sends
+
+/* Description: Timer1 time outside the ISRs ***********************************
+ * TMR1H is latched by the TMR1L read, which the ISRs also do.
+ * Input parameters: null
+ * return: Timer1, us 						*/
+uint Isr_Now(void){
+	uint t;
+	uchar gie;
+	gie = INTCONbits.GIEH;
+	INTCONbits.GIEH = 0;
+	t = ReadTimer1();
+	INTCONbits.GIEH = gie;
+	return t;								}
+
+/* Description: Account the time of one ISR, on its exit ***********************
+ * Input parameters: level--ISR_HIGH or ISR_LOW; start--Timer1 on entry
+ * return: null 						*/
+void Isr_Done(uchar level, uint start){
+	uint t;
+	t = ReadTimer1() - start;
+	if (t > isrTimeMax[level]){  isrTimeMax[level] = t;  }
+	isrCount[level]++;						}
+
+/* Description: Send the next byte of the transmit ring, low priority **********
+ * Input parameters: null
+ * return: null 						*/
+void Isr_Tx(void){
+	if (txHead == txTail){
+		PIE1bits.TXIE = 0;
+		return;	}
+	TXREG = txRing[txTail];
+	txTail = (txTail + 1) & TX_RING_MASK;	}
+
+/* Description: 1 ms tick, low priority ****************************************
+ * Timer2 restarts from 0 at the period match that raises TMR2IF, so its
+ * count on entry is the entry latency.
+ * Input parameters: count--TMR2 read first on entry
+ * return: null 						*/
+void Isr_Tick(uchar count){
+	uint t;
+	PIR1bits.TMR2IF = 0;
+	tickCount++;
+	t = (uint)count * TICK_US_PER_COUNT;
+	if (t > isrEntryMax[ISR_LOW]){  isrEntryMax[ISR_LOW] = t;  }	}
+
+/* Description: MFRC522 IRQ edge of a reader, high priority ********************
+ * Input parameters: r--reader; edge--Timer1 at the edge (CCP1 capture), or
+ *                   start when the pin has no capture; start--Timer1 on entry
+ * return: null 						*/
+void Isr_ReaderEdge(uchar r, uint edge, uint start){
+	uint t;
+	readerIrqTime[r] = edge;
+	readerIrqSeen[r] = 1;					//after the time, Isr_Notice reads it
+	t = start - edge;
+	if (t > isrEntryMax[ISR_HIGH]){  isrEntryMax[ISR_HIGH] = t;  }	}
+#endif
+
+/* Description: Move one received byte to the receive ring *********************
+ * The high priority ISR on RCIF, RX_Getc while the interrupts are off.
+ * Input parameters: null
+ * return: null 						*/
+void Isr_Rx(void){
+	uchar c, next;
+	if (RCSTAbits.OERR){					//cleared by CREN off and on
+		RCSTAbits.CREN = 0;
+		RCSTAbits.CREN = 1;
+		rxOverruns++;	}
+	c = RCREG;
+	next = (rxHead + 1) & RX_RING_MASK;
+	if (next == rxTail){
+		rxOverruns++;
+		return;	}
+	rxRing[rxHead] = c;
+	rxHead = next;							}
+
+/* Description: Get one byte of the receive ring *******************************
+ * Input parameters: c--byte received
+ * return: 1 if a byte was read, 0 if the ring is empty 	*/
+uchar RX_Getc(uchar *c){
+	if (!isrOn && PIR1bits.RCIF){  Isr_Rx();  }
+	if (rxHead == rxTail){  return 0;  }
+	*c = rxRing[rxTail];
+	rxTail = (rxTail + 1) & RX_RING_MASK;
+	return 1;								}
+
+/* Description: The driver sees the end of a command on the IRQ pin ************
+ * Keeps the worst time since the ISR took the edge: how late the main loop
+ * is behind the MFRC522.
+ * Input parameters: null
+ * return: null 						*/
+void Isr_Notice(void){
+#if ISR_ENABLE
+	uint t;
+	if (!readerIrqSeen[readerCur]){  return;  }
+	t = Isr_Now() - readerIrqTime[readerCur];
+	if (t > irqNoticeMax){  irqNoticeMax = t;  }
+	readerIrqSeen[readerCur] = 0;
+#endif
+	}
+
+/* Description: ms since the interrupts are on *********************************
+ * Input parameters: null
+ * return: tick count 						*/
+uint Tick_Read(void){
+	uint t;
+	uchar gie;
+	gie = INTCONbits.GIEL;
+	INTCONbits.GIEL = 0;					//2 bytes written by the low priority ISR
+	t = tickCount;
+	INTCONbits.GIEL = gie;
+	return t;								}
+
+/* Description: Clear the ISR latency counters *********************************
+ * Input parameters: null
+ * return: null 						*/
+void Isr_ResetStats(void){
+	uchar gie;
+	gie = INTCONbits.GIEH;
+	INTCONbits.GIEH = 0;
+	isrCount[ISR_HIGH] = 0;
+	isrCount[ISR_LOW] = 0;
+	isrEntryMax[ISR_HIGH] = 0;
+	isrEntryMax[ISR_LOW] = 0;
+	isrTimeMax[ISR_HIGH] = 0;
+	isrTimeMax[ISR_LOW] = 0;
+	irqNoticeMax = 0;
+	rxOverruns = 0;
+	INTCONbits.GIEH = gie;					}
+
+/* Description: Send the ISR counters and worst latencies to serial ************
+ * Input parameters: null
+ * return: null 						*/
+void sendIsrReport(void){
+	uchar level;
+	for (level=ISR_HIGH; level<=ISR_LOW; level++){
+		TX_Putrs(level == ISR_HIGH ? "ISR high " : "ISR low ");
+		TX_PutDec(isrCount[level], 0);
+		TX_Putrs(" entry max ");
+		TX_PutDec(isrEntryMax[level], 0);
+		TX_Putrs(" us, time max ");
+		TX_PutDec(isrTimeMax[level], 0);
+		TX_Putrs(" us\r");	}
+	TX_Putrs("MFRC522 IRQ seen after max ");
+	TX_PutDec(irqNoticeMax, 0);
+	TX_Putrs(" us\rRX overruns ");
+	TX_PutDec(rxOverruns, 0);
+	TX_Putc('\r');
+	TX_Flush();								}
+
+
+//------------------------------------------------------------------------------
+//modules of the build profile, in dependency order (MFRC522-Modules.h)
+#if RC522_TRANSPORT
+#include "MFRC522-Transport.h"
+#endif
+#if RC522_CLASSIC
+#include "MFRC522-Classic.h"
+#endif
+#if RC522_CONFIG
+#include "MFRC522-Config.h"
+#endif
+#if RC522_DUMP
+#include "MFRC522-Dump.h"
+#endif
+#if RC522_PERSO
+#include "MFRC522-Perso.h"
+#endif
+#if RC522_TUNE
+#include "MFRC522-Tune.h"
+#endif
+#if RC522_GATE
+#include "MFRC522-Gate.h"
+#endif
+#if RC522_TCL
+#include "MFRC522-ISO14443-4.h"
+#endif
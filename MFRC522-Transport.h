@@ -0,0 +1,333 @@
+/*
+ * Name: MFRC522-Transport.h
+ * ISO14443-3 card layer on top of MFRC522-RFID-SPI.h
+ * REQA/WUPA  ->  anticollision  ->  select (cascade levels)  ->  HALT
+ *
+ * Card presence tracker (MFRC522_Presence) and transaction runner (TXN_xxx)
+ * used by the modes. Included by MFRC522-RFID-SPI.h when RC522_TRANSPORT is
+ * set, see MFRC522-Modules.h.
+ */
+
+//prototype functions
+uchar MFRC522_Request(uchar reqMode, uchar *TagType);
+uchar MFRC522_Anticoll(uchar *serNum);
+uchar MFRC522_AnticollLevel(uchar level, uchar *serNum);
+uchar MFRC522_SelectTag(uchar *serNum);
+uchar MFRC522_SelectLevel(uchar level, uchar *serNum, uchar *sak);
+uchar MFRC522_SelectCard(uchar *uid, uchar *uidLen, uchar *sak);
+uchar MFRC522_GetCardType(uchar sak);
+void MFRC522_Halt(void);
+uchar MFRC522_Presence(void);
+uchar MFRC522_Reselect(void);
+void TXN_Begin(void);
+uchar TXN_Check(uchar stage, uchar status);
+uchar TXN_End(void);
+void TXN_ResetStats(void);
+void sendTxnResult(void);
+void sendTxnStats(void);
+void MFRC522_PresenceReset(void);
+
+//card presence tracker
+uchar presenceUid[MAX_UID_LEN];			//UID of the tracked card
+uchar presenceUidLen;
+uchar presenceSak;
+uchar presenceAtqa[2];
+uchar presenceState;					//0 = no card, 1 = card tracked
+uchar presenceMiss;						//consecutive polls without answer
+uchar presenceSwap;						//another card already selected, report it next
+uchar presenceNextUid[MAX_UID_LEN];
+uchar presenceNextUidLen;
+uchar presenceNextSak;
+
+//transaction runner: first failed stage of the current transaction and counters
+uchar txnStage;							//STAGE_xxx that failed, STAGE_NONE if none
+uchar txnError;							//MI_xxx code of that stage
+uint  txnFail[STAGE_COUNT];				//failures per stage since TXN_ResetStats
+uint  txnCount;							//transactions started
+uint  txnDone;							//transactions without failure
+
+const rom char *rom txnStageName[STAGE_COUNT] = {"request", "select", "auth", "read", "write", "value"};
+const rom char *rom txnErrorName[MI_NOACCESS+1] = {"ok", "no tag", "error", "CRC", "collision", "auth", "timeout", "no access"};
+
+//------------------------------------------------------------------------------
+
+/* Description: Searching card, read card type *********************************
+ * Input parameter: reqMode -- search methods,
+ *			 TagType--return card types
+ *			 	0x4400 = Mifare_UltraLight
+ *				0x0400 = Mifare_One(S50)
+ *				0x0200 = Mifare_One(S70)
+ *				0x0800 = Mifare_Pro(X)
+ *				0x4403 = Mifare_DESFire
+ * return:return MI_OK if successed		*/
+uchar MFRC522_Request(uchar reqMode, uchar *TagType) {
+	uchar status;  
+	uint backBits;							//the data bits that received
+	Write_MFRC522(BitFramingReg, 0x07);		//TxLastBists = BitFramingReg[2..0]
+	TagType[0] = reqMode;
+	MFRC522_SetTimeout(TIMEOUT_SHORT);
+	Boot_FirstReqa();
+	status = MFRC522_ToCard(PCD_TRANSCEIVE, TagType, 1, TagType, &backBits);
+	if ((status == MI_OK) && (backBits != 0x10)){  status = MI_ERR;  }
+	return status;				}
+
+/* Description: Prevent conflict, read the card serial number ******************
+ * Input parameter: serNum--return the 4 bytes card serial number, the 5th byte is recheck byte
+ * return: return MI_OK if successed			*/
+uchar MFRC522_Anticoll(uchar *serNum){
+	return MFRC522_AnticollLevel(PICC_ANTICOLL, serNum);	}
+
+/* Description: Prevent conflict on one cascade level **************************
+ * Input parameter: level--PICC_ANTICOLL, PICC_ANTICOLL_CL2 or PICC_ANTICOLL_CL3
+ *			 serNum--return the 4 bytes of this level (CT + 3 bytes if UID continues), 5th byte is BCC
+ * return: return MI_OK if successed			*/
+uchar MFRC522_AnticollLevel(uchar level, uchar *serNum){
+    uchar status;
+    uchar i;
+	uchar serNumCheck=0;
+    uint unLen;
+    //ClearBitMask(Status2Reg, 0x08);		//TempSensclear
+    //ClearBitMask(CollReg,0x80);			//ValuesAfterColl
+	Write_MFRC522(BitFramingReg, 0x00);		//TxLastBists = BitFramingReg[2..0]
+    serNum[0] = level;
+    serNum[1] = 0x20;
+    MFRC522_SetTimeout(TIMEOUT_SELECT);
+    status = MFRC522_ToCard(PCD_TRANSCEIVE, serNum, 2, serNum, &unLen);
+    if (status == MI_OK){
+		//Verify card serial number
+		for (i=0; i<4; i++){	serNumCheck ^= serNum[i];	}
+		if (serNumCheck != serNum[i]){ 	status = MI_ERR;    }
+    }
+    //SetBitMask(CollReg, 0x80);		//ValuesAfterColl=1
+    return status;					} 				
+
+/* Description: Select card, read card storage volume *************************
+ * Input parameter :serNum--Send card serial number
+ * return: return the card storage volume			 */
+uchar MFRC522_SelectTag(uchar *serNum) {
+	uchar size;
+	if (MFRC522_SelectLevel(PICC_SElECTTAG, serNum, &size) != MI_OK){ 	size = 0;  	}
+    return size;						}
+
+/* Description: Select card on one cascade level ******************************
+ * Input parameter: level--PICC_SElECTTAG, PICC_ANTICOLL_CL2 or PICC_ANTICOLL_CL3
+ *			 serNum--4 bytes of this level + BCC, as returned by MFRC522_AnticollLevel
+ *			 sak--return the select acknowledge byte
+ * return: return MI_OK if successed and CRC of the SAK matches	 */
+uchar MFRC522_SelectLevel(uchar level, uchar *serNum, uchar *sak) {
+    uchar i;
+	uchar status;
+    uint recvBits;
+    uchar *buffer;
+	buffer = framePool[FRAME_PCD];
+	//ClearBitMask(Status2Reg, 0x08);			//MFCrypto1On=0
+    buffer[0] = level;
+    buffer[1] = 0x70;
+    for (i=0; i<5; i++){  buffer[i+2] = *(serNum+i);  }
+    MFRC522_SetTimeout(TIMEOUT_SELECT);
+    MFRC522_CrcOn(1);							//CRC_A of the frame and of the SAK
+    status = MFRC522_ToCard(PCD_TRANSCEIVE, buffer, 7, buffer, &recvBits);
+    MFRC522_CrcOn(0);
+    if (status == MI_CRCERR){  return status;  }
+    if ((status != MI_OK) || (recvBits != 0x08)){  return MI_ERR;  }
+    *sak = buffer[0];
+    return status;						}
+
+/* Description: Anticollision and select through all cascade levels ***********
+ * Input parameter: uid--return the 4, 7 or 10 bytes UID (MAX_UID_LEN buffer)
+ *			 uidLen--return the UID length; sak--return the final SAK
+ * return: return MI_OK if successed			 */
+uchar MFRC522_SelectCard(uchar *uid, uchar *uidLen, uchar *sak) {
+	uchar level, i, n;
+	uchar status;
+	uchar *serNum;
+	serNum = framePool[FRAME_DATA];
+	n = 0;
+	for (level=PICC_ANTICOLL; level<=PICC_ANTICOLL_CL3; level+=2){
+		status = MFRC522_AnticollLevel(level, serNum);
+		if (status == MI_OK){  status = MFRC522_SelectLevel(level, serNum, sak);  }
+		if (status != MI_OK){  return status;  }
+		if (!(*sak & 0x04)){								//UID complete
+			for (i=0; i<4; i++){  uid[n++] = serNum[i];  }
+			*uidLen = n;
+#if RC522_DUMP
+			cacheCurrent = Cache_Find(uid, n);
+#endif
+			return MI_OK;	}
+		for (i=1; i<4; i++){  uid[n++] = serNum[i];  }		//skip cascade tag
+	}
+	return MI_ERR;						}
+
+/* Description: Decode card type from SAK **************************************
+ * Input parameter: sak--select acknowledge of the last cascade level
+ * return: PICC_TYPE_xxx						 */
+uchar MFRC522_GetCardType(uchar sak) {
+	if (sak & 0x04){  return PICC_TYPE_NOT_COMPLETE;  }
+	switch (sak & 0x7F) {
+		case 0x00:	return PICC_TYPE_ULTRALIGHT;
+		case 0x09:	return PICC_TYPE_MIFARE_MINI;
+		case 0x08:	return PICC_TYPE_MIFARE_1K;
+		case 0x18:	return PICC_TYPE_MIFARE_4K;
+		case 0x20:	return PICC_TYPE_ISO14443_4;
+		default:	break;	}
+	return PICC_TYPE_UNKNOWN;			}
+
+/* Description: Command the cards into sleep mode ******************************
+ * Input parameters: null
+ * return: null 						*/
+void MFRC522_Halt(void){
+	uchar status;
+    uint unLen;
+    uchar *buff;
+    buff = framePool[FRAME_PCD];
+    buff[0] = PICC_HALT;
+    buff[1] = 0;
+    CalulateCRC(buff, 2, &buff[2]);
+    MFRC522_SetTimeout(TIMEOUT_HALT);
+    status = MFRC522_ToCard(PCD_TRANSCEIVE, buff, 4, buff,&unLen);
+	ClearBitMask(Status2Reg, 0x08);	}		//MFCrypto1On=0, next REQA/WUPA in plain
+
+/* Description: Track the card in the field ************************************
+ * With no card tracked, REQA finds a new card (halted cards do not answer) and
+ * selects it: PRESENCE_ARRIVE, the caller runs its transaction and halts it.
+ * With a card tracked, WUPA wakes the halted card and its UID is compared:
+ * same card is halted again (PRESENCE_STAY); PRESENCE_DEBOUNCE polls without
+ * answer give PRESENCE_LEAVE, and the next call polls for a new card at once.
+ * Input parameters: null
+ * return: PRESENCE_xxx event; the card is in presenceUid, presenceUidLen, presenceSak */
+uchar MFRC522_Presence(void){
+	uchar status;
+	uchar i;
+	uchar *str;
+	Cfg_Poll();									//configuration frames from the host
+	str = framePool[FRAME_APP];
+	if (presenceSwap){							//card that replaced the tracked one
+		presenceSwap = 0;
+		for (i=0; i<MAX_UID_LEN; i++){  presenceUid[i] = presenceNextUid[i];  }
+		presenceUidLen = presenceNextUidLen;
+		presenceSak = presenceNextSak;
+		presenceState = 1;
+		presenceMiss = 0;
+		return PRESENCE_ARRIVE;	}
+	if (!presenceState){
+		status = MFRC522_Request(PICC_REQIDL, str);
+		Boot_Poll();							//boot report, once the first REQA is out
+		if (status != MI_OK){
+			if (++healthIdle >= HEALTH_PERIOD){  healthIdle = 0;  Health_Check();  }	//idle: check the chip
+			return PRESENCE_NONE;	}
+		presenceAtqa[0] = str[0];
+		presenceAtqa[1] = str[1];
+		status = MFRC522_SelectCard(presenceUid, &presenceUidLen, &presenceSak);
+		if (status != MI_OK){  txnFail[STAGE_SELECT]++;  return PRESENCE_NONE;  }
+		presenceState = 1;
+		presenceMiss = 0;
+		return PRESENCE_ARRIVE;	}
+	status = MFRC522_Request(PICC_REQALL, str);	//wake the halted card
+	if (status == MI_OK){  status = MFRC522_SelectCard(presenceNextUid, &presenceNextUidLen, &presenceNextSak);  }
+	if (status != MI_OK){
+		if (++presenceMiss < PRESENCE_DEBOUNCE){  return PRESENCE_STAY;  }
+		presenceState = 0;
+		return PRESENCE_LEAVE;	}
+	presenceMiss = 0;
+	status = (presenceNextUidLen == presenceUidLen);
+	for (i=0; status && (i<presenceUidLen); i++){  status = (presenceNextUid[i] == presenceUid[i]);  }
+	if (status){
+		MFRC522_Halt();
+		return PRESENCE_STAY;	}
+	presenceAtqa[0] = str[0];					//another card, already selected
+	presenceAtqa[1] = str[1];
+	presenceSwap = 1;
+	presenceState = 0;
+	return PRESENCE_LEAVE;				}
+
+/* Description: Select the tracked card again after a broken exchange *********
+ * A MIFARE Classic card that lost an encrypted frame is back in IDLE and its
+ * Crypto1 stream no longer matches: Crypto1 is dropped, WUPA wakes the card
+ * (a second one if the first only ended the authenticated state) and it is
+ * selected again. The caller authenticates again.
+ * Input parameters: null
+ * return: MI_OK if the card of presenceUid is selected	*/
+uchar MFRC522_Reselect(void){
+	uchar status;
+	uchar i, uidLen, sak;
+	uchar uid[MAX_UID_LEN];
+	ClearBitMask(Status2Reg, 0x08);				//MFCrypto1On=0, WUPA in plain
+	status = MFRC522_Request(PICC_REQALL, framePool[FRAME_DATA]);
+	if (status != MI_OK){  status = MFRC522_Request(PICC_REQALL, framePool[FRAME_DATA]);  }
+	if (status == MI_OK){  status = MFRC522_SelectCard(uid, &uidLen, &sak);  }
+	if ((status == MI_OK) && (uidLen != presenceUidLen)){  status = MI_ERR;  }
+	for (i=0; (status == MI_OK) && (i<uidLen); i++){
+		if (uid[i] != presenceUid[i]){  status = MI_ERR;  }	}
+	return status;							}
+
+/* Description: Start a transaction on the selected card *********************
+ * Input parameters: null
+ * return: null 						*/
+void TXN_Begin(void){
+	txnStage = STAGE_NONE;
+	txnError = MI_OK;
+	txnCount++;								}
+
+/* Description: Record the result of one transaction stage *******************
+ * The first failure is kept in txnStage/txnError and counted in txnFail;
+ * the caller stops the chain when the returned status is not MI_OK.
+ * Input parameters: stage--STAGE_xxx; status--MI_xxx returned by the stage
+ * return: status 						*/
+uchar TXN_Check(uchar stage, uchar status){
+	if ((status != MI_OK) && (txnError == MI_OK)){
+		txnStage = stage;
+		txnError = status;
+		txnFail[stage]++;	}
+	return status;							}
+
+/* Description: End the transaction ********************************************
+ * Input parameters: null
+ * return: MI_OK, or the error of the stage that failed	*/
+uchar TXN_End(void){
+	if (txnError == MI_OK){  txnDone++;  }
+	return txnError;						}
+
+/* Description: Clear the transaction counters *********************************
+ * Input parameters: null
+ * return: null 						*/
+void TXN_ResetStats(void){
+	uchar i;
+	for (i=0; i<STAGE_COUNT; i++){  txnFail[i] = 0;  }
+	txnCount = 0;
+	txnDone = 0;							}
+
+/* Description: Send the failed stage of the last transaction to serial ********
+ * Input parameters: null
+ * return: null 						*/
+void sendTxnResult(void){
+	TX_Putrs("\rStopped at ");
+	TX_Putrs(txnStageName[txnStage]);
+	TX_Putrs(": ");
+	TX_Putrs(txnErrorName[txnError]);
+	TX_Putc('\r');							}
+
+/* Description: Send the transaction counters to serial ************************
+ * Input parameters: null
+ * return: null 						*/
+void sendTxnStats(void){
+	uchar i;
+	TX_Putrs("Transactions ");
+	TX_PutDec(txnDone, 0);
+	TX_Putc('/');
+	TX_PutDec(txnCount, 0);
+	TX_Putc('\r');
+	for (i=0; i<STAGE_COUNT; i++){
+		TX_Putrs(txnStageName[i]);
+		TX_Putrs(" failed ");
+		TX_PutDec(txnFail[i], 0);
+		TX_Putc('\r');	}
+	TX_Flush();								}
+
+/* Description: Forget the tracked card ****************************************
+ * Input parameters: null
+ * return: null 						*/
+void MFRC522_PresenceReset(void){
+	presenceState = 0;
+	presenceMiss = 0;
+	presenceSwap = 0;
+	presenceUidLen = 0;					}
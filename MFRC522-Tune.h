@@ -0,0 +1,134 @@
+/*
+ * Name: MFRC522-Tune.h
+ * Antenna tuning mode on top of MFRC522-Classic.h
+ * tuneAntenna (SW3+SW4) sweeps RxGain, MinLevel and driver conductance against a
+ * reference card and saves the best profile with Tune_Save; Tune_Load of the core
+ * applies it at every start.
+ *
+ * Included by MFRC522-RFID-SPI.h when RC522_TUNE is set, see MFRC522-Modules.h.
+ */
+
+//antenna tuning: sweep RxGain x MinLevel x driver conductance against a reference card
+#define TUNE_TRIALS            8				//WUPA..read..HALT per setting
+#define TUNE_BLOCK             4				//block read by a trial, key A FF..FF
+#define TUNE_PERIOD_S          600				//re-tuning period of tuneAntenna, delay1s() calls
+
+//prototype functions
+uchar Tune_Trial(uint *latency);
+uchar Tune_Sweep(void);
+void sendTuneResult(uchar *profile, uchar ok, uint latency);
+void tuneAntenna(void);
+
+//antenna tuning sweep: RFCfgReg RxGain 23, 33, 38, 43, 48 dB; RxThresholdReg MinLevel
+//5, 8, 11 with CollLevel 4; CWGsPReg = ModGsPReg conductance
+const rom uchar tuneGain[5] = {0x18, 0x48, 0x58, 0x68, 0x78};
+const rom uchar tuneThreshold[3] = {0x54, 0x84, 0xB4};
+const rom uchar tuneDriver[3] = {0x20, 0x30, 0x3F};
+uchar tuneProfile[TUNE_REGS];			//best profile of the last sweep
+uchar tuneOk;							//trials passed by it
+uint  tuneLatency;						//its mean trial time, us (Timer3 ticks at Fcy 1 MHz)
+
+//------------------------------------------------------------------------------
+
+/* Description: One tuning trial on the reference card *************************
+ * WUPA, anticollision and select, auth and read of TUNE_BLOCK, HALT.
+ * Input parameters: latency--return the trial time in us, 0xFFFF if longer
+ * return: MI_OK if the block was read	*/
+uchar Tune_Trial(uint *latency){
+	uchar status;
+	uchar uid[MAX_UID_LEN];
+	uchar uidLen, sak;
+	uchar *block;
+	block = framePool[FRAME_APP];
+	PIR2bits.TMR3IF = 0;
+	WriteTimer3(0);
+	status = MFRC522_Request(PICC_REQALL, block);
+	if (status == MI_OK){  status = MFRC522_SelectCard(uid, &uidLen, &sak);  }
+	if (status == MI_OK){  status = MFRC522_AuthRom(PICC_AUTHENT1A, TUNE_BLOCK, keyDefault, &uid[uidLen-4]);  }
+	if (status == MI_OK){  status = MFRC522_Read(TUNE_BLOCK, block);  }
+	*latency = PIR2bits.TMR3IF ? 0xFFFF : ReadTimer3();
+	MFRC522_Halt();
+	return status;							}
+
+/* Description: Sweep the profiles on the current reader and keep the best ****
+ * Score: trials passed, then mean trial time. The best profile is applied and,
+ * if it passed any trial, saved to EEPROM.
+ * Input parameters: null
+ * return: MI_OK if a profile read the reference card	*/
+uchar Tune_Sweep(void){
+	uchar g, t, d, n, ok;
+	uchar profile[TUNE_REGS];
+	uchar saved[TUNE_REGS];
+	uint latency;
+	unsigned long total;
+	for (n=0; n<TUNE_REGS; n++){  saved[n] = Read_MFRC522(tuneRegs[n]);  }
+	tuneOk = 0;
+	tuneLatency = 0xFFFF;
+	for (g=0; g<sizeof(tuneGain); g++){
+		for (t=0; t<sizeof(tuneThreshold); t++){
+			for (d=0; d<sizeof(tuneDriver); d++){
+				profile[0] = tuneGain[g];
+				profile[1] = tuneThreshold[t];
+				profile[2] = tuneDriver[d];
+				profile[3] = tuneDriver[d];
+				Tune_Apply(profile);
+				for (n=0, ok=0, total=0; n<TUNE_TRIALS; n++){
+					if (Tune_Trial(&latency) == MI_OK){  ok++;  total += latency;  }	}
+				latency = ok ? total / ok : 0xFFFF;
+				sendTuneResult(profile, ok, latency);
+				if ((ok > tuneOk) || ((ok == tuneOk) && ok && (latency < tuneLatency))){
+					tuneOk = ok;
+					tuneLatency = latency;
+					for (n=0; n<TUNE_REGS; n++){  tuneProfile[n] = profile[n];  }	}	}	}	}
+	if (!tuneOk){
+		Tune_Apply(saved);						//no card, keep the profile in use
+		return MI_ERR;	}
+	Tune_Apply(tuneProfile);
+	Tune_Save(tuneProfile);
+	return MI_OK;							}
+
+/* Description: Send one line of the tuning report to serial *******************
+ * Input parameters: profile--registers tried; ok--trials passed; latency--mean trial time, us
+ * return: null 						*/
+void sendTuneResult(uchar *profile, uchar ok, uint latency){
+	TX_Putrs("RF ");
+	TX_PutHex(profile[0]);
+	TX_Putrs(" thr ");
+	TX_PutHex(profile[1]);
+	TX_Putrs(" cw ");
+	TX_PutHex(profile[2]);
+	TX_Putrs(" mod ");
+	TX_PutHex(profile[3]);
+	TX_Putrs(": ");
+	TX_PutDec(ok, 0);
+	TX_Putc('/');
+	TX_PutDec(TUNE_TRIALS, 0);
+	TX_Putc(' ');
+	TX_PutDec(latency, 0);
+	TX_Putrs(" us\r");
+	TX_Flush();								}
+
+/* Description: Calibration mode, tune every reader on its reference card ******
+ * Keep a card with key A FF..FF at the working distance of each antenna. The
+ * sweep runs at start and every TUNE_PERIOD_S delay1s(); a reader without card keeps its
+ * saved profile.
+ * Input parameter: null
+ * Return: null					 */
+void tuneAntenna(void){
+	uchar r;
+	uint s;
+	setup();
+	for(;;){
+		for (r=0; r<READER_COUNT; r++){
+			Reader_Select(r);
+			TX_Putrs("Reader ");
+			TX_PutDec(r, 0);
+			TX_Putc('\r');
+			TX_Flush();
+			if (Tune_Sweep() == MI_OK){
+				TX_Putrs("Best, saved: ");
+				sendTuneResult(tuneProfile, tuneOk, tuneLatency);	}
+			else{  TX_Putrs("No reference card\r");  TX_Flush();  }
+			Boot_Poll();	}
+		Reader_Select(0);
+		for (s=0; s<TUNE_PERIOD_S; s++){  delay1s();  }	}	}
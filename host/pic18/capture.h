@@ -0,0 +1,7 @@
+/* Host stand-in for the C18 capture library */
+#ifndef PIC18_HOST_CAPTURE_H
+#define PIC18_HOST_CAPTURE_H
+#define C1_EVERY_4_RISE_EDGE	0x86
+#define CAPTURE_INT_OFF			0x7f
+void OpenCapture1(unsigned char config);
+#endif
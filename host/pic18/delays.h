@@ -0,0 +1,9 @@
+/* Host stand-in for the C18 delays library: advances the host clock, Fcy 1 MHz */
+#ifndef PIC18_HOST_DELAYS_H
+#define PIC18_HOST_DELAYS_H
+void Delay1TCY(void);
+void Delay10TCYx(unsigned char n);
+void Delay100TCYx(unsigned char n);
+void Delay1KTCYx(unsigned char n);
+void Delay10KTCYx(unsigned char n);
+#endif
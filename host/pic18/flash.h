@@ -0,0 +1,10 @@
+/* Host stand-in for the C18 flash library: program memory is hostFlash */
+#ifndef PIC18_HOST_FLASH_H
+#define PIC18_HOST_FLASH_H
+#define FLASH_WRITE_BLOCK	32
+#define FLASH_ERASE_BLOCK	64
+#define FLASH_PTR(addr)		(hostFlash + (addr))	//program memory read as data
+extern unsigned char hostFlash[0x8000];
+void EraseFlash(unsigned long startaddr, unsigned long endaddr);
+void WriteBlockFlash(unsigned long startaddr, unsigned char num_blocks, unsigned char *flash_array);
+#endif
@@ -0,0 +1,50 @@
+/*
+ * Name: p18f4520.h (host)
+ * Host stand-in for the C18 device header, so the driver builds on Linux for
+ * the tools in host/. Special function registers are plain variables defined
+ * in pic18_host.c; only the registers and bits the driver uses are declared.
+ */
+#ifndef PIC18_HOST_P18F4520_H
+#define PIC18_HOST_P18F4520_H
+
+//C18 storage qualifiers and 16 bit int of the target
+#define rom
+#define far
+#define near
+#define ram
+#define uint	unsigned short
+
+typedef struct { unsigned RA0:1,RA1:1,RA2:1,RA3:1,RA4:1,RA5:1,RA6:1,RA7:1; } PORTAbits_t;
+typedef struct { unsigned RB0:1,RB1:1,RB2:1,RB3:1,RB4:1,RB5:1,RB6:1,RB7:1; } PORTBbits_t;
+typedef struct { unsigned RC0:1,RC1:1,RC2:1,RC3:1,RC4:1,RC5:1,RC6:1,RC7:1; } PORTCbits_t;
+typedef struct { unsigned RBIF:1,INT0IF:1,TMR0IF:1,RBIE:1,INT0IE:1,TMR0IE:1,GIEL:1,GIEH:1; } INTCONbits_t;
+typedef struct { unsigned BOR:1,POR:1,PD:1,TO:1,RI:1,:1,SBOREN:1,IPEN:1; } RCONbits_t;
+typedef struct { unsigned TMR1IP:1,TMR2IP:1,CCP1IP:1,SSPIP:1,TXIP:1,RCIP:1,ADIP:1,PSPIP:1; } IPR1bits_t;
+typedef struct { unsigned TMR1IE:1,TMR2IE:1,CCP1IE:1,SSPIE:1,TXIE:1,RCIE:1,ADIE:1,PSPIE:1; } PIE1bits_t;
+typedef struct { unsigned TMR1IF:1,TMR2IF:1,CCP1IF:1,SSPIF:1,TXIF:1,RCIF:1,ADIF:1,PSPIF:1; } PIR1bits_t;
+typedef struct { unsigned CCP2IF:1,TMR3IF:1,HLVDIF:1,BCLIF:1,EEIF:1,:1,CMIF:1,OSCFIF:1; } PIR2bits_t;
+typedef struct { unsigned RX9D:1,OERR:1,FERR:1,ADDEN:1,CREN:1,SREN:1,RX9:1,SPEN:1; } RCSTAbits_t;
+typedef struct { unsigned RD:1,WR:1,WREN:1,WRERR:1,FREE:1,:1,CFGS:1,EEPGD:1; } EECON1bits_t;
+
+extern volatile PORTAbits_t PORTAbits;
+extern volatile PORTBbits_t PORTBbits;
+extern volatile PORTCbits_t PORTCbits;
+extern volatile INTCONbits_t INTCONbits;
+extern volatile RCONbits_t RCONbits;
+extern volatile IPR1bits_t IPR1bits;
+extern volatile PIE1bits_t PIE1bits;
+extern volatile PIR1bits_t *hostPir1(void);
+#define PIR1bits	(*hostPir1())				//TXIF follows the line rate of pic18_host.c
+extern volatile PIR2bits_t PIR2bits;
+extern volatile RCSTAbits_t RCSTAbits;
+extern volatile EECON1bits_t EECON1bits;
+extern volatile unsigned char PORTA, PORTB, PORTC, PORTD, PORTE;
+extern volatile unsigned char LATA, LATB, LATC, LATD, LATE;
+extern volatile unsigned char TRISA, TRISB, TRISC, TRISD, TRISE;
+extern volatile unsigned char EEADR, EEDATA, EECON2, RCREG, FSR1L, FSR1H;
+extern volatile unsigned char *hostTxReg(void);
+#define TXREG		(*hostTxReg())				//a write starts sending one byte
+
+#define Nop()
+#define ClrWdt()
+#endif
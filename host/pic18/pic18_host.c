@@ -0,0 +1,116 @@
+/*
+ * Name: pic18_host.c
+ * Host side registers and C18 library stand-ins for the tools in host/.
+ * The host clock hostMicros counts instruction cycles (1 us at Fcy 1 MHz):
+ * delays advance it, Timer0 (1:256) and Timer3 (1:1) read it. SPI bytes go
+ * to hostSpi, the stand-in chip of the tool; USART output to hostUsart, at
+ * hostBaud when set (TXIF stays clear for the 10 bits of each byte).
+ * Program memory is hostFlash, zeros at start like the unprogrammed rom
+ * arrays of the firmware; an erase or a block write takes 2 ms, as on the chip.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "p18f4520.h"
+#include "delays.h"
+#include "usart.h"
+#include "sw_spi.h"
+#include "timers.h"
+#include "capture.h"
+#include "flash.h"
+#include "pic18_host.h"
+
+volatile PORTAbits_t PORTAbits;
+volatile PORTBbits_t PORTBbits;
+volatile PORTCbits_t PORTCbits;
+volatile INTCONbits_t INTCONbits;
+volatile RCONbits_t RCONbits;
+volatile IPR1bits_t IPR1bits;
+volatile PIE1bits_t PIE1bits;
+static volatile PIR1bits_t pir1 = {0,0,0,0,1,0,0,0};
+volatile PIR2bits_t PIR2bits;
+volatile RCSTAbits_t RCSTAbits;
+volatile EECON1bits_t EECON1bits;
+volatile unsigned char PORTA, PORTB, PORTC, PORTD, PORTE;
+volatile unsigned char LATA, LATB, LATC, LATD, LATE;
+volatile unsigned char TRISA, TRISB, TRISC, TRISD, TRISE;
+volatile unsigned char EEADR, EEDATA, EECON2, RCREG;
+volatile unsigned char FSR1L, FSR1H = 0xFF;		//above the stack: Stack_Paint paints nothing
+
+unsigned long hostMicros;
+char (*hostSpi)(char out);
+FILE *hostUsart;
+unsigned long hostBaud;
+unsigned char hostFlash[0x8000];
+
+static unsigned long timer0Base, timer3Base;
+static volatile unsigned char txReg;
+static int txPending;						//txReg holds a byte not yet passed to hostUsart
+static unsigned long txFreeAt;				//hostMicros when the USART takes the next byte
+
+static void txOut(void){
+	if (txPending && hostUsart) fputc(txReg == '\r' ? '\n' : txReg, hostUsart);
+	txPending = 0;
+}
+
+/* PIR1bits: TXIF is clear while the last byte written to TXREG is on the line;
+ * each read takes a cycle, so a loop waiting on TXIF lets the time run */
+volatile PIR1bits_t *hostPir1(void){
+	hostMicros++;
+	pir1.TXIF = !hostBaud || hostMicros >= txFreeAt;
+	if (pir1.TXIF) txOut();
+	return &pir1;
+}
+
+/* TXREG: the caller stores the byte after the call, so the previous one goes out now;
+ * 10 bits per byte on the line */
+volatile unsigned char *hostTxReg(void){
+	txOut();
+	txPending = 1;
+	if (hostBaud) txFreeAt = hostMicros + 10000000UL / hostBaud;
+	return &txReg;
+}
+
+void Delay1TCY(void){ hostMicros += 1; }
+void Delay10TCYx(unsigned char n){ hostMicros += 10UL * (n ? n : 256); }
+void Delay100TCYx(unsigned char n){ hostMicros += 100UL * (n ? n : 256); }
+void Delay1KTCYx(unsigned char n){ hostMicros += 1000UL * (n ? n : 256); }
+void Delay10KTCYx(unsigned char n){ hostMicros += 10000UL * (n ? n : 256); }
+
+void OpenUSART(unsigned char config, unsigned int spbrg){ (void)config; (void)spbrg; }
+void putcUSART(char c){ if (hostUsart) fputc(c == '\r' ? '\n' : c, hostUsart); }
+void putsUSART(char *s){ while (*s) putcUSART(*s++); }
+void putrsUSART(const char *s){ while (*s) putcUSART(*s++); }
+char BusyUSART(void){ return 0; }
+char DataRdyUSART(void){ return 0; }
+char ReadUSART(void){ return 0; }
+
+void OpenSWSPI(void){}
+char WriteSWSPI(char out){ return hostSpi ? hostSpi(out) : 0; }
+
+void OpenTimer0(unsigned char config){ (void)config; timer0Base = hostMicros; }
+unsigned int ReadTimer0(void){ return (unsigned int)(((hostMicros - timer0Base) >> 8) & 0xFFFF); }
+void WriteTimer0(unsigned int value){ timer0Base = hostMicros - ((unsigned long)value << 8); }
+void OpenTimer3(unsigned char config){ (void)config; timer3Base = hostMicros; }
+unsigned int ReadTimer3(void){ return (unsigned int)((hostMicros - timer3Base) & 0xFFFF); }
+void WriteTimer3(unsigned int value){ timer3Base = hostMicros - value; }
+
+void OpenCapture1(unsigned char config){ (void)config; }
+
+/* Flash erase sets bits to 1 over whole erase blocks, programming only clears them */
+void EraseFlash(unsigned long startaddr, unsigned long endaddr){
+	unsigned long a;
+	for (a = startaddr & ~(unsigned long)(FLASH_ERASE_BLOCK - 1); a < endaddr && a < sizeof hostFlash; a += FLASH_ERASE_BLOCK){
+		memset(hostFlash + a, 0xFF, FLASH_ERASE_BLOCK);
+		hostMicros += 2000;
+	}
+}
+void WriteBlockFlash(unsigned long startaddr, unsigned char num_blocks, unsigned char *flash_array){
+	unsigned long a = startaddr & ~(unsigned long)(FLASH_WRITE_BLOCK - 1);
+	int i;
+	while (num_blocks-- && a < sizeof hostFlash){
+		for (i = 0; i < FLASH_WRITE_BLOCK; i++) hostFlash[a + i] &= *flash_array++;
+		a += FLASH_WRITE_BLOCK;
+		hostMicros += 2000;
+	}
+}
@@ -0,0 +1,10 @@
+/* Host clock, SPI and USART hooks of pic18_host.c */
+#ifndef PIC18_HOST_H
+#define PIC18_HOST_H
+#include <stdio.h>
+#define ISR_ENABLE 0						//no interrupts: the driver polls TX and RX
+extern unsigned long hostMicros;			//instruction cycles since start, 1 us each
+extern char (*hostSpi)(char out);			//stand-in chip, one SPI byte exchanged
+extern FILE *hostUsart;						//USART output, direct and through TXREG, null to drop it
+extern unsigned long hostBaud;				//line rate paced by TXIF, 0: the USART is always free
+#endif
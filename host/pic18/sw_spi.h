@@ -0,0 +1,6 @@
+/* Host stand-in for the C18 software SPI library: bytes go to hostSpi */
+#ifndef PIC18_HOST_SW_SPI_H
+#define PIC18_HOST_SW_SPI_H
+void OpenSWSPI(void);
+char WriteSWSPI(char out);
+#endif
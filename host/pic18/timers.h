@@ -0,0 +1,15 @@
+/* Host stand-in for the C18 timers library: Timer0 and Timer3 count the host clock */
+#ifndef PIC18_HOST_TIMERS_H
+#define PIC18_HOST_TIMERS_H
+#define TIMER_INT_OFF	0x7f
+#define T0_16BIT		0xbf
+#define T0_SOURCE_INT	0xdf
+#define T0_PS_1_256		0xf7
+#define T3_SOURCE_INT	0xfd
+void OpenTimer0(unsigned char config);
+unsigned int ReadTimer0(void);
+void WriteTimer0(unsigned int value);
+void OpenTimer3(unsigned char config);
+unsigned int ReadTimer3(void);
+void WriteTimer3(unsigned int value);
+#endif
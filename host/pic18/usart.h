@@ -0,0 +1,17 @@
+/* Host stand-in for the C18 USART library: output goes to hostUsart, if set */
+#ifndef PIC18_HOST_USART_H
+#define PIC18_HOST_USART_H
+#define USART_TX_INT_OFF	0x7f
+#define USART_RX_INT_ON		0xff
+#define USART_RX_INT_OFF	0xbf
+#define USART_ASYNCH_MODE	0xfe
+#define USART_EIGHT_BIT		0xfd
+#define USART_CONT_RX		0xff
+void OpenUSART(unsigned char config, unsigned int spbrg);
+void putcUSART(char c);
+void putsUSART(char *s);
+void putrsUSART(const char *s);
+char BusyUSART(void);
+char DataRdyUSART(void);
+char ReadUSART(void);
+#endif
@@ -0,0 +1,568 @@
+/*
+ * Name: rc522_config.c
+ * Host side builder and loader of the configuration image of the reader
+ * firmware: keys, antenna tuning, settings and card templates. Builds the image
+ * from a text file and sends it to every reader given, all ports at once. A
+ * reader that runs the image of -d gets a delta: only the 32 byte windows that
+ * changed. The reader programs the image in its spare flash bank and switches
+ * to it when the whole image checks, so it keeps running the old one until then.
+ *
+ * Build: cc -O2 -o rc522_config rc522_config.c
+ * Use:   rc522_config [-o image] [-d previous image] [-B baud] [-t ms] [-n tries] config.txt [tty...]
+ *        rc522_config -r report[,report...] [-c] [-B baud] [-t ms] [-n tries] tty...
+ *        baud 2400 (OpenUSART spbrg 25 at Fosc 4 MHz), answer timeout t 1000 ms,
+ *        n 8 tries per frame; without tty only the image is built. -r prints
+ *        the reports of each reader instead: isr, txn, cache, reader, retry,
+ *        memory, bench; -c clears their counters
+ *
+ * Text file, one item per line, # starts a comment:
+ *	version <n>						1..65535, newer than the image on the readers
+ *	key <sector|*> <A|B> <12 hex>	key of a sector, * every sector without its own
+ *	tune <reader> <8 hex>			RFCfgReg, RxThresholdReg, CWGsPReg, ModGsPReg
+ *	set <name>=<value>...			margin, backoff, backoffmax, compact, fresh,
+ *									gatefirst, gatelast, retry.<profile> (reqa, select,
+ *									auth, read, write, nvm, halt, default); others
+ *									keep the firmware defaults
+ *	template <block> <32 hex>|"<16 chars>"	block written by writeTagBlockMemory,
+ *									not block 0 nor a sector trailer
+ *
+ * Image: header magic C5, format 01, version, records length, CRC-16 of the
+ * records, then the records <type> <len> <data>; 16 bit fields high byte first.
+ * Frames to the reader: A5 <type> <len> <payload> <crc16>, CRC-16/CCITT of
+ * type, len and payload, high byte first:
+ *	10 begin:  version, length, CRC [, version of the delta base]
+ *	11 data:   records offset, up to 32 bytes
+ *	12 commit
+ *	13 query
+ *	14 report: report number, bit 7 clears its counters; report lines, then
+ *	   K00<report>, or K03 when the report is not in the build profile
+ * Answer line: K<code><value>, code 00 ok, 01 frame CRC, 02 state, 03 range,
+ * 04 base, 05 version, 06 image CRC, 07 flash; value the next offset or the
+ * active version.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_PORTS		256
+#define LINE_LEN		256
+#define HEADER_LEN		8
+#define RECORDS_MAX		448				//bank 512 bytes less the header erase block
+#define CHUNK			32
+#define FRAME_SYNC		0xA5
+#define FRAME_MAX		(2 + CHUNK)
+#define MAGIC			0xC5
+#define FORMAT			1
+#define SETTINGS_LEN	15
+
+enum { FR_BEGIN = 0x10, FR_DATA, FR_COMMIT, FR_QUERY, FR_REPORT };
+enum { REC_KEY = 1, REC_TUNE, REC_SETTINGS, REC_TEMPLATE };
+enum { K_OK, K_FRAME, K_STATE, K_RANGE, K_BASE, K_VERSION, K_CRC, K_FLASH };
+enum { ST_QUERY, ST_BEGIN, ST_DATA, ST_COMMIT, ST_CHECK, ST_REPORT, ST_DONE, ST_FAILED };
+
+struct image {
+	unsigned int version, crc;
+	int len;
+	uint8_t rec[RECORDS_MAX];
+};
+
+struct port {
+	const char *path;
+	int fd, state, tries, restarts, full;
+	unsigned int active;					//version on the reader
+	int offset;								//records offset of the data frame sent
+	int report;								//index in reportList of the report asked
+	uint8_t frame[FRAME_MAX + 5];
+	int frameLen;
+	char line[LINE_LEN];
+	int len;
+	uint64_t start, deadline, end;
+	unsigned long frames, resends, bytes;
+	const char *why;
+};
+
+static const char *settingName[SETTINGS_LEN] = {"margin", "backoff", "backoffmax", "compact", "fresh",
+	"gatefirst", "gatelast", "retry.reqa", "retry.select", "retry.auth", "retry.read", "retry.write",
+	"retry.nvm", "retry.halt", "retry.default"};
+//firmware defaults: TIMEOUT_MARGIN_PCT, RETRY_BACKOFF_10US, RETRY_BACKOFF_MAX, COMPACT_ELIDE_TRAILERS,
+//CACHE_FRESH_TAPS, GATE_FIRST_BLOCK, GATE_LAST_BLOCK, retryLimit
+static uint8_t settings[SETTINGS_LEN] = {25, 10, 100, 1, 0, 4, 6, 0, 2, 0, 2, 0, 0, 0, 0};
+static int haveSettings;
+
+#define REPORT_CLEAR	0x80
+//CFG_REP_xxx of the firmware, in order
+static const char *reportName[] = {"isr", "txn", "cache", "reader", "retry", "memory", "bench"};
+#define REPORTS			(int)(sizeof reportName / sizeof reportName[0])
+static int reportList[REPORTS], nReports, reportClear;
+
+static struct image img, prev;
+static int havePrev;
+static struct port ports[MAX_PORTS];
+static int nPorts;
+static speed_t baud = B2400;
+static int timeoutMs = 1000, maxTries = 8;
+
+static uint64_t nowUs(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int hexNibble(char c){
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	return -1;
+}
+
+/* Parse len hex digits, -1 if a digit is not hex */
+static long hexField(const char *p, int len){
+	long v = 0;
+	int i, n;
+	for (i = 0; i < len; i++){
+		n = hexNibble(p[i]);
+		if (n < 0) return -1;
+		v = (v << 4) | n;
+	}
+	return v;
+}
+
+/* Parse exactly n hex bytes, 0 if malformed */
+static int hexBytes(const char *p, uint8_t *out, int n){
+	int i;
+	long v;
+	if ((int)strlen(p) != 2 * n) return 0;
+	for (i = 0; i < n; i++){
+		v = hexField(p + 2 * i, 2);
+		if (v < 0) return 0;
+		out[i] = (uint8_t)v;
+	}
+	return 1;
+}
+
+static unsigned int crc16(unsigned int crc, const uint8_t *p, int len){
+	int b;
+	while (len--){
+		crc ^= (unsigned int)*p++ << 8;
+		for (b = 0; b < 8; b++)
+			crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) & 0xFFFF : (crc << 1) & 0xFFFF;
+	}
+	return crc;
+}
+
+/* Version a after b, 16 bit serial numbers as the firmware compares them */
+static int newer(unsigned int a, unsigned int b){
+	return ((a - b - 1) & 0xFFFF) < 0x7FFF;
+}
+
+/* ---- image ---- */
+
+static int addRecord(int type, const uint8_t *data, int len){
+	if (img.len + 2 + len > RECORDS_MAX) return 0;
+	img.rec[img.len++] = (uint8_t)type;
+	img.rec[img.len++] = (uint8_t)len;
+	memcpy(img.rec + img.len, data, len);
+	img.len += len;
+	return 1;
+}
+
+static int setSetting(const char *item){
+	const char *eq = strchr(item, '=');
+	char *end;
+	long v;
+	int i;
+	if (!eq) return 0;
+	for (i = 0; i < SETTINGS_LEN; i++)
+		if (strlen(settingName[i]) == (size_t)(eq - item) && !strncmp(item, settingName[i], eq - item)) break;
+	v = strtol(eq + 1, &end, 0);
+	if (i == SETTINGS_LEN || *end || end == eq + 1 || v < 0 || v > 255) return 0;
+	settings[i] = (uint8_t)v;
+	haveSettings = 1;
+	return 1;
+}
+
+/* One line of the text file, 0 if malformed */
+static int parseItem(char *s){
+	char *word[4], *q;
+	uint8_t data[1 + 16];
+	long v;
+	int n = 0;
+	if ((q = strchr(s, '#')) && !strchr(s, '"')) *q = 0;
+	if (!strncmp(s, "template", 8) && (q = strchr(s, '"'))){		//text template, spaces kept
+		v = strtol(s + 8, 0, 0);
+		s = q + 1;
+		q = strrchr(s, '"');
+		if (!q || q - s > 16 || v <= 0 || v > 63 || (v & 3) == 3) return 0;
+		memset(data + 1, ' ', 16);
+		memcpy(data + 1, s, q - s);
+		data[0] = (uint8_t)v;
+		return addRecord(REC_TEMPLATE, data, 17);
+	}
+	if (!(q = strtok(s, " \t"))) return 1;
+	if (!strcmp(q, "set")){
+		while ((q = strtok(0, " \t"))){
+			if (!setSetting(q)) return 0;
+			n++;
+		}
+		return n > 0;
+	}
+	for (; q; q = strtok(0, " \t")){
+		if (n == 4) return 0;
+		word[n++] = q;
+	}
+	if (!strcmp(word[0], "version") && n == 2){
+		v = strtol(word[1], &q, 0);
+		if (*q || v < 1 || v > 0xFFFF) return 0;
+		img.version = (unsigned int)v;
+		return 1;
+	}
+	if (!strcmp(word[0], "key") && n == 4){
+		if (!strcmp(word[1], "*")) data[0] = 0xFF;
+		else {
+			v = strtol(word[1], &q, 0);
+			if (*q || v < 0 || v > 15) return 0;
+			data[0] = (uint8_t)v;
+		}
+		if (strcmp(word[2], "A") && strcmp(word[2], "B")) return 0;
+		data[1] = word[2][0] == 'A' ? 0x60 : 0x61;
+		return hexBytes(word[3], data + 2, 6) && addRecord(REC_KEY, data, 8);
+	}
+	if (!strcmp(word[0], "tune") && n == 3){
+		v = strtol(word[1], &q, 0);
+		if (*q || v < 0 || v > 7) return 0;
+		data[0] = (uint8_t)v;
+		return hexBytes(word[2], data + 1, 4) && addRecord(REC_TUNE, data, 5);
+	}
+	if (!strcmp(word[0], "template") && n == 3){
+		v = strtol(word[1], &q, 0);
+		if (*q || v <= 0 || v > 63 || (v & 3) == 3) return 0;
+		data[0] = (uint8_t)v;
+		return hexBytes(word[2], data + 1, 16) && addRecord(REC_TEMPLATE, data, 17);
+	}
+	return 0;
+}
+
+static void buildImage(const char *path){
+	char line[LINE_LEN];
+	FILE *f = fopen(path, "r");
+	int n = 0;
+	if (!f){ perror(path); exit(2); }
+	while (fgets(line, sizeof line, f)){
+		n++;
+		line[strcspn(line, "\r\n")] = 0;
+		if (!parseItem(line)){ fprintf(stderr, "%s:%d: bad line or image full\n", path, n); exit(2); }
+	}
+	fclose(f);
+	if (!img.version){ fprintf(stderr, "%s: no version\n", path); exit(2); }
+	if (haveSettings && !addRecord(REC_SETTINGS, settings, SETTINGS_LEN)){ fprintf(stderr, "%s: image full\n", path); exit(2); }
+	img.crc = crc16(0xFFFF, img.rec, img.len);
+}
+
+static void writeImage(const char *path){
+	uint8_t h[HEADER_LEN] = {MAGIC, FORMAT, img.version >> 8, img.version & 0xFF,
+		img.len >> 8, img.len & 0xFF, img.crc >> 8, img.crc & 0xFF};
+	FILE *f = fopen(path, "wb");
+	if (!f || fwrite(h, 1, HEADER_LEN, f) != HEADER_LEN || fwrite(img.rec, 1, img.len, f) != (size_t)img.len){
+		perror(path);
+		exit(2);
+	}
+	fclose(f);
+}
+
+static void readImage(const char *path, struct image *im){
+	uint8_t h[HEADER_LEN];
+	FILE *f = fopen(path, "rb");
+	if (!f || fread(h, 1, HEADER_LEN, f) != HEADER_LEN || h[0] != MAGIC || h[1] != FORMAT){
+		fprintf(stderr, "%s: not an image\n", path);
+		exit(2);
+	}
+	im->version = (h[2] << 8) | h[3];
+	im->len = (h[4] << 8) | h[5];
+	im->crc = (h[6] << 8) | h[7];
+	if (im->len > RECORDS_MAX || fread(im->rec, 1, im->len, f) != (size_t)im->len
+		|| crc16(0xFFFF, im->rec, im->len) != im->crc){
+		fprintf(stderr, "%s: image CRC\n", path);
+		exit(2);
+	}
+	fclose(f);
+}
+
+/* ---- transfer ---- */
+
+static void frameSend(struct port *p){
+	if (write(p->fd, p->frame, p->frameLen) != p->frameLen && errno != EAGAIN){
+		p->state = ST_FAILED;
+		p->why = strerror(errno);
+		return;
+	}
+	p->frames++;
+	p->bytes += p->frameLen;
+	p->deadline = nowUs() + timeoutMs * 1000ULL;
+}
+
+static void frameBuild(struct port *p, int type, const uint8_t *payload, int len){
+	unsigned int crc;
+	p->frame[0] = FRAME_SYNC;
+	p->frame[1] = (uint8_t)type;
+	p->frame[2] = (uint8_t)len;
+	memcpy(p->frame + 3, payload, len);
+	crc = crc16(0xFFFF, p->frame + 1, len + 2);
+	p->frame[3 + len] = crc >> 8;
+	p->frame[4 + len] = crc & 0xFF;
+	p->frameLen = len + 5;
+	p->tries = 0;
+	frameSend(p);
+}
+
+static void sendQuery(struct port *p, int state){
+	p->state = state;
+	frameBuild(p, FR_QUERY, 0, 0);
+}
+
+static void sendReport(struct port *p, int report){
+	uint8_t b = (uint8_t)(reportList[report] | (reportClear ? REPORT_CLEAR : 0));
+	p->state = ST_REPORT;
+	p->report = report;
+	frameBuild(p, FR_REPORT, &b, 1);
+}
+
+/* Names of -r, 0 if one is unknown */
+static int parseReports(char *s){
+	char *q;
+	int i;
+	for (q = strtok(s, ","); q; q = strtok(0, ",")){
+		for (i = 0; i < REPORTS && strcmp(q, reportName[i]); i++);
+		if (i == REPORTS || nReports == REPORTS) return 0;
+		reportList[nReports++] = i;
+	}
+	return nReports > 0;
+}
+
+static void sendBegin(struct port *p){
+	uint8_t b[8] = {img.version >> 8, img.version & 0xFF, img.len >> 8, img.len & 0xFF,
+		img.crc >> 8, img.crc & 0xFF, prev.version >> 8, prev.version & 0xFF};
+	p->state = ST_BEGIN;
+	frameBuild(p, FR_BEGIN, b, p->full ? 6 : 8);
+}
+
+/* Data frame of the first window from offset that the reader lacks, else commit */
+static void sendData(struct port *p, int offset){
+	uint8_t b[2 + CHUNK];
+	int n;
+	for (; offset < img.len; offset += CHUNK){
+		n = img.len - offset < CHUNK ? img.len - offset : CHUNK;
+		if (p->full || offset + n > prev.len || memcmp(img.rec + offset, prev.rec + offset, n)) break;
+	}
+	if (offset >= img.len){
+		p->state = ST_COMMIT;
+		frameBuild(p, FR_COMMIT, 0, 0);
+		return;
+	}
+	b[0] = offset >> 8;
+	b[1] = offset & 0xFF;
+	memcpy(b + 2, img.rec + offset, n);
+	p->state = ST_DATA;
+	p->offset = offset;
+	frameBuild(p, FR_DATA, b, 2 + n);
+}
+
+static void fail(struct port *p, const char *why){
+	p->state = ST_FAILED;
+	p->why = why;
+	p->end = nowUs();
+}
+
+/* Start over from begin */
+static void restart(struct port *p){
+	if (++p->restarts >= maxTries){ fail(p, "transfer keeps failing"); return; }
+	sendBegin(p);
+}
+
+static void answer(struct port *p, int code, unsigned int value){
+	if (code == K_FRAME){									//frame damaged on the link
+		p->resends++;
+		if (++p->tries >= maxTries) fail(p, "link errors");
+		else frameSend(p);
+		return;
+	}
+	switch (p->state){
+	case ST_QUERY:
+		p->active = value;
+		if (value == img.version){ p->state = ST_DONE; p->end = nowUs(); p->why = "up to date"; }
+		else if (newer(value, img.version)) fail(p, "reader has a newer image");
+		else {
+			p->full = !havePrev || value != prev.version;
+			sendBegin(p);
+		}
+		break;
+	case ST_BEGIN:
+		if (code == K_OK) sendData(p, 0);
+		else if (code == K_BASE && !p->full){ p->full = 1; sendBegin(p); }
+		else if (code == K_VERSION){ p->active = value; fail(p, "reader has a newer image"); }
+		else fail(p, "begin refused");
+		break;
+	case ST_DATA:
+		if (code == K_OK && (int)value > p->offset) sendData(p, (int)value);
+		else restart(p);
+		break;
+	case ST_COMMIT:
+		if (code == K_OK && value == img.version){ p->state = ST_DONE; p->end = nowUs(); }
+		else if (code == K_STATE) sendQuery(p, ST_CHECK);	//answer of a first commit lost
+		else if (code == K_FLASH) fail(p, "flash does not program");
+		else restart(p);
+		break;
+	case ST_CHECK:
+		if (value == img.version){ p->state = ST_DONE; p->end = nowUs(); }
+		else restart(p);
+		break;
+	case ST_REPORT:
+		if (code == K_RANGE) printf("%s: %s not in this build\n", p->path, reportName[reportList[p->report]]);
+		else if (code != K_OK){ fail(p, "report refused"); break; }
+		if (p->report + 1 < nReports) sendReport(p, p->report + 1);
+		else { p->state = ST_DONE; p->end = nowUs(); p->why = "reports sent"; }
+		break;
+	}
+}
+
+/* Text lines of the reader, K<code><value> answers taken */
+static void portRead(struct port *p){
+	char buf[512];
+	ssize_t n;
+	long code, value;
+	int i;
+	n = read(p->fd, buf, sizeof buf);
+	if (n <= 0){
+		if (n < 0 && errno == EAGAIN) return;
+		fail(p, n ? strerror(errno) : "closed");
+		return;
+	}
+	for (i = 0; i < n; i++){
+		if (buf[i] != '\r' && buf[i] != '\n'){
+			if (p->len < LINE_LEN - 1) p->line[p->len++] = buf[i];
+			continue;
+		}
+		p->line[p->len] = 0;
+		if (p->len == 7 && p->line[0] == 'K'){
+			code = hexField(p->line + 1, 2);
+			value = hexField(p->line + 3, 4);
+			if (code >= 0 && value >= 0 && p->state < ST_DONE) answer(p, (int)code, (unsigned int)value);
+		}
+		else if (p->len && p->state == ST_REPORT) printf("%s: %s\n", p->path, p->line);
+		p->len = 0;
+	}
+}
+
+static int portOpen(struct port *p){
+	struct termios tio;
+	p->fd = open(p->path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if (p->fd < 0) return 0;
+	if (tcgetattr(p->fd, &tio) == 0){
+		cfmakeraw(&tio);
+		cfsetispeed(&tio, baud);
+		cfsetospeed(&tio, baud);
+		tio.c_cflag |= CLOCAL | CREAD;
+		tcsetattr(p->fd, TCSANOW, &tio);
+	}
+	return 1;
+}
+
+static void report(struct port *p){
+	printf("%s: ", p->path);
+	if (p->state == ST_DONE && nReports) printf("%s\n", p->why);
+	else if (p->state == ST_DONE && p->why) printf("version %u, %s\n", p->active, p->why);
+	else if (p->state == ST_DONE) printf("version %u -> %u, %s, %lu frames, %lu bytes, %lu resends, %.2f s\n",
+		p->active, img.version, p->full ? "full" : "delta", p->frames, p->bytes, p->resends, (p->end - p->start) / 1e6);
+	else printf("FAILED, %s (version %u)\n", p->why, p->active);
+}
+
+static void usage(const char *name){
+	int i;
+	fprintf(stderr, "use: %s [-o image] [-d previous image] [-B baud] [-t ms] [-n tries] config.txt [tty...]\n", name);
+	fprintf(stderr, "     %s -r report[,report...] [-c] [-B baud] [-t ms] [-n tries] tty...\nreports:", name);
+	for (i = 0; i < REPORTS; i++) fprintf(stderr, " %s", reportName[i]);
+	fprintf(stderr, "\n");
+	exit(2);
+}
+
+int main(int argc, char **argv){
+	const char *outPath = 0, *prevPath = 0;
+	struct pollfd fds[MAX_PORTS];
+	uint64_t now, start;
+	int opt, i, busy, failed = 0;
+	while ((opt = getopt(argc, argv, "o:d:B:t:n:r:c")) != -1){
+		switch (opt){
+		case 'r': if (!parseReports(optarg)) usage(argv[0]); break;
+		case 'c': reportClear = 1; break;
+		case 'o': outPath = optarg; break;
+		case 'd': prevPath = optarg; break;
+		case 'B':
+			switch (atoi(optarg)){
+			case 2400: baud = B2400; break;
+			case 9600: baud = B9600; break;
+			case 19200: baud = B19200; break;
+			case 57600: baud = B57600; break;
+			case 115200: baud = B115200; break;
+			default: usage(argv[0]);
+			}
+			break;
+		case 't': timeoutMs = atoi(optarg); break;
+		case 'n': maxTries = atoi(optarg); break;
+		default: usage(argv[0]);
+		}
+	}
+	if (optind == argc || argc - optind - !nReports > MAX_PORTS || timeoutMs < 1 || maxTries < 1) usage(argv[0]);
+	if (nReports && (outPath || prevPath)) usage(argv[0]);
+	if (!nReports){
+		buildImage(argv[optind++]);
+		printf("image version %u, %d bytes of records, crc %04X\n", img.version, img.len, img.crc);
+		if (outPath) writeImage(outPath);
+		if (prevPath){
+			readImage(prevPath, &prev);
+			havePrev = 1;
+		}
+	}
+	start = nowUs();
+	for (i = optind; i < argc; i++, nPorts++){
+		ports[nPorts].path = argv[i];
+		ports[nPorts].start = start;
+		if (!portOpen(&ports[nPorts])){ fail(&ports[nPorts], strerror(errno)); continue; }
+		if (nReports) sendReport(&ports[nPorts], 0);
+		else sendQuery(&ports[nPorts], ST_QUERY);
+	}
+	for (;;){
+		for (i = 0, busy = 0; i < nPorts; i++){
+			fds[i].fd = ports[i].state < ST_DONE ? ports[i].fd : -1;
+			fds[i].events = POLLIN;
+			busy += ports[i].state < ST_DONE;
+		}
+		if (!busy) break;
+		if (poll(fds, nPorts, 20) < 0 && errno != EINTR){ perror("poll"); return 1; }
+		now = nowUs();
+		for (i = 0; i < nPorts; i++){
+			struct port *p = &ports[i];
+			if (p->state >= ST_DONE) continue;
+			if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) portRead(p);
+			if (p->state < ST_DONE && now >= p->deadline){			//no answer: send the frame again
+				p->resends++;
+				if (++p->tries >= maxTries) fail(p, "no answer");
+				else frameSend(p);
+			}
+		}
+	}
+	for (i = 0; i < nPorts; i++){
+		report(&ports[i]);
+		failed += ports[i].state == ST_FAILED;
+		if (ports[i].fd >= 0) close(ports[i].fd);
+	}
+	if (nPorts) printf("%d readers, %d failed, %.2f s\n", nPorts, failed, (nowUs() - start) / 1e6);
+	return failed != 0;
+}
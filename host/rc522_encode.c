@@ -0,0 +1,391 @@
+/*
+ * Name: rc522_encode.c
+ * Host side feeder of the encoding line mode of the reader firmware (encodeLine,
+ * SW2+SW3): sends the image of the next card, the reader writes it to the next
+ * card presented, reads it back and answers with the card UID, and the image of
+ * the following card goes out at once, while the operator swaps cards. A card
+ * that fails keeps its image for the next card. Prints every card, the rate of
+ * the line and the failures by reason; -l keeps the image number and UID of
+ * every card encoded.
+ *
+ * Build: cc -O2 -o rc522_encode rc522_encode.c
+ * Use:   rc522_encode [-B baud] [-t ms] [-n tries] [-r s] [-f first] [-l log] images.txt tty
+ *        baud 2400 (OpenUSART spbrg 25 at Fosc 4 MHz), answer timeout t 1000 ms,
+ *        n 8 tries per frame, rate line of the reader every r 60 s (0 never),
+ *        first image f 1: the number printed on exit resumes the queue
+ *
+ * Images file, one card per line, # starts a comment:
+ *	<block> <32 hex>|"<16 chars>" [<block> <32 hex>|"<16 chars>"]...
+ * not block 0 nor a sector trailer, at most LINE_BLOCKS of the firmware (3) per
+ * card; sectors are authenticated with the keys of the configuration image.
+ * The image number is the card line of the file, from 1.
+ *
+ * Frames to the reader: A5 <type> <len> <payload> <crc16>, as rc522_config:
+ *	20 image:  image number, block index, blocks, block, 16 bytes
+ *	21 stats
+ * Lines of the reader:
+ *	K<code><value>			answer of a frame, value the blocks received
+ *	C<image><result><MI error><UID>	a card; result 00 ok, 01 auth, 02 write,
+ *							03 read back, 04 verify, 05 same card again
+ *	R<seconds><cards><cards per minute><failed cards per result 01..05>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LINE_LEN		512
+#define MAX_BLOCKS		16				//per card; the reader refuses more than LINE_BLOCKS
+#define FRAME_SYNC		0xA5
+#define FRAME_MAX		(5 + 16)
+#define MAX_UID_LEN		10
+
+enum { FR_IMAGE = 0x20, FR_STATS };
+enum { K_OK, K_FRAME, K_STATE, K_RANGE };
+enum { RES_OK, RES_AUTH, RES_WRITE, RES_READ, RES_VERIFY, RES_SAME, RES_COUNT };
+enum { ST_IMAGE, ST_CARD, ST_STATS, ST_DONE, ST_FAILED };
+
+struct card {
+	int blocks;
+	uint8_t block[MAX_BLOCKS][17];		//block, 16 bytes
+};
+
+static const char *resultName[RES_COUNT] = {"ok", "auth", "write", "read back", "verify", "same card"};
+static const char *errorName[8] = {"ok", "no tag", "error", "CRC", "collision", "auth", "timeout", "no access"};
+
+static struct card *cards;
+static int nCards;
+static speed_t baud = B2400;
+static int timeoutMs = 1000, maxTries = 8, reportS = 60;
+static volatile sig_atomic_t stop;
+
+//link
+static int fd, state, tries;
+static int cur, blockIndex;				//card of the queue, block being sent
+static uint8_t frame[FRAME_MAX + 5];
+static int frameLen;
+static char line[LINE_LEN];
+static int lineLen;
+static uint64_t start, deadline, lastCard, nextReport;
+static unsigned long frames, resends, done, failed[RES_COUNT];
+static const char *why;
+static FILE *logFile;
+
+static uint64_t nowUs(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int hexNibble(char c){
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	return -1;
+}
+
+/* Parse len hex digits, -1 if a digit is not hex */
+static long hexField(const char *p, int len){
+	long v = 0;
+	int i, n;
+	for (i = 0; i < len; i++){
+		n = hexNibble(p[i]);
+		if (n < 0) return -1;
+		v = (v << 4) | n;
+	}
+	return v;
+}
+
+static unsigned int crc16(unsigned int crc, const uint8_t *p, int len){
+	int b;
+	while (len--){
+		crc ^= (unsigned int)*p++ << 8;
+		for (b = 0; b < 8; b++)
+			crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) & 0xFFFF : (crc << 1) & 0xFFFF;
+	}
+	return crc;
+}
+
+/* ---- images ---- */
+
+/* One card line, 0 if malformed; a blank or comment line leaves c->blocks 0 */
+static int parseCard(const char *s, struct card *c){
+	char *end;
+	long v;
+	int i, n;
+	uint8_t *b;
+	c->blocks = 0;
+	for (;;){
+		while (*s == ' ' || *s == '\t') s++;
+		if (!*s || *s == '#') return 1;
+		if (c->blocks == MAX_BLOCKS) return 0;
+		v = strtol(s, &end, 0);
+		if (end == s || v <= 0 || v > 63 || (v & 3) == 3) return 0;
+		b = c->block[c->blocks++];
+		b[0] = (uint8_t)v;
+		for (s = end; *s == ' ' || *s == '\t'; s++);
+		if (*s == '"'){										//text, spaces kept
+			s++;
+			n = strcspn(s, "\"");
+			if (!s[n] || n > 16) return 0;
+			memset(b + 1, ' ', 16);
+			memcpy(b + 1, s, n);
+			s += n + 1;
+			continue;
+		}
+		for (i = 0; i < 16; i++){
+			v = hexField(s + 2 * i, 2);
+			if (v < 0) return 0;
+			b[1 + i] = (uint8_t)v;
+		}
+		s += 32;
+		if (*s && *s != ' ' && *s != '\t') return 0;
+	}
+}
+
+static void readCards(const char *path){
+	char text[LINE_LEN];
+	FILE *f = fopen(path, "r");
+	int n = 0, cap = 0;
+	if (!f){ perror(path); exit(2); }
+	while (fgets(text, sizeof text, f)){
+		n++;
+		text[strcspn(text, "\r\n")] = 0;
+		if (nCards == cap){
+			cap = cap ? 2 * cap : 1024;
+			cards = realloc(cards, cap * sizeof *cards);
+			if (!cards){ perror("realloc"); exit(2); }
+		}
+		if (!parseCard(text, &cards[nCards])){ fprintf(stderr, "%s:%d: bad card line\n", path, n); exit(2); }
+		if (cards[nCards].blocks) nCards++;
+	}
+	fclose(f);
+	if (nCards > 0xFFFF){ fprintf(stderr, "%s: more than 65535 cards\n", path); exit(2); }
+}
+
+/* ---- link ---- */
+
+static void fail(const char *reason){
+	state = ST_FAILED;
+	why = reason;
+}
+
+static void frameSend(void){
+	if (write(fd, frame, frameLen) != frameLen && errno != EAGAIN){
+		fail(strerror(errno));
+		return;
+	}
+	frames++;
+	deadline = nowUs() + timeoutMs * 1000ULL;
+}
+
+static void frameBuild(int type, const uint8_t *payload, int n){
+	unsigned int crc;
+	frame[0] = FRAME_SYNC;
+	frame[1] = (uint8_t)type;
+	frame[2] = (uint8_t)n;
+	memcpy(frame + 3, payload, n);
+	crc = crc16(0xFFFF, frame + 1, n + 2);
+	frame[3 + n] = crc >> 8;
+	frame[4 + n] = crc & 0xFF;
+	frameLen = n + 5;
+	tries = 0;
+	frameSend();
+}
+
+/* Frame of block blockIndex of the current card */
+static void sendBlock(void){
+	uint8_t b[FRAME_MAX];
+	b[0] = (cur + 1) >> 8;
+	b[1] = (cur + 1) & 0xFF;
+	b[2] = (uint8_t)blockIndex;
+	b[3] = (uint8_t)cards[cur].blocks;
+	memcpy(b + 4, cards[cur].block[blockIndex], 17);
+	state = ST_IMAGE;
+	frameBuild(FR_IMAGE, b, 4 + 17);
+}
+
+/* Image of the next card of the queue, else the last rate line */
+static void nextCard(void){
+	if (cur == nCards || stop){
+		state = ST_STATS;
+		frameBuild(FR_STATS, 0, 0);
+		return;
+	}
+	blockIndex = 0;
+	sendBlock();
+}
+
+static void answer(int code, unsigned int value){
+	if (code == K_FRAME){									//frame damaged on the link
+		resends++;
+		if (++tries >= maxTries) fail("link errors");
+		else frameSend();
+		return;
+	}
+	if (state != ST_IMAGE) return;							//stats answer, the R line came first
+	if (code != K_OK){ fail("image refused: more blocks than LINE_BLOCKS, or a bad block"); return; }
+	if ((int)value > blockIndex) blockIndex = (int)value;
+	if (blockIndex < cards[cur].blocks) sendBlock();
+	else state = ST_CARD;
+}
+
+static void cardLine(const char *s, int n){
+	long image = hexField(s + 1, 4), result = hexField(s + 5, 2), error = hexField(s + 7, 2);
+	uint64_t now = nowUs();
+	if (image < 0 || result < 0 || result >= RES_COUNT || error < 0 || (n - 9) % 2 || n - 9 < 8 || n - 9 > 2 * MAX_UID_LEN) return;
+	if (image != cur + 1 || state != ST_CARD) return;		//answer of an image given up
+	if (result == RES_OK){
+		printf("image %5ld  uid %s  ok  %.1f s\n", image, s + 9, (now - lastCard) / 1e6);
+		if (logFile){ fprintf(logFile, "%ld %s\n", image, s + 9); fflush(logFile); }
+		lastCard = now;
+		done++;
+		cur++;
+		nextCard();
+		return;
+	}
+	failed[result]++;
+	printf("image %5ld  uid %s  FAILED %s (%s), image kept for the next card\n", image, s + 9,
+		resultName[result], error < 8 ? errorName[error] : "?");
+}
+
+static void rateLine(const char *s){
+	long v[8];
+	int i;
+	for (i = 0; i < 8; i++) if ((v[i] = hexField(s + 1 + 4 * i, 4)) < 0) return;
+	printf("reader: %ld cards in %ld s, %ld cards/min; failed", v[1], v[0], v[2]);
+	for (i = RES_AUTH; i < RES_COUNT; i++) printf("%s %s %ld", i == RES_AUTH ? "" : ",", resultName[i], v[2 + i]);
+	printf("\n");
+	if (state == ST_STATS) state = ST_DONE;
+}
+
+/* Text lines of the reader: K answers, C cards, R rate */
+static void portRead(void){
+	char buf[512];
+	ssize_t n;
+	long code, value;
+	int i;
+	n = read(fd, buf, sizeof buf);
+	if (n <= 0){
+		if (n < 0 && (errno == EAGAIN || errno == EINTR)) return;
+		fail(n ? strerror(errno) : "closed");
+		return;
+	}
+	for (i = 0; i < n; i++){
+		if (buf[i] != '\r' && buf[i] != '\n'){
+			if (lineLen < LINE_LEN - 1) line[lineLen++] = buf[i];
+			continue;
+		}
+		line[lineLen] = 0;
+		if (lineLen == 7 && line[0] == 'K'){
+			code = hexField(line + 1, 2);
+			value = hexField(line + 3, 4);
+			if (code >= 0 && value >= 0) answer((int)code, (unsigned int)value);
+		}
+		else if (lineLen > 9 && line[0] == 'C') cardLine(line, lineLen);
+		else if (lineLen == 33 && line[0] == 'R') rateLine(line);
+		lineLen = 0;
+		if (state >= ST_DONE) return;
+	}
+}
+
+static int portOpen(const char *path){
+	struct termios tio;
+	fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if (fd < 0) return 0;
+	if (tcgetattr(fd, &tio) == 0){
+		cfmakeraw(&tio);
+		cfsetispeed(&tio, baud);
+		cfsetospeed(&tio, baud);
+		tio.c_cflag |= CLOCAL | CREAD;
+		tcsetattr(fd, TCSANOW, &tio);
+	}
+	return 1;
+}
+
+static void onSignal(int sig){
+	(void)sig;
+	stop = 1;
+}
+
+static void usage(const char *name){
+	fprintf(stderr, "use: %s [-B baud] [-t ms] [-n tries] [-r s] [-f first] [-l log] images.txt tty\n", name);
+	exit(2);
+}
+
+int main(int argc, char **argv){
+	const char *logPath = 0;
+	struct pollfd pfd;
+	uint64_t now;
+	double s;
+	int opt, i, first = 1;
+	unsigned long bad = 0;
+	while ((opt = getopt(argc, argv, "B:t:n:r:f:l:")) != -1){
+		switch (opt){
+		case 'B':
+			switch (atoi(optarg)){
+			case 2400: baud = B2400; break;
+			case 9600: baud = B9600; break;
+			case 19200: baud = B19200; break;
+			case 57600: baud = B57600; break;
+			case 115200: baud = B115200; break;
+			default: usage(argv[0]);
+			}
+			break;
+		case 't': timeoutMs = atoi(optarg); break;
+		case 'n': maxTries = atoi(optarg); break;
+		case 'r': reportS = atoi(optarg); break;
+		case 'f': first = atoi(optarg); break;
+		case 'l': logPath = optarg; break;
+		default: usage(argv[0]);
+		}
+	}
+	if (argc - optind != 2 || timeoutMs < 1 || maxTries < 1 || reportS < 0 || first < 1) usage(argv[0]);
+	readCards(argv[optind]);
+	if (first > nCards){ fprintf(stderr, "%s: %d cards, nothing from %d\n", argv[optind], nCards, first); return 2; }
+	if (logPath && !(logFile = fopen(logPath, "a"))){ perror(logPath); return 2; }
+	if (!portOpen(argv[optind + 1])){ perror(argv[optind + 1]); return 2; }
+	signal(SIGINT, onSignal);
+	signal(SIGTERM, onSignal);
+	printf("%d cards, from image %d\n", nCards, first);
+	cur = first - 1;
+	start = lastCard = nowUs();
+	nextReport = start + reportS * 1000000ULL;
+	nextCard();
+	while (state < ST_DONE){
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, 20) < 0 && errno != EINTR){ perror("poll"); return 1; }
+		if (pfd.revents & (POLLIN | POLLHUP | POLLERR)) portRead();
+		now = nowUs();
+		if (stop && state == ST_CARD) nextCard();			//operator stop: last rate line
+		if (state == ST_CARD && reportS && now >= nextReport){	//rate line, its answer is not waited for
+			frameBuild(FR_STATS, 0, 0);
+			nextReport = now + reportS * 1000000ULL;
+		}
+		if ((state == ST_IMAGE || state == ST_STATS) && now >= deadline){	//no answer: send the frame again
+			resends++;
+			if (++tries >= maxTries) fail("no answer");
+			else frameSend();
+		}
+	}
+	s = (nowUs() - start) / 1e6;
+	for (i = RES_AUTH; i < RES_COUNT; i++) bad += failed[i];
+	printf("%lu cards in %.1f s, %.1f cards/min, %lu failed", done, s, s > 0 ? done * 60 / s : 0, bad);
+	for (i = RES_AUTH; i < RES_COUNT; i++) if (failed[i]) printf(", %s %lu", resultName[i], failed[i]);
+	printf("; %lu frames, %lu resends\n", frames, resends);
+	if (state == ST_FAILED) printf("FAILED, %s\n", why);
+	if (cur < nCards) printf("next image %d: -f %d resumes the queue\n", cur + 1, cur + 1);
+	close(fd);
+	if (logFile) fclose(logFile);
+	return state == ST_FAILED || cur < nCards;
+}
@@ -0,0 +1,227 @@
+/*
+ * Name: rc522_expand.c
+ * Host side expander for the compact dump of readDataCompact() (SW4).
+ * Reads the serial capture on stdin and writes one 1 KB image per card,
+ * named <UID>.bin, restoring runs, elided default trailers and RLE blocks.
+ * The <UID>.bin already in the directory is the mirror of the card: sectors
+ * sent as unchanged (C records) are taken from it.
+ *
+ * Build: cc -O2 -o rc522_expand rc522_expand.c
+ * Use:   rc522_expand [output dir] < capture.txt
+ *
+ * Records, one per line (\r or \n), hex fields; other lines are ignored:
+ *	I<flags><uid>		card start, flags bit0 = default trailers elided
+ *	B<block><rle data>	block contents, *<n-1><byte> = n times byte
+ *	R<block><count>		count data blocks from block repeat the last data block
+ *	C<sector><crc16>	sector unchanged, CRC-16 of its 64 bytes
+ *	N<block>			block not readable with the reader's keys, zeros in the image
+ *	X<block>			no data from block on
+ *	E<crc16>			card end, CRC-16 of the 16 sector CRCs, high byte first
+ * CRC-16/CCITT: polynomial 0x1021, init 0xFFFF.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#define BLOCKS			64
+#define SECTORS			16
+#define BLOCK_LEN		16
+#define LINE_LEN		256
+#define ELIDE_TRAILERS	0x01
+
+static const unsigned char defaultTrailer[BLOCK_LEN] = {
+	0x00,0x00,0x00,0x00,0x00,0x00,0xFF,0x07,0x80,0x69,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};
+
+static unsigned char image[BLOCKS][BLOCK_LEN];
+static unsigned char mirror[BLOCKS][BLOCK_LEN];
+static int haveMirror, notMirrored, noAccess;
+static unsigned char seen[BLOCKS];
+static unsigned char last[BLOCK_LEN];
+static char uidHex[2*10+1];
+static int flags, stop, inCard;
+
+static int hexNibble(char c){
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	return -1;
+}
+
+/* Parse len hex digits, -1 if a digit is not hex */
+static long hexField(const char *p, int len){
+	long v = 0;
+	int i, n;
+	for (i = 0; i < len; i++){
+		n = hexNibble(p[i]);
+		if (n < 0) return -1;
+		v = (v << 4) | n;
+	}
+	return v;
+}
+
+/* Read one line ended by \r or \n, 0 at end of input */
+static int readLine(char *line, int max){
+	int c, len = 0;
+	while ((c = getchar()) != EOF){
+		if (c == '\r' || c == '\n'){
+			if (len) break;
+			continue;
+		}
+		if (len < max - 1) line[len++] = (char)c;
+	}
+	line[len] = 0;
+	return len > 0 || c != EOF;
+}
+
+static int isHex(const char *p, int len){
+	while (len--) if (hexNibble(*p++) < 0) return 0;
+	return 1;
+}
+
+static int isTrailer(int block){ return (block & 3) == 3; }
+
+static unsigned int crc16(unsigned int crc, const unsigned char *p, int len){
+	int b;
+	while (len--){
+		crc ^= (unsigned int)*p++ << 8;
+		for (b = 0; b < 8; b++)
+			crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) & 0xFFFF : (crc << 1) & 0xFFFF;
+	}
+	return crc;
+}
+
+static unsigned int sectorCrc(unsigned char img[BLOCKS][BLOCK_LEN], int sector){
+	return crc16(0xFFFF, img[4 * sector], 4 * BLOCK_LEN);
+}
+
+/* Card CRC: CRC of the sector CRCs, as the reader computes it */
+static unsigned int imageCrc(void){
+	unsigned int crc = 0xFFFF, s;
+	unsigned char digest[2];
+	int sec;
+	for (sec = 0; sec < SECTORS; sec++){
+		s = sectorCrc(image, sec);
+		digest[0] = s >> 8;
+		digest[1] = s & 0xFF;
+		crc = crc16(crc, digest, 2);
+	}
+	return crc;
+}
+
+static void loadMirror(const char *dir){
+	char path[512];
+	FILE *f;
+	snprintf(path, sizeof path, "%s/%s.bin", dir, uidHex);
+	f = fopen(path, "rb");
+	haveMirror = f && fread(mirror, 1, sizeof mirror, f) == sizeof mirror;
+	if (f) fclose(f);
+}
+
+/* Decode the RLE payload of a B record, 0 if malformed */
+static int decodeBlock(const char *p, unsigned char *out){
+	int n = 0, run;
+	long v;
+	while (*p && n < BLOCK_LEN){
+		run = 1;
+		if (*p == '*'){
+			run = hexNibble(p[1]) + 1;
+			if (run < 1) return 0;
+			p += 2;
+		}
+		v = hexField(p, 2);
+		if (v < 0 || n + run > BLOCK_LEN) return 0;
+		while (run--) out[n++] = (unsigned char)v;
+		p += 2;
+	}
+	return n == BLOCK_LEN && *p == 0;
+}
+
+static void endCard(const char *dir, long crc){
+	char path[512];
+	FILE *f;
+	int blk, missing = 0;
+	for (blk = 0; blk < BLOCKS; blk++){
+		if (blk >= stop){ memset(image[blk], 0, BLOCK_LEN); missing++; continue; }
+		if (!seen[blk] && isTrailer(blk) && (flags & ELIDE_TRAILERS))
+			memcpy(image[blk], defaultTrailer, BLOCK_LEN);
+	}
+	snprintf(path, sizeof path, "%s/%s.bin", dir, uidHex);
+	f = fopen(path, "wb");
+	if (!f){ perror(path); return; }
+	fwrite(image, 1, sizeof image, f);
+	fclose(f);
+	printf("%s: %s, %d blocks not read", path, crc == (long)imageCrc() ? "crc ok" : "CRC MISMATCH", missing);
+	if (noAccess) printf(", %d blocks without access", noAccess);
+	if (notMirrored) printf(", %d unchanged sectors missing from the mirror", notMirrored);
+	printf("\n");
+	inCard = 0;
+}
+
+int main(int argc, char **argv){
+	const char *dir = argc > 1 ? argv[1] : ".";
+	char line[LINE_LEN];
+	int len, blk, cnt;
+	long v, w;
+	while (readLine(line, sizeof line)){
+		len = (int)strlen(line);
+		switch (line[0]){
+		case 'I':
+			v = hexField(line + 1, 2);
+			if (v < 0 || len < 11 || len > 23 || (len - 3) % 2 || !isHex(line + 3, len - 3)) break;
+			flags = (int)v;
+			strcpy(uidHex, line + 3);
+			memset(image, 0, sizeof image);
+			memset(seen, 0, sizeof seen);
+			memset(last, 0, sizeof last);
+			stop = BLOCKS;
+			notMirrored = 0;
+			noAccess = 0;
+			loadMirror(dir);
+			inCard = 1;
+			break;
+		case 'B':
+			v = hexField(line + 1, 2);
+			if (!inCard || v < 0 || v >= BLOCKS || !decodeBlock(line + 3, image[v])) break;
+			seen[v] = 1;
+			if (!isTrailer((int)v)) memcpy(last, image[v], BLOCK_LEN);
+			break;
+		case 'N':
+			v = hexField(line + 1, 2);
+			if (!inCard || v < 0 || v >= BLOCKS || len != 3) break;
+			memset(image[v], 0, BLOCK_LEN);
+			seen[v] = 1;
+			noAccess++;
+			break;
+		case 'R':
+			v = hexField(line + 1, 2);
+			w = hexField(line + 3, 2);
+			if (!inCard || v < 0 || w < 0 || len != 5) break;
+			for (blk = (int)v, cnt = (int)w; cnt && blk < BLOCKS; blk++){
+				if (isTrailer(blk)) continue;
+				memcpy(image[blk], last, BLOCK_LEN);
+				seen[blk] = 1;
+				cnt--;
+			}
+			break;
+		case 'C':
+			v = hexField(line + 1, 2);
+			w = hexField(line + 3, 4);
+			if (!inCard || v < 0 || v >= SECTORS || w < 0 || len != 7) break;
+			if (!haveMirror || sectorCrc(mirror, (int)v) != w){ notMirrored++; break; }
+			memcpy(image[4 * v], mirror[4 * v], 4 * BLOCK_LEN);
+			memset(&seen[4 * v], 1, 4);
+			break;
+		case 'X':
+			v = hexField(line + 1, 2);
+			if (inCard && v >= 0 && len == 3) stop = (int)v;
+			break;
+		case 'E':
+			v = hexField(line + 1, 4);
+			if (inCard && v >= 0 && len == 5) endCard(dir, v);
+			break;
+		default:
+			break;
+		}
+	}
+	return 0;
+}
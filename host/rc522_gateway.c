@@ -0,0 +1,626 @@
+/*
+ * Name: rc522_gateway.c
+ * Host gateway for many readers: reads the serial output of every reader with
+ * epoll and non-blocking I/O, parses it line by line as it arrives and appends
+ * the events, in batches, to a memory-mapped store indexed by card UID.
+ * Reports events per second and the latency from the first byte of an event
+ * on the serial link to its record in the store.
+ *
+ * Build: cc -O2 -o rc522_gateway rc522_gateway.c
+ * Use:   rc522_gateway [-s store] [-b batch] [-t ms] [-r s] [-B baud] tty...
+ *        rc522_gateway [-s store] -q <uid hex>	records of a card, newest first
+ *        store rc522.events, batch 64 events or t 50 ms, report every r 10 s,
+ *        baud 2400 (OpenUSART spbrg 25 at Fosc 4 MHz); ptys work as ttys
+ *
+ * Text lines parsed, ended by \r or \n; other lines are ignored:
+ *	Card detected / <atqa> , <atqa>   The card's number is: / <uid bytes>
+ *									card event (showSerialNumber, SW1)
+ *	Card removed					removal of the last card of the port
+ *	<block>: <16 hex bytes> | no access				HEX dump block (SW2)
+ *	Sector <s>, block <b>: <16 escaped chars> | no access	ASCII dump block (SW3)
+ *		one blank after the colon, then the data, which may start with blanks:
+ *		"Sector 1, block 4:    abcdefghijklm" is block 4 = 3 blanks + 13 letters
+ *	<reader> <uid hex> <block hex>:<32 hex digits>	gate block (SW1+SW2)
+ *	I<flags><uid hex>				compact dump start, card event (SW4)
+ * The HEX and ASCII dumps do not send the UID: their blocks take the UID of the
+ * last card event of the port, if any.
+ * Binary frames, for firmware that sends them; the text output is 7 bit since
+ * TX_PutAscii, so 0xA5 cannot start a text byte:
+ *	A5 <type> <len> <payload> <crc16>	CRC-16/CCITT of type, len and payload,
+ *										high byte first
+ *	type 1 card:    reader, uid len, uid, atqa[2]
+ *	type 2 block:   reader, uid len, uid, block, 16 data bytes
+ *	type 3 removed: reader
+ *
+ * Store: a header with the record count and UID_BUCKETS index heads, then
+ * fixed size records. Records are only appended; each one links to the
+ * previous record of its index bucket, so the records of a UID are found
+ * newest first without a scan.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define MAX_PORTS		256
+#define LINE_LEN		256
+#define READ_LEN		4096
+#define MAX_UID_LEN		10
+#define BLOCK_LEN		16
+#define FRAME_SYNC		0xA5
+#define FRAME_MAX		64
+#define UID_BUCKETS		4096
+#define STORE_GROW		65536				//records added to the file at a time
+#define STORE_MAGIC		"RC522EV1"
+#define LATENCY_MAX		65536				//latencies kept per report
+
+enum { EV_CARD = 1, EV_BLOCK, EV_REMOVED };
+enum { BLOCK_OK = 0, BLOCK_NOACCESS };
+enum { WAIT_NONE, WAIT_ATQA, WAIT_UID };	//showSerialNumber lines still to come
+
+struct header {
+	char magic[8];
+	uint32_t recordSize, buckets;
+	uint64_t count;							//records written
+	uint64_t bucket[UID_BUCKETS];			//last record of each bucket + 1, 0 = none
+};
+
+struct record {
+	uint64_t received;						//us, CLOCK_REALTIME, first byte of the event
+	uint64_t prev;							//previous record of the bucket + 1, 0 = none
+	uint32_t latency;						//us from the first byte to the store
+	uint16_t port;
+	uint8_t type, reader, status, block, uidLen, atqa[2];
+	uint8_t uid[MAX_UID_LEN];
+	uint8_t data[BLOCK_LEN];
+	uint8_t pad[7];
+};
+
+struct port {
+	const char *path;
+	int fd;
+	char line[LINE_LEN];
+	int len;
+	uint64_t lineStart;						//monotonic us of the first byte of the line
+	uint8_t frame[FRAME_MAX + 5];
+	int frameLen;							//bytes of the binary frame, 0 = text
+	uint64_t frameStart;
+	int wait;								//WAIT_xxx
+	uint64_t cardStart;
+	uint8_t atqa[2];
+	uint8_t uid[MAX_UID_LEN];				//last card of the port
+	uint8_t uidLen;
+	unsigned long events, badFrames;
+};
+
+struct pending {
+	struct record r;
+	uint64_t start;							//monotonic us of the first byte
+};
+
+static struct port ports[MAX_PORTS];
+static int nPorts;
+static int storeFd = -1;
+static struct header *store;
+static size_t storeSize;
+static uint64_t capacity;					//records the file holds
+static struct pending *batch;
+static int batchLen, batchMax = 64;
+static int flushMs = 50, reportS = 10;
+static speed_t baud = B2400;
+static volatile sig_atomic_t quit;
+static uint32_t latencies[LATENCY_MAX];
+static int nLatencies;
+static unsigned long intervalEvents, totalEvents;
+static uint64_t intervalStart;
+
+static uint64_t nowUs(clockid_t clock){
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int hexNibble(char c){
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	return -1;
+}
+
+/* Parse 2 hex digits, -1 if a digit is not hex */
+static int hexByte(const char *p){
+	int h = hexNibble(p[0]), l = h < 0 ? -1 : hexNibble(p[1]);
+	return l < 0 ? -1 : (h << 4) | l;
+}
+
+/* Parse a run of n hex bytes without separators, 0 if malformed */
+static int hexBytes(const char *p, uint8_t *out, int n){
+	int i, v;
+	for (i = 0; i < n; i++){
+		v = hexByte(p + 2 * i);
+		if (v < 0) return 0;
+		out[i] = (uint8_t)v;
+	}
+	return 1;
+}
+
+static unsigned int crc16(unsigned int crc, const uint8_t *p, int len){
+	int b;
+	while (len--){
+		crc ^= (unsigned int)*p++ << 8;
+		for (b = 0; b < 8; b++)
+			crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) & 0xFFFF : (crc << 1) & 0xFFFF;
+	}
+	return crc;
+}
+
+static unsigned int uidBucket(const uint8_t *uid, int len){
+	return crc16(0xFFFF, uid, len) % UID_BUCKETS;
+}
+
+/* ---- store ---- */
+
+static void storeMap(uint64_t records){
+	size_t size = sizeof(struct header) + records * sizeof(struct record);
+	void *p;
+	if (ftruncate(storeFd, (off_t)size) < 0){ perror("store: ftruncate"); exit(1); }
+	p = store ? mremap(store, storeSize, size, MREMAP_MAYMOVE)
+	          : mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, storeFd, 0);
+	if (p == MAP_FAILED){ perror("store: mmap"); exit(1); }
+	store = p;
+	storeSize = size;
+	capacity = records;
+}
+
+static struct record *storeRecord(uint64_t i){
+	return (struct record *)(store + 1) + i;
+}
+
+static void storeOpen(const char *path, int readOnly){
+	struct stat st;
+	uint64_t records;
+	storeFd = open(path, readOnly ? O_RDONLY : O_RDWR | O_CREAT, 0644);
+	if (storeFd < 0){ perror(path); exit(1); }
+	if (fstat(storeFd, &st) < 0){ perror(path); exit(1); }
+	if (readOnly){
+		if ((size_t)st.st_size < sizeof(struct header)){ fprintf(stderr, "%s: not a store\n", path); exit(1); }
+		storeSize = st.st_size;
+		store = mmap(0, storeSize, PROT_READ, MAP_SHARED, storeFd, 0);
+		if (store == MAP_FAILED){ perror("store: mmap"); exit(1); }
+	}
+	else if (st.st_size == 0){
+		storeMap(STORE_GROW);
+		memcpy(store->magic, STORE_MAGIC, 8);
+		store->recordSize = sizeof(struct record);
+		store->buckets = UID_BUCKETS;
+		return;
+	}
+	else{
+		records = ((uint64_t)st.st_size - sizeof(struct header)) / sizeof(struct record);
+		storeMap(records);
+	}
+	if (memcmp(store->magic, STORE_MAGIC, 8) || store->recordSize != sizeof(struct record) || store->buckets != UID_BUCKETS){
+		fprintf(stderr, "%s: not a store of this version\n", path);
+		exit(1);
+	}
+}
+
+/* Append the batch: records first, then the count and the index heads */
+static void storeFlush(void){
+	uint64_t stored, now;
+	struct record *r;
+	unsigned int b;
+	int i;
+	if (!batchLen) return;
+	if (store->count + batchLen > capacity) storeMap(capacity + STORE_GROW);
+	now = nowUs(CLOCK_MONOTONIC);
+	for (i = 0; i < batchLen; i++){
+		r = storeRecord(store->count + i);
+		*r = batch[i].r;
+		r->latency = (uint32_t)(now - batch[i].start);
+		if (nLatencies < LATENCY_MAX) latencies[nLatencies++] = r->latency;
+	}
+	__sync_synchronize();
+	for (i = 0; i < batchLen; i++){
+		stored = store->count + i;
+		r = storeRecord(stored);
+		b = uidBucket(r->uid, r->uidLen);
+		r->prev = store->bucket[b];
+		store->bucket[b] = stored + 1;
+	}
+	store->count += batchLen;
+	msync(store, storeSize, MS_ASYNC);
+	intervalEvents += batchLen;
+	totalEvents += batchLen;
+	batchLen = 0;
+}
+
+static void queueEvent(struct port *p, int type, uint64_t start, int reader,
+		const uint8_t *uid, int uidLen, int block, int status, const uint8_t *data){
+	struct pending *e;
+	if (batchLen == batchMax) storeFlush();
+	e = &batch[batchLen++];
+	memset(e, 0, sizeof *e);
+	e->start = start;
+	e->r.received = nowUs(CLOCK_REALTIME) - (nowUs(CLOCK_MONOTONIC) - start);
+	e->r.port = (uint16_t)(p - ports);
+	e->r.type = (uint8_t)type;
+	e->r.reader = (uint8_t)reader;
+	e->r.status = (uint8_t)status;
+	e->r.block = (uint8_t)block;
+	if (uidLen > MAX_UID_LEN) uidLen = MAX_UID_LEN;
+	e->r.uidLen = (uint8_t)uidLen;
+	if (uidLen) memcpy(e->r.uid, uid, uidLen);
+	if (type == EV_CARD) memcpy(e->r.atqa, p->atqa, 2);
+	if (data) memcpy(e->r.data, data, BLOCK_LEN);
+	p->events++;
+}
+
+static void cardEvent(struct port *p, uint64_t start, int reader, const uint8_t *uid, int uidLen){
+	memcpy(p->uid, uid, uidLen);
+	p->uidLen = (uint8_t)uidLen;
+	queueEvent(p, EV_CARD, start, reader, uid, uidLen, 0, 0, 0);
+}
+
+/* ---- text format ---- */
+
+/* "AA BB CC DD": 4, 7 or 10 bytes separated by spaces, 0 if not a UID line */
+static int parseUidLine(const char *s, uint8_t *uid){
+	int n = 0, v;
+	while (*s == ' ') s++;
+	while (*s && n < MAX_UID_LEN){
+		v = hexByte(s);
+		if (v < 0) return 0;
+		uid[n++] = (uint8_t)v;
+		s += 2;
+		while (*s == ' ') s++;
+	}
+	return (*s == 0 && (n == 4 || n == 7 || n == 10)) ? n : 0;
+}
+
+/* 16 bytes as " XX" each, or "no access" */
+static int parseHexData(const char *s, uint8_t *data, int *status){
+	int i, v;
+	if (strcmp(s, " no access") == 0){ *status = BLOCK_NOACCESS; return 1; }
+	for (i = 0; i < BLOCK_LEN; i++){
+		if (*s++ != ' ') return 0;
+		v = hexByte(s);
+		if (v < 0) return 0;
+		data[i] = (uint8_t)v;
+		s += 2;
+	}
+	*status = BLOCK_OK;
+	return *s == 0;
+}
+
+/* 16 characters escaped by TX_PutAscii: \\ and \xHH */
+static int parseAsciiData(const char *s, uint8_t *data, int *status){
+	int i, v;
+	if (strcmp(s, "no access") == 0){ *status = BLOCK_NOACCESS; return 1; }
+	for (i = 0; i < BLOCK_LEN && *s; i++){
+		if (s[0] == '\\' && s[1] == '\\'){ data[i] = '\\'; s += 2; }
+		else if (s[0] == '\\' && s[1] == 'x'){
+			v = hexByte(s + 2);
+			if (v < 0) return 0;
+			data[i] = (uint8_t)v;
+			s += 4;
+		}
+		else data[i] = (uint8_t)*s++;
+	}
+	*status = BLOCK_OK;
+	return i == BLOCK_LEN && *s == 0;
+}
+
+static void parseLine(struct port *p, char *s){
+	uint8_t uid[MAX_UID_LEN], data[BLOCK_LEN];
+	int n, a, b, status, len = (int)strlen(s);
+	const char *q;
+	if (strncmp(s, "Card detected", 13) == 0){
+		p->wait = WAIT_ATQA;
+		p->cardStart = p->lineStart;
+		return;
+	}
+	if (p->wait == WAIT_ATQA && (q = strstr(s, "The card's number is"))){
+		a = hexByte(s);
+		b = len > 5 ? hexByte(s + 5) : -1;
+		p->atqa[0] = a < 0 ? 0 : (uint8_t)a;
+		p->atqa[1] = b < 0 ? 0 : (uint8_t)b;
+		p->wait = WAIT_UID;
+		return;
+	}
+	if (p->wait == WAIT_UID){
+		p->wait = WAIT_NONE;
+		if ((n = parseUidLine(s, uid))){ cardEvent(p, p->cardStart, 0, uid, n); return; }
+	}
+	p->wait = WAIT_NONE;
+	if (strcmp(s, "Card removed") == 0){
+		queueEvent(p, EV_REMOVED, p->lineStart, 0, p->uid, p->uidLen, 0, 0, 0);
+		return;
+	}
+	n = 0;
+	if (sscanf(s, "Sector %d, block %d:%n", &a, &b, &n) == 2 && n && s[n] == ' ' && b >= 0 && b < 256){
+		if (parseAsciiData(s + n + 1, data, &status))	//data may start with blanks
+			queueEvent(p, EV_BLOCK, p->lineStart, 0, p->uid, p->uidLen, b, status, data);
+		return;
+	}
+	n = 0;
+	if (sscanf(s, "%d:%n", &b, &n) == 1 && n && b >= 0 && b < 256 && (s[0] == ' ' || (s[0] >= '0' && s[0] <= '9'))){
+		if (parseHexData(s + n, data, &status))
+			queueEvent(p, EV_BLOCK, p->lineStart, 0, p->uid, p->uidLen, b, status, data);
+		return;
+	}
+	//gate: "<reader> <uid hex> <block hex>:<32 hex digits>"
+	q = strchr(s, ':');
+	if (len > 2 && s[0] >= '0' && s[0] <= '9' && s[1] == ' ' && q && q - s >= 6 && strlen(q + 1) == 2 * BLOCK_LEN){
+		n = (int)(q - s - 5) / 2;				//uid bytes
+		if (n >= 4 && n <= MAX_UID_LEN && s[2 + 2 * n] == ' ' && hexBytes(s + 2, uid, n)
+			&& (b = hexByte(q - 2)) >= 0 && hexBytes(q + 1, data, BLOCK_LEN)){
+			memcpy(p->uid, uid, n);
+			p->uidLen = (uint8_t)n;
+			queueEvent(p, EV_BLOCK, p->lineStart, s[0] - '0', uid, n, b, BLOCK_OK, data);
+		}
+		return;
+	}
+	//compact dump start: I<flags><uid>
+	if (s[0] == 'I' && len >= 11 && len <= 23 && !((len - 3) % 2) && hexByte(s + 1) >= 0
+		&& hexBytes(s + 3, uid, (len - 3) / 2)){
+		cardEvent(p, p->lineStart, 0, uid, (len - 3) / 2);
+	}
+}
+
+/* ---- binary format ---- */
+
+static void parseFrame(struct port *p){
+	uint8_t *f = p->frame, *d = f + 3;
+	int len = f[2], uidLen;
+	unsigned int crc = crc16(0xFFFF, f + 1, len + 2);
+	if (crc != ((unsigned int)f[3 + len] << 8 | f[4 + len])){ p->badFrames++; return; }
+	uidLen = len >= 2 ? d[1] : 0;
+	switch (f[1]){
+	case EV_CARD:
+		if (len != 4 + uidLen || uidLen > MAX_UID_LEN) break;
+		memcpy(p->atqa, d + 2 + uidLen, 2);
+		cardEvent(p, p->frameStart, d[0], d + 2, uidLen);
+		return;
+	case EV_BLOCK:
+		if (len != 3 + uidLen + BLOCK_LEN || uidLen > MAX_UID_LEN) break;
+		queueEvent(p, EV_BLOCK, p->frameStart, d[0], d + 2, uidLen, d[2 + uidLen], BLOCK_OK, d + 3 + uidLen);
+		return;
+	case EV_REMOVED:
+		if (len != 1) break;
+		queueEvent(p, EV_REMOVED, p->frameStart, d[0], p->uid, p->uidLen, 0, 0, 0);
+		return;
+	}
+	p->badFrames++;
+}
+
+/* Feed the bytes of one read: text lines and binary frames interleave */
+static void feed(struct port *p, const uint8_t *buf, int n, uint64_t t){
+	int i;
+	uint8_t c;
+	for (i = 0; i < n; i++){
+		c = buf[i];
+		if (p->frameLen){
+			p->frame[p->frameLen++] = c;
+			if (p->frameLen == 3 && c > FRAME_MAX){ p->badFrames++; p->frameLen = 0; }
+			else if (p->frameLen >= 3 && p->frameLen == 5 + p->frame[2]){ parseFrame(p); p->frameLen = 0; }
+			continue;
+		}
+		if (c == FRAME_SYNC){
+			p->frame[0] = c;
+			p->frameLen = 1;
+			p->frameStart = t;
+			continue;
+		}
+		if (c == '\r' || c == '\n'){
+			if (p->len){
+				p->line[p->len] = 0;
+				parseLine(p, p->line);
+				p->len = 0;
+			}
+			continue;
+		}
+		if (!p->len) p->lineStart = t;
+		if (p->len < LINE_LEN - 1) p->line[p->len++] = (char)c;
+	}
+}
+
+/* ---- serial ports ---- */
+
+static int portOpen(struct port *p, int ep){
+	struct termios tio;
+	struct epoll_event ev;
+	p->fd = open(p->path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if (p->fd < 0) return 0;
+	if (tcgetattr(p->fd, &tio) == 0){
+		cfmakeraw(&tio);
+		cfsetispeed(&tio, baud);
+		cfsetospeed(&tio, baud);
+		tio.c_cflag |= CLOCAL | CREAD;
+		tcsetattr(p->fd, TCSANOW, &tio);
+	}
+	ev.events = EPOLLIN;
+	ev.data.ptr = p;
+	if (epoll_ctl(ep, EPOLL_CTL_ADD, p->fd, &ev) < 0){ close(p->fd); p->fd = -1; return 0; }
+	p->len = 0;
+	p->frameLen = 0;
+	p->wait = WAIT_NONE;
+	return 1;
+}
+
+static void portClose(struct port *p, int ep){
+	epoll_ctl(ep, EPOLL_CTL_DEL, p->fd, 0);
+	close(p->fd);
+	p->fd = -1;
+	fprintf(stderr, "%s: closed, reopening\n", p->path);
+}
+
+/* Read until EAGAIN; edge cases of ptys: EIO once the other side is gone */
+static void portRead(struct port *p, int ep){
+	uint8_t buf[READ_LEN];
+	ssize_t n;
+	for (;;){
+		n = read(p->fd, buf, sizeof buf);
+		if (n > 0){ feed(p, buf, (int)n, nowUs(CLOCK_MONOTONIC)); continue; }
+		if (n < 0 && errno == EINTR) continue;
+		if (n < 0 && errno == EAGAIN) return;
+		portClose(p, ep);
+		return;
+	}
+}
+
+/* ---- report ---- */
+
+static int byValue(const void *a, const void *b){
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+static void report(uint64_t now){
+	double s = (now - intervalStart) / 1e6;
+	int i, open = 0;
+	unsigned long bad = 0;
+	for (i = 0; i < nPorts; i++){
+		open += ports[i].fd >= 0;
+		bad += ports[i].badFrames;
+	}
+	fprintf(stderr, "ports %d/%d, %lu events, %.1f events/s, %lu stored",
+		open, nPorts, intervalEvents, s > 0 ? intervalEvents / s : 0.0, totalEvents);
+	if (nLatencies){
+		qsort(latencies, nLatencies, sizeof latencies[0], byValue);
+		fprintf(stderr, ", latency us p50 %u p99 %u max %u", latencies[nLatencies / 2],
+			latencies[(int)(nLatencies * 0.99)], latencies[nLatencies - 1]);
+	}
+	if (bad) fprintf(stderr, ", %lu bad frames", bad);
+	fprintf(stderr, "\n");
+	intervalEvents = 0;
+	nLatencies = 0;
+	intervalStart = now;
+}
+
+/* ---- query ---- */
+
+static int query(const char *uidHex){
+	uint8_t uid[MAX_UID_LEN];
+	int uidLen = (int)strlen(uidHex) / 2, i, found = 0;
+	uint64_t i1;
+	struct record *r;
+	static const char *typeName[] = {"?", "card", "block", "removed"};
+	if (uidLen > MAX_UID_LEN || strlen(uidHex) % 2 || !hexBytes(uidHex, uid, uidLen)){
+		fprintf(stderr, "uid: hex bytes\n");
+		return 2;
+	}
+	for (i1 = store->bucket[uidBucket(uid, uidLen)]; i1; i1 = r->prev){
+		if (sizeof(struct header) + i1 * sizeof(struct record) > storeSize) break;
+		r = storeRecord(i1 - 1);
+		if (r->uidLen != uidLen || memcmp(r->uid, uid, uidLen)) continue;
+		printf("%llu.%06llu port %u reader %u %s", (unsigned long long)(r->received / 1000000),
+			(unsigned long long)(r->received % 1000000), r->port, r->reader, typeName[r->type <= EV_REMOVED ? r->type : 0]);
+		if (r->type == EV_BLOCK){
+			printf(" %2u:", r->block);
+			if (r->status == BLOCK_NOACCESS) printf(" no access");
+			else for (i = 0; i < BLOCK_LEN; i++) printf(" %02X", r->data[i]);
+		}
+		printf(" (%u us)\n", r->latency);
+		found++;
+	}
+	return found == 0;
+}
+
+static void onSignal(int sig){ (void)sig; quit = 1; }
+
+static void usage(const char *name){
+	fprintf(stderr, "use: %s [-s store] [-b batch] [-t ms] [-r s] [-B baud] tty...\n"
+		"     %s [-s store] -q <uid hex>\n", name, name);
+	exit(2);
+}
+
+int main(int argc, char **argv){
+	const char *storePath = "rc522.events", *queryUid = 0;
+	struct epoll_event events[64];
+	struct sigaction sa;
+	uint64_t now, lastReopen = 0, nextReport, oldest;
+	int ep, opt, i, n, timeout;
+	while ((opt = getopt(argc, argv, "s:b:t:r:B:q:")) != -1){
+		switch (opt){
+		case 's': storePath = optarg; break;
+		case 'b': batchMax = atoi(optarg); break;
+		case 't': flushMs = atoi(optarg); break;
+		case 'r': reportS = atoi(optarg); break;
+		case 'B':
+			switch (atoi(optarg)){
+			case 2400: baud = B2400; break;
+			case 9600: baud = B9600; break;
+			case 19200: baud = B19200; break;
+			case 57600: baud = B57600; break;
+			case 115200: baud = B115200; break;
+			default: usage(argv[0]);
+			}
+			break;
+		case 'q': queryUid = optarg; break;
+		default: usage(argv[0]);
+		}
+	}
+	if (queryUid){
+		storeOpen(storePath, 1);
+		return query(queryUid);
+	}
+	if (optind == argc || argc - optind > MAX_PORTS || batchMax < 1 || flushMs < 1 || reportS < 1) usage(argv[0]);
+	storeOpen(storePath, 0);
+	batch = calloc(batchMax, sizeof *batch);
+	ep = epoll_create1(0);
+	if (!batch || ep < 0){ perror("init"); return 1; }
+	memset(&sa, 0, sizeof sa);
+	sa.sa_handler = onSignal;
+	sigaction(SIGINT, &sa, 0);
+	sigaction(SIGTERM, &sa, 0);
+	for (i = optind; i < argc; i++){
+		ports[nPorts].path = argv[i];
+		if (!portOpen(&ports[nPorts], ep)) fprintf(stderr, "%s: %s, retrying\n", argv[i], strerror(errno));
+		nPorts++;
+	}
+	intervalStart = nowUs(CLOCK_MONOTONIC);
+	nextReport = intervalStart + reportS * 1000000ULL;
+	while (!quit){
+		now = nowUs(CLOCK_MONOTONIC);
+		timeout = (int)((nextReport > now ? nextReport - now : 0) / 1000);
+		if (batchLen){
+			oldest = batch[0].start + flushMs * 1000ULL;
+			n = (int)((oldest > now ? oldest - now : 0) / 1000);
+			if (n < timeout) timeout = n;
+		}
+		n = epoll_wait(ep, events, 64, timeout);
+		if (n < 0 && errno != EINTR){ perror("epoll_wait"); break; }
+		for (i = 0; i < n; i++){
+			struct port *p = events[i].data.ptr;
+			if (p->fd < 0) continue;
+			if (events[i].events & EPOLLIN) portRead(p, ep);
+			else if (events[i].events & (EPOLLHUP | EPOLLERR)) portClose(p, ep);
+		}
+		now = nowUs(CLOCK_MONOTONIC);
+		if (batchLen && (batchLen >= batchMax || now >= batch[0].start + flushMs * 1000ULL)) storeFlush();
+		if (now - lastReopen >= 1000000){
+			for (i = 0; i < nPorts; i++) if (ports[i].fd < 0) portOpen(&ports[i], ep);
+			lastReopen = now;
+		}
+		if (now >= nextReport){
+			report(now);
+			nextReport = now + reportS * 1000000ULL;
+		}
+	}
+	storeFlush();
+	report(nowUs(CLOCK_MONOTONIC));
+	msync(store, storeSize, MS_SYNC);
+	return 0;
+}
@@ -0,0 +1,83 @@
+/*
+ * Name: rc522_mapreport.c
+ * Host side RAM report of a firmware build.
+ * Reads the MPLINK map file (link with /m<file>.map) and prints the data
+ * memory sections by size and the totals per section type, so each build
+ * can be checked against the 1536 bytes of the PIC18F4520.
+ *
+ * Build: cc -O2 -o rc522_mapreport rc522_mapreport.c
+ * Use:   rc522_mapreport build.map [RAM bytes, default 1536]
+ *
+ * Lines of the "Section Info" table used:
+ *	<name> <type> <address> <location> <size>
+ * location "data" is RAM; type udata, idata, access (udata_acs/idata_acs)
+ * and the stack section (.stack) are reported apart.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LINE_LEN		256
+#define MAX_SECTIONS	512
+#define RAM_DEFAULT		1536
+
+struct section {
+	char name[64];
+	char type[16];
+	unsigned long address, size;
+};
+
+static struct section sections[MAX_SECTIONS];
+static int count;
+
+static int bySize(const void *a, const void *b){
+	const struct section *x = a, *y = b;
+	if (x->size != y->size) return x->size < y->size ? 1 : -1;
+	return strcmp(x->name, y->name);
+}
+
+/* One table line, 0 if it is not a data memory section */
+static int parseSection(const char *line, struct section *s){
+	char location[16];
+	if (sscanf(line, "%63s %15s %lx %15s %lx", s->name, s->type, &s->address, location, &s->size) != 5) return 0;
+	return strcmp(location, "data") == 0;
+}
+
+int main(int argc, char **argv){
+	char line[LINE_LEN];
+	FILE *f;
+	int inTable = 0, i;
+	unsigned long ram = argc > 2 ? strtoul(argv[2], 0, 0) : RAM_DEFAULT;
+	unsigned long udata = 0, idata = 0, access = 0, stack = 0, total;
+	if (argc < 2){
+		fprintf(stderr, "use: %s build.map [RAM bytes]\n", argv[0]);
+		return 2;
+	}
+	f = fopen(argv[1], "r");
+	if (!f){ perror(argv[1]); return 1; }
+	while (fgets(line, sizeof line, f)){
+		if (strstr(line, "Section Info")){ inTable = 1; continue; }
+		if (!inTable) continue;
+		if (strstr(line, "Program Memory Usage") || strstr(line, "Symbols")) break;
+		if (count < MAX_SECTIONS && parseSection(line, &sections[count])) count++;
+	}
+	fclose(f);
+	if (!count){
+		fprintf(stderr, "%s: no data sections in the Section Info table\n", argv[1]);
+		return 1;
+	}
+	qsort(sections, count, sizeof sections[0], bySize);
+	printf("%-24s %-10s %8s %6s\n", "section", "type", "address", "bytes");
+	for (i = 0; i < count; i++){
+		printf("%-24s %-10s %#8lx %6lu\n", sections[i].name, sections[i].type, sections[i].address, sections[i].size);
+		if (strcmp(sections[i].name, ".stack") == 0) stack += sections[i].size;
+		else if (strstr(sections[i].type, "acs")) access += sections[i].size;
+		else if (strcmp(sections[i].type, "idata") == 0) idata += sections[i].size;
+		else udata += sections[i].size;
+	}
+	total = udata + idata + access + stack;
+	printf("\nudata %lu, idata %lu, access %lu, stack %lu\n", udata, idata, access, stack);
+	printf("RAM %lu of %lu bytes, %lu free\n", total, ram, total > ram ? 0 : ram - total);
+	return total > ram;
+}
@@ -0,0 +1,258 @@
+/*
+ * Name: rc522_replay.c
+ * Offline replay of an SPI trace (firmware built with SPI_TRACE 1).
+ * Runs a mode of the driver on the host against a stand-in chip that answers
+ * every register read with the value of the trace and checks that the driver
+ * accesses the same registers in the same order. Reports the bus timing of
+ * the trace, per MFRC522 command, and the first access where the driver of
+ * this tree diverges from the one that made the trace.
+ *
+ * Build: cc -O2 -Ihost/pic18 -o rc522_replay host/rc522_replay.c host/pic18/pic18_host.c
+ *        (add -DREADER_COUNT=n as in the firmware build)
+ * Use:   rc522_replay <mode> < capture.txt
+ *        mode: serial, hex, ascii, compact, gate, clear, write (DIP switch modes)
+ *
+ * Records, one per line (\r or \n), hex fields; other lines are ignored:
+ *	T<seq><op><value><time>	seq 8 bit, op bit7 read, bits 5..0 register,
+ *							op 0x40|r reader r selected, time Timer3 us 16 bit
+ * The trace must start at boot. The reader stalls on a full ring, or stops
+ * the capture when a line of its output holds the ring; the trace then just
+ * ends. A sequence gap (ring dropping records) ends the replay there. Gaps in time above 65 ms are counted as one wrap.
+ * Written values that differ (tuning saved in EEPROM, other card) are
+ * counted; a different register or direction stops the replay.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include "p18f4520.h"
+#include "delays.h"
+#include "timers.h"
+#include "capture.h"
+#include "pic18_host.h"
+#include "../MFRC522-RFID-SPI.h"
+
+#define LINE_LEN		128
+#define OP_READ			0x80
+#define OP_READER		0x40
+#define OP_REG			0x3F
+#define CONTEXT			4
+#define VALUE_SHOWN		8
+
+struct record {
+	unsigned char op, val;
+	unsigned long us;			//unwrapped time since the first record
+	int gap;					//records lost before this one
+};
+
+static struct record *trace;
+static long count, cap;
+static long cursor;				//next record the driver must match
+static int phase;				//0 address byte, 1 data byte of an access
+static unsigned char spiOp;
+static int replayReader;
+static long valueDiffs;
+static jmp_buf done;
+static char why[160];
+
+static const char *regName[64] = {
+	"Reserved00", "CommandReg", "CommIEnReg", "DivlEnReg", "CommIrqReg", "DivIrqReg", "ErrorReg", "Status1Reg",
+	"Status2Reg", "FIFODataReg", "FIFOLevelReg", "WaterLevelReg", "ControlReg", "BitFramingReg", "CollReg", "Reserved0F",
+	"Reserved10", "ModeReg", "TxModeReg", "RxModeReg", "TxControlReg", "TxAutoReg", "TxSelReg", "RxSelReg",
+	"RxThresholdReg", "DemodReg", "Reserved1A", "Reserved1B", "MifareReg", "Reserved1D", "Reserved1E", "SerialSpeedReg",
+	"Reserved20", "CRCResultRegM", "CRCResultRegL", "Reserved23", "ModWidthReg", "Reserved25", "RFCfgReg", "GsNReg",
+	"CWGsPReg", "ModGsPReg", "TModeReg", "TPrescalerReg", "TReloadRegH", "TReloadRegL", "TCounterValueRegH", "TCounterValueRegL",
+	"Reserved30", "TestSel1Reg", "TestSel2Reg", "TestPinEnReg", "TestPinValueReg", "TestBusReg", "AutoTestReg", "VersionReg",
+	"AnalogTestReg", "TestDAC1Reg", "TestDAC2Reg", "TestADCReg", "Reserved3C", "Reserved3D", "Reserved3E", "Reserved3F"};
+
+static const struct { const char *name; void (*run)(void); } modes[] = {
+	{"serial", showSerialNumber}, {"hex", readDataHEX}, {"ascii", readDataASCII},
+	{"compact", readDataCompact}, {"gate", readDataGate},
+	{"clear", clearTagsMemory}, {"write", writeTagBlockMemory}};
+
+static int hexNibble(char c){
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	return -1;
+}
+
+/* Parse len hex digits, -1 if a digit is not hex */
+static long hexField(const char *p, int len){
+	long v = 0;
+	int i, n;
+	for (i = 0; i < len; i++){
+		n = hexNibble(p[i]);
+		if (n < 0) return -1;
+		v = (v << 4) | n;
+	}
+	return v;
+}
+
+/* Read one line ended by \r or \n, 0 at end of input */
+static int readLine(char *line, int max){
+	int c, len = 0;
+	while ((c = getchar()) != EOF){
+		if (c == '\r' || c == '\n'){
+			if (len) break;
+			continue;
+		}
+		if (len < max - 1) line[len++] = (char)c;
+	}
+	line[len] = 0;
+	return len > 0 || c != EOF;
+}
+
+static void describe(char *out, size_t size, unsigned char op, unsigned char val){
+	if (op & OP_READER) snprintf(out, size, "reader %u", val);
+	else snprintf(out, size, "%c %s %02X", (op & OP_READ) ? 'R' : 'W', regName[op & OP_REG], val);
+}
+
+static void loadTrace(void){
+	char line[LINE_LEN];
+	long seq, op, val, t, lastSeq = -1, lastT = 0, firstT = 0;
+	unsigned long wraps = 0;
+	while (readLine(line, sizeof line)){
+		if (line[0] != 'T' || strlen(line) != 11) continue;
+		seq = hexField(line + 1, 2);
+		op = hexField(line + 3, 2);
+		val = hexField(line + 5, 2);
+		t = hexField(line + 7, 4);
+		if (seq < 0 || op < 0 || val < 0 || t < 0) continue;
+		if (count == cap){
+			cap = cap ? 2 * cap : 4096;
+			trace = realloc(trace, cap * sizeof *trace);
+			if (!trace){ perror("realloc"); exit(2); }
+		}
+		if (!count){
+			firstT = t;
+			if (seq) fprintf(stderr, "warning: trace starts at sequence %02lX, not at boot\n", seq);
+		}
+		else if (t < lastT) wraps++;
+		trace[count].op = (unsigned char)op;
+		trace[count].val = (unsigned char)val;
+		trace[count].us = wraps * 0x10000UL + t - firstT;
+		trace[count].gap = lastSeq >= 0 ? (int)((seq - lastSeq - 1) & 0xFF) : 0;
+		lastSeq = seq;
+		lastT = t;
+		count++;
+	}
+}
+
+/* Bus timing of the trace: access spacing and MFRC522 commands */
+static void timingReport(long end){
+	static const struct { unsigned char cmd, waitReg; const char *name; } cmds[] = {
+		{0x0C, 0x04, "Transceive"}, {0x0E, 0x04, "MFAuthent"}, {0x03, 0x05, "CalcCRC"}, {0x0F, 0x01, "SoftReset"}};
+	unsigned long total[4] = {0}, longest[4] = {0}, polls[4] = {0}, n[4] = {0};
+	unsigned long gap, maxGap = 0, dt;
+	long i, j, lastPoll;
+	int c, reads = 0;
+	if (end < 2){ printf("trace too short for timing\n"); return; }
+	for (i = 1; i < end; i++){
+		gap = trace[i].us - trace[i-1].us;
+		if (gap > maxGap) maxGap = gap;
+		if (trace[i].op & OP_READ) reads++;
+	}
+	printf("%ld records, %d reads, %lu us, %.1f us per access, longest gap %lu us\n",
+		end, reads, trace[end-1].us, (double)trace[end-1].us / (end - 1), maxGap);
+	for (i = 0; i < end; i++){
+		if (trace[i].op != 0x01) continue;						//write to CommandReg
+		for (c = 0; c < 4 && cmds[c].cmd != (trace[i].val & 0x0F); c++);
+		if (c == 4) continue;
+		lastPoll = -1;
+		for (j = i + 1; j < end && trace[j].op != 0x01 && !(trace[j].op & OP_READER); j++){
+			if (trace[j].op == (OP_READ | cmds[c].waitReg)){ lastPoll = j; polls[c]++; }
+		}
+		if (lastPoll < 0) continue;
+		dt = trace[lastPoll].us - trace[i].us;
+		total[c] += dt;
+		if (dt > longest[c]) longest[c] = dt;
+		n[c]++;
+	}
+	for (c = 0; c < 4; c++){
+		if (!n[c]) continue;
+		printf("%-10s %6lu commands, mean %6lu us, max %6lu us, %.1f polls\n",
+			cmds[c].name, n[c], total[c] / n[c], longest[c], (double)polls[c] / n[c]);
+	}
+}
+
+static void stop(const char *msg){
+	snprintf(why, sizeof why, "%s", msg);
+	longjmp(done, 1);
+}
+
+/* Stand-in chip: one SPI byte, address then data of each access */
+static char standinSpi(char out){
+	char msg[160], want[40], got[40];
+	unsigned char op;
+	struct record *r;
+	if (phase == 0){
+		spiOp = ((unsigned char)out >> 1) & OP_REG;
+		if (out & 0x80) spiOp |= OP_READ;
+		phase = 1;
+		return 0;
+	}
+	phase = 0;
+	if (cursor < count && trace[cursor].gap) stop("trace gap, records lost on the reader");
+	if (cursor < count && (trace[cursor].op & OP_READER)){		//reader change recorded first
+		if (readerCur != trace[cursor].val){
+			snprintf(msg, sizeof msg, "trace selects reader %u, driver uses reader %u", trace[cursor].val, readerCur);
+			stop(msg);
+		}
+		replayReader = readerCur;
+		if (++cursor < count && trace[cursor].gap) stop("trace gap, records lost on the reader");
+	}
+	if (cursor >= count) stop("end of trace");
+	if (readerCur != replayReader){
+		snprintf(msg, sizeof msg, "driver selects reader %u, trace stays on reader %d", readerCur, replayReader);
+		stop(msg);
+	}
+	r = &trace[cursor];
+	op = spiOp;
+	hostMicros = r->us;
+	if (r->op != op){
+		describe(want, sizeof want, r->op, r->val);
+		describe(got, sizeof got, op, (unsigned char)out);
+		snprintf(msg, sizeof msg, "trace %s, driver %s", want, got);
+		stop(msg);
+	}
+	cursor++;
+	if (op & OP_READ) return (char)r->val;
+	if ((unsigned char)out != r->val){
+		if (valueDiffs++ < VALUE_SHOWN){
+			describe(want, sizeof want, r->op, r->val);
+			printf("record %ld: trace %s, driver writes %02X\n", cursor - 1, want, (unsigned char)out);
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char **argv){
+	char line[40];
+	static int m;
+	int nModes = sizeof modes / sizeof modes[0];
+	long i;
+	for (m = 0; argc > 1 && m < nModes && strcmp(argv[1], modes[m].name); m++);
+	if (argc < 2 || m == nModes){
+		fprintf(stderr, "use: %s <mode> < capture.txt\nmodes:", argv[0]);
+		for (m = 0; m < nModes; m++) fprintf(stderr, " %s", modes[m].name);
+		fprintf(stderr, "\n");
+		return 2;
+	}
+	loadTrace();
+	if (!count){ fprintf(stderr, "no T records in the capture\n"); return 2; }
+	hostSpi = standinSpi;
+	replayReader = -1;
+	if (!setjmp(done)) modes[m].run();
+	printf("replay %s: %ld of %ld records, %s\n", modes[m].name, cursor, count, why);
+	if (valueDiffs) printf("%ld written values differ from the trace\n", valueDiffs);
+	if (cursor < count){
+		for (i = cursor > CONTEXT ? cursor - CONTEXT : 0; i <= cursor && i < count; i++){
+			describe(line, sizeof line, trace[i].op, trace[i].val);
+			printf("%c %6ld %10lu us  %s\n", i == cursor ? '>' : ' ', i, trace[i].us, line);
+		}
+	}
+	timingReport(cursor < count ? cursor : count);
+	return cursor < count;
+}
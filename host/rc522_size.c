@@ -0,0 +1,317 @@
+/*
+ * Name: rc522_size.c
+ * Host side flash and RAM report of a firmware build, per driver module.
+ * Reads the MPLINK map file (link with /m<file>.map), sizes every symbol up to
+ * the next one of its section and charges it to the module whose header
+ * defines it: core (MFRC522-RFID-SPI.h) and the headers it includes under
+ * #if RC522_xxx. Each module is checked against its RC522_ROM_xxx and
+ * RC522_RAM_xxx budget of MFRC522-Modules.h; the exit status is 1 when one
+ * module, or the whole image, does not fit.
+ *
+ * Build: cc -O2 -o rc522_size rc522_size.c
+ * Use:   rc522_size build.map [source dir, default .]
+ *
+ * Lines of the map used:
+ *	<name> <type> <address> <location> <size>		Section Info table
+ *	<name> <address> <location> <storage> [file]	symbol tables
+ * location "program" is flash (below 32 KB), "data" is RAM (below 1536).
+ * A symbol whose file is a module header is charged to that module, any other
+ * to the module that defines its name. main.c, the C library, the startup code,
+ * the stack and the idata copies in .cinit are "other".
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define LINE_LEN		512
+#define MAX_SECTIONS	512
+#define MAX_SYMBOLS		4096
+#define MAX_NAMES		2048
+#define MAX_MODULES		16
+#define FLASH_SIZE		32768
+#define RAM_SIZE		1536
+#define UMBRELLA		"MFRC522-RFID-SPI.h"
+#define PROFILE			"MFRC522-Modules.h"
+#define LOC_PROGRAM		0
+#define LOC_DATA		1
+
+struct section {
+	unsigned long address, size;
+	int location;
+};
+
+struct symbol {
+	char name[64];
+	unsigned long address;
+	int location;
+	int module;					//-1 = other
+};
+
+struct module {
+	char name[16];				//CORE, TRANSPORT, ... as in RC522_ROM_<name>
+	char header[64];
+	long budget[2];				//flash, RAM; -1 if not in MFRC522-Modules.h
+	unsigned long used[2];
+};
+
+struct name {
+	char name[64];
+	int module;
+};
+
+static struct section sections[MAX_SECTIONS];
+static int sectionCount;
+static struct symbol symbols[MAX_SYMBOLS];
+static int symbolCount;
+static struct module modules[MAX_MODULES];
+static int moduleCount;
+static struct name names[MAX_NAMES];
+static int nameCount;
+static unsigned long other[2];
+
+static int byAddress(const void *a, const void *b){
+	const struct symbol *x = a, *y = b;
+	if (x->location != y->location) return x->location - y->location;
+	if (x->address != y->address) return x->address < y->address ? -1 : 1;
+	return 0;
+}
+
+static int location(const char *s){
+	if (strcmp(s, "program") == 0) return LOC_PROGRAM;
+	if (strcmp(s, "data") == 0) return LOC_DATA;
+	return -1;
+}
+
+static FILE *openIn(const char *dir, const char *file){
+	char path[512];
+	FILE *f;
+	snprintf(path, sizeof path, "%s/%s", dir, file);
+	f = fopen(path, "r");
+	if (!f) perror(path);
+	return f;
+}
+
+static int findModule(const char *name){
+	int i;
+	for (i = 0; i < moduleCount; i++) if (strcmp(modules[i].name, name) == 0) return i;
+	return -1;
+}
+
+static int addModule(const char *name, const char *header){
+	struct module *m;
+	if (moduleCount == MAX_MODULES) return -1;
+	m = &modules[moduleCount];
+	snprintf(m->name, sizeof m->name, "%s", name);
+	snprintf(m->header, sizeof m->header, "%s", header);
+	m->budget[0] = m->budget[1] = -1;
+	return moduleCount++;
+}
+
+static void addName(const char *name, int module){
+	if (nameCount == MAX_NAMES || !*name) return;
+	snprintf(names[nameCount].name, sizeof names[0].name, "%s", name);
+	names[nameCount++].module = module;
+}
+
+/* Module headers of the umbrella: #if RC522_<name> then #include "<header>" */
+static int readUmbrella(const char *dir){
+	char line[LINE_LEN], flag[32] = "", header[64];
+	FILE *f = openIn(dir, UMBRELLA);
+	if (!f) return 0;
+	addModule("CORE", UMBRELLA);
+	while (fgets(line, sizeof line, f)){
+		if (sscanf(line, "#if RC522_%31[A-Z0-9_]", flag) == 1) continue;
+		if (*flag && sscanf(line, "#include \"%63[^\"]\"", header) == 1) addModule(flag, header);
+		*flag = 0;
+	}
+	fclose(f);
+	return 1;
+}
+
+/* RC522_ROM_<name> and RC522_RAM_<name> budgets */
+static int readBudgets(const char *dir){
+	char line[LINE_LEN], kind[4], name[16];
+	long value;
+	int m;
+	FILE *f = openIn(dir, PROFILE);
+	if (!f) return 0;
+	while (fgets(line, sizeof line, f)){
+		if (sscanf(line, "#define RC522_%3[A-Z]_%15[A-Z0-9_] %ld", kind, name, &value) != 3) continue;
+		m = findModule(name);
+		if (m < 0) continue;
+		if (strcmp(kind, "ROM") == 0) modules[m].budget[0] = value;
+		else if (strcmp(kind, "RAM") == 0) modules[m].budget[1] = value;
+	}
+	fclose(f);
+	return 1;
+}
+
+/* Last identifier of a declarator: "*rom txnStageName[STAGE_COUNT]" -> txnStageName */
+static void declName(const char *p, const char *end, char *out){
+	const char *s, *e = 0;
+	*out = 0;
+	while (p < end){
+		if (*p == '['){ while (p < end && *p != ']') p++; continue; }
+		if (isalpha((unsigned char)*p) || *p == '_'){
+			s = p;
+			while (p < end && (isalnum((unsigned char)*p) || *p == '_')) p++;
+			e = p;
+			if (e - s < 64){ memcpy(out, s, e - s); out[e - s] = 0; }
+			continue;
+		}
+		p++;
+	}
+}
+
+/* Names a header defines: functions, globals and static locals */
+static void scanHeader(const char *dir, int module){
+	char line[LINE_LEN], id[64], *p, *end, *part;
+	int comment = 0;
+	FILE *f = openIn(dir, modules[module].header);
+	if (!f) return;
+	while (fgets(line, sizeof line, f)){
+		if (comment){ if (strstr(line, "*/")) comment = 0; continue; }
+		if (strncmp(line, "/*", 2) == 0){ comment = !strstr(line, "*/"); continue; }
+		if ((p = strstr(line, "//")) != 0) *p = 0;
+		p = line;
+		if (isspace((unsigned char)*p)){
+			while (isspace((unsigned char)*p)) p++;
+			if (strncmp(p, "static ", 7)) continue;	//static locals only
+		}
+		if (!isalpha((unsigned char)*p) || !strncmp(p, "typedef", 7) || !strncmp(p, "extern", 6)) continue;
+		end = p + strcspn(p, "=;{");
+		if (memchr(p, '(', end - p)){				//function definition, not a prototype
+			if (*end != '{') continue;
+			*strchr(p, '(') = 0;
+			declName(p, p + strlen(p), id);
+			addName(id, module);
+			continue;
+		}
+		for (part = p; part < end; ){
+			char *comma = memchr(part, ',', end - part);
+			char *stop = comma ? comma : end;
+			declName(part, stop, id);
+			addName(id, module);
+			part = stop + 1;
+		}
+	}
+	fclose(f);
+}
+
+static int headerModule(const char *file){
+	const char *base = file, *p;
+	int i;
+	for (p = file; *p; p++) if (*p == '/' || *p == '\\') base = p + 1;
+	for (i = 0; i < moduleCount; i++) if (strcmp(modules[i].header, base) == 0) return i;
+	return -1;
+}
+
+static int nameModule(const char *name){
+	int i;
+	for (i = 0; i < nameCount; i++) if (strcmp(names[i].name, name) == 0) return names[i].module;
+	return -1;
+}
+
+/* Section Info and symbol tables; a symbol listed twice (by name, by address) is kept once */
+static int readMap(const char *file){
+	char line[LINE_LEN], name[64], type[32], loc[16], storage[16], path[LINE_LEN];
+	unsigned long address, size;
+	int n, i, l;
+	FILE *f = fopen(file, "r");
+	if (!f){ perror(file); return 0; }
+	while (fgets(line, sizeof line, f)){
+		*path = 0;
+		if (sscanf(line, "%63s %31s %lx %15s %lx", name, type, &address, loc, &size) == 5 && (l = location(loc)) >= 0){
+			if (sectionCount < MAX_SECTIONS){
+				sections[sectionCount].address = address;
+				sections[sectionCount].size = size;
+				sections[sectionCount++].location = l;
+			}
+			continue;
+		}
+		n = sscanf(line, "%63s %lx %15s %15s %511[^\r\n]", name, &address, loc, storage, path);
+		if (n < 4 || (l = location(loc)) < 0) continue;
+		for (i = 0; i < symbolCount; i++)
+			if (symbols[i].address == address && symbols[i].location == l && strcmp(symbols[i].name, name) == 0) break;
+		if (i < symbolCount || symbolCount == MAX_SYMBOLS) continue;
+		strcpy(symbols[symbolCount].name, name);
+		symbols[symbolCount].address = address;
+		symbols[symbolCount].location = l;
+		symbols[symbolCount].module = n == 5 ? headerModule(path) : -1;
+		if (symbols[symbolCount].module < 0) symbols[symbolCount].module = nameModule(name);
+		symbolCount++;
+	}
+	fclose(f);
+	return 1;
+}
+
+static unsigned long limit(int l){ return l == LOC_PROGRAM ? FLASH_SIZE : RAM_SIZE; }
+
+/* Charge every section byte to the symbol before it, or to other */
+static void charge(void){
+	int s, i, first;
+	unsigned long start, end, next, bytes;
+	qsort(symbols, symbolCount, sizeof symbols[0], byAddress);
+	for (s = 0; s < sectionCount; s++){
+		start = sections[s].address;
+		end = start + sections[s].size;
+		if (start >= limit(sections[s].location)) continue;	//SFRs, configuration words, EEPROM
+		if (end > limit(sections[s].location)) end = limit(sections[s].location);
+		first = 1;
+		for (i = 0; i < symbolCount; i++){
+			if (symbols[i].location != sections[s].location) continue;
+			if (symbols[i].address < start || symbols[i].address >= end) continue;
+			if (first){ other[sections[s].location] += symbols[i].address - start; first = 0; }
+			next = (i + 1 < symbolCount && symbols[i+1].location == symbols[i].location && symbols[i+1].address < end)
+				? symbols[i+1].address : end;
+			bytes = next - symbols[i].address;
+			if (symbols[i].module >= 0) modules[symbols[i].module].used[sections[s].location] += bytes;
+			else other[sections[s].location] += bytes;
+		}
+		if (first) other[sections[s].location] += end - start;
+	}
+}
+
+static int column(unsigned long used, long budget){
+	if (budget < 0){ printf(" %7lu %7s", used, "-"); return 0; }
+	printf(" %7lu %7ld", used, budget);
+	return used > (unsigned long)budget;
+}
+
+int main(int argc, char **argv){
+	const char *dir = argc > 2 ? argv[2] : ".";
+	unsigned long total[2];
+	int i, over, failed = 0;
+	if (argc < 2){
+		fprintf(stderr, "use: %s build.map [source dir]\n", argv[0]);
+		return 2;
+	}
+	if (!readUmbrella(dir) || !readBudgets(dir)) return 1;
+	for (i = 0; i < moduleCount; i++) scanHeader(dir, i);
+	if (!readMap(argv[1])) return 1;
+	if (!symbolCount){
+		fprintf(stderr, "%s: no symbols, link with /m and keep the symbol tables\n", argv[1]);
+		return 1;
+	}
+	charge();
+	total[0] = other[0];
+	total[1] = other[1];
+	printf("%-12s %7s %7s %7s %7s\n", "module", "flash", "budget", "RAM", "budget");
+	for (i = 0; i < moduleCount; i++){
+		printf("%-12s", modules[i].name);
+		over = column(modules[i].used[0], modules[i].budget[0]);
+		over |= column(modules[i].used[1], modules[i].budget[1]);
+		printf("%s\n", over ? "  OVER" : (modules[i].used[0] | modules[i].used[1]) ? "" : "  not in the build");
+		failed |= over;
+		total[0] += modules[i].used[0];
+		total[1] += modules[i].used[1];
+	}
+	printf("%-12s %7lu %7s %7lu %7s\n", "other", other[0], "-", other[1], "-");
+	printf("%-12s", "total");
+	over = column(total[0], FLASH_SIZE);
+	over |= column(total[1], RAM_SIZE);
+	printf("%s\n", over ? "  OVER" : "");
+	return failed | over;
+}
@@ -0,0 +1,902 @@
+/*
+ * Name: rc522_soak.c
+ * Soak test of the driver on the host, against a stand-in MFRC522 and a
+ * MIFARE Classic 1K card that inject RF errors at set rates: CRC (two bits of
+ * one byte, parity still good), parity, collision, no answer, RxIRq with an
+ * empty FIFO, answers longer than the buffer, and a chip that never ends the
+ * command. Runs read cycles (WUPA, select, auth and READ, HALT) or a DIP
+ * switch mode for a simulated time and reports the sustained rate, latency
+ * percentiles and every breach of the protocol state found on the way.
+ * TxCRCEn and RxCRCEn are modelled: the CRC_A is appended to the frame, and
+ * checked and removed from the answer, a wrong one sets CRCErr.
+ * Frames are on the air byte by byte at the bit rate of TxModeReg/RxModeReg:
+ * the FIFO empties while sending (LoAlert, the frame ends when it runs empty)
+ * and fills while receiving (HiAlert, BufferOvfl when full). The apdu run uses
+ * an ISO14443-4 card (SAK 0x20, ATS FSCI 8, DS and DR up to 848 kbps, FWI 7,
+ * PICC block rules, S(WTX) with -w) with a 1 KB file for UPDATE and READ
+ * BINARY, and reports the APDU rate.
+ *
+ * Build: cc -O2 -Ihost/pic18 -o rc522_soak host/rc522_soak.c host/pic18/pic18_host.c
+ *        (add -fsanitize=address,undefined to catch overruns in the driver too)
+ * Use:   rc522_soak [options] [mode]
+ *        mode: cycle (default), apdu, serial, hex, ascii, compact, gate (DIP switch modes)
+ *	-T s		simulated seconds, default 60
+ *	-c -p -k -t -e -l -x %	rate per RF frame of CRC, parity, collision, no answer,
+ *				empty FIFO, long answer and chip stall errors; -r % sets all but -x
+ *	-b n		blocks read per cycle, default 64 (cycle)
+ *	-L n		APDU data bytes, default 200 (apdu)
+ *	-R kbps		highest bit rate asked in PPS: 106, 212, 424, 848 (default) (apdu)
+ *	-w %		rate per APDU of S(WTX) from the card (apdu)
+ *	-d in,out	ms the card stays in and out of the field, default 400,200 (modes)
+ *	-s n		random seed
+ *	-u file		USART output to file, e.g. the T lines of a build with -DSPI_TRACE=1
+ *				for rc522_replay
+ *	-B baud		USART line rate, default none (the USART is always free)
+ * Time is the host clock of pic18_host.c: SPI accesses, delays and frames at
+ * 106 kbit/s advance it, so the rates are those of the PIC at Fcy 1 MHz.
+ *
+ * Breaches counted, exit status 1 if any:
+ *	silent		MI_OK with a UID, SAK or block data the card did not send (cycle)
+ *	desync		MI_OK from select or auth while the card is not in that state, or
+ *				from a READ resent under Crypto1 (cycle); an error on an encrypted
+ *				frame sends the card to IDLE
+ *	backLen		bit count above the 64 byte FIFO, or not the bits received (cycle)
+ *	overrun		bytes written past the MAX_LEN buffer of MFRC522_ToCard (cycle)
+ *	empty read	FIFODataReg read with the FIFO empty
+ *	overflow	FIFODataReg written with the FIFO full
+ *	plain REQA	REQA or WUPA sent with MFCrypto1On still set
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <setjmp.h>
+#include "p18f4520.h"
+#include "delays.h"
+#include "timers.h"
+#include "capture.h"
+#include "pic18_host.h"
+#include "../MFRC522-RFID-SPI.h"
+
+#define FIFO_SIZE		64
+#define SPI_BYTE_US		40				//software SPI, one byte at Fcy 1 MHz
+#define BIT_US			9.44			//128/fc
+#define FDT_US			92				//PICC answer after the last PCD bit
+#define AUTH_US			600				//three pass authentication
+#define CRC_US			2				//CalcCRC, per byte
+#define WINDOW_US		1000000UL		//throughput window
+#define CANARY			0xA5
+#define CANARY_LEN		8
+#define FRAME_MAX		300				//longest frame on the air, T=CL blocks included
+#define FILE_LEN		1024			//binary file of the ISO14443-4 card
+#define APDU_PAIRS		8				//UPDATE BINARY and READ BINARY per apdu cycle
+
+enum { ERR_CRC, ERR_PARITY, ERR_COLL, ERR_NOANSWER, ERR_EMPTY, ERR_LONG, ERR_STALL, ERR_COUNT };
+enum { CARD_IDLE, CARD_READY, CARD_ACTIVE, CARD_AUTH, CARD_HALT, CARD_TCL };
+enum { BR_SILENT, BR_DESYNC, BR_BACKLEN, BR_OVERRUN, BR_EMPTY, BR_OVERFLOW, BR_PLAIN, BR_COUNT };
+
+static const char *errName[ERR_COUNT] = {"crc", "parity", "collision", "no answer", "empty fifo", "long answer", "stall"};
+static const char *breachName[BR_COUNT] = {"silent", "desync", "backLen", "overrun", "empty read", "overflow", "plain REQA"};
+static const char errOpt[ERR_COUNT] = {'c', 'p', 'k', 't', 'e', 'l', 'x'};
+
+//chip
+static unsigned char reg[64];
+static unsigned char fifo[FIFO_SIZE];
+static int fifoHead, fifoLen;
+static int phase, spiRead;				//0 address byte, 1 data byte of an access
+static unsigned char spiAddr;
+static struct {
+	int busy, stall;
+	unsigned long doneAt, rxAt;			//end of the command, first bit of the answer
+	unsigned char irq, err, coll, lastBits;
+	unsigned char ans[FRAME_MAX];
+	int ansBytes, pushed, crypto;		//pushed: answer bytes already in the FIFO
+	double rxByteUs;
+} cmd;
+static struct {							//transceive frame on the air
+	int active, n;
+	unsigned long start;
+	unsigned char f[FRAME_MAX];
+} tx;
+static int lastBits;					//bits of the last answer put in the FIFO
+
+//card
+static struct { int state, halted, sector; } card;
+static unsigned char cardUid[4] = {0x3A, 0x91, 0x5C, 0x07};
+static unsigned char cardMem[64][16];
+static unsigned char cardKey[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+static unsigned long inUs, outUs;		//dwell in and out of the field, 0 always in
+static unsigned long enteredAt, presence, servedPresence;
+static int cardIso;						//ISO14443-4 card (apdu run) in place of the 1K
+static struct {
+	int rxRate, txRate, pps, block, fsd, wtx;	//rates PCD to PICC and back, TCL_xxxKBPS
+	unsigned char in[FRAME_MAX], out[FILE_LEN + 2], last[FRAME_MAX];
+	int inLen, outLen, outSent, lastLen;
+} iso;
+static unsigned char cardFile[FILE_LEN];
+
+//run
+static double rate[ERR_COUNT];
+static unsigned long injected[ERR_COUNT], breaches[BR_COUNT];
+static unsigned long frames, cardReads;
+static int tclRate = TCL_848KBPS, apduLen = 200;
+static double wtxRate;
+static unsigned long endUs;
+static unsigned long rng = 0x2545F491UL;
+static jmp_buf done;
+
+struct series { unsigned long *v; long n, cap; };
+static struct series cycleLat, readLat, cardLat;
+static struct { unsigned long start, reads, min, max; int count; } window;
+
+static const struct { const char *name; void (*run)(void); } modes[] = {
+	{"serial", showSerialNumber}, {"hex", readDataHEX}, {"ascii", readDataASCII},
+	{"compact", readDataCompact}, {"gate", readDataGate}};
+
+static unsigned long rnd(void){
+	rng ^= rng << 13;
+	rng ^= rng >> 17;
+	rng ^= rng << 5;
+	return rng & 0xFFFFFFFFUL;
+}
+
+static double rndUnit(void){ return (double)rnd() / 4294967296.0; }
+
+static void keep(unsigned long v, int which){
+	struct series *s = which == 0 ? &cycleLat : which == 1 ? &readLat : &cardLat;
+	if (s->n == s->cap){
+		s->cap = s->cap ? 2 * s->cap : 4096;
+		s->v = realloc(s->v, s->cap * sizeof *s->v);
+		if (!s->v){ perror("realloc"); exit(2); }
+	}
+	s->v[s->n++] = v;
+}
+
+static int byValue(const void *a, const void *b){
+	unsigned long x = *(const unsigned long *)a, y = *(const unsigned long *)b;
+	return x < y ? -1 : x > y;
+}
+
+static void breach(int b, const char *what){
+	if (breaches[b]++ < 4) printf("%10lu us  %s: %s\n", hostMicros, breachName[b], what);
+}
+
+static void crcA(const unsigned char *p, int len, unsigned char *out){
+	unsigned int crc = 0x6363;
+	int b;
+	while (len--){
+		crc ^= *p++;
+		for (b = 0; b < 8; b++) crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : crc >> 1;
+	}
+	out[0] = crc & 0xFF;
+	out[1] = crc >> 8;
+}
+
+static int crcOk(const unsigned char *p, int len){
+	unsigned char c[2];
+	crcA(p, len - 2, c);
+	return len > 2 && c[0] == p[len-2] && c[1] == p[len-1];
+}
+
+//------------------------------------------------------------------------------
+//card
+
+static int cardInField(void){
+	unsigned long t, in;
+	if (!inUs) return 1;
+	t = hostMicros % (inUs + outUs);
+	in = t < inUs;
+	if (in && hostMicros / (inUs + outUs) + 1 != presence){		//entered again
+		presence = hostMicros / (inUs + outUs) + 1;
+		enteredAt = hostMicros - t;
+		card.state = CARD_IDLE;
+		card.halted = 0;
+		iso.rxRate = iso.txRate = TCL_106KBPS;
+	}
+	return in;
+}
+
+static void cardInit(void){
+	int b, i;
+	for (b = 0; b < 64; b++){
+		for (i = 0; i < 16; i++) cardMem[b][i] = (unsigned char)(b * 16 + i) ^ 0x5A;
+		if ((b & 3) == 3){
+			memset(cardMem[b], 0x00, 6);				//key A reads as zeros
+			cardMem[b][6] = 0xFF; cardMem[b][7] = 0x07; cardMem[b][8] = 0x80; cardMem[b][9] = 0x69;
+			memset(cardMem[b] + 10, 0xFF, 6);
+		}
+	}
+	memcpy(cardMem[0], cardUid, 4);
+	cardMem[0][4] = cardUid[0] ^ cardUid[1] ^ cardUid[2] ^ cardUid[3];
+	cardMem[0][5] = 0x08;
+}
+
+static void cardSleep(void){ card.state = card.halted ? CARD_HALT : CARD_IDLE; }
+
+/* The field goes off: the card loses power */
+static void cardPowerOff(void){
+	card.state = CARD_IDLE;
+	card.halted = 0;
+	iso.rxRate = iso.txRate = TCL_106KBPS;
+}
+
+static void cardServed(void){
+	if (!inUs || servedPresence == presence) return;
+	servedPresence = presence;
+	keep(hostMicros - enteredAt, 2);
+}
+
+/* Keep a block of the ISO14443-4 card for a resend, CRC_A added: answer bits */
+static int isoSend(unsigned char *ans, int len){
+	crcA(ans, len, ans + len);
+	memcpy(iso.last, ans, len + 2);
+	iso.lastLen = len + 2;
+	return 8 * (len + 2);
+}
+
+/* Next I-block of the response, chained when longer than FSD */
+static int isoNext(unsigned char *ans){
+	int chunk = iso.outLen - iso.outSent, more = chunk > iso.fsd - 3;
+	if (more) chunk = iso.fsd - 3;
+	ans[0] = 0x02 | iso.block | (more ? 0x10 : 0);
+	memcpy(ans + 1, iso.out + iso.outSent, chunk);
+	iso.outSent += chunk;
+	return isoSend(ans, chunk + 1);
+}
+
+/* APDU in iso.in: UPDATE BINARY or READ BINARY of the file, response in iso.out */
+static void isoApdu(void){
+	const unsigned char *a = iso.in;
+	int off = (a[2] << 8) | a[3], len = a[4] ? a[4] : 256;
+	iso.outLen = iso.outSent = 0;
+	if (iso.inLen == 5 + a[4] && a[0] == 0x00 && a[1] == 0xD6 && a[4] && off + a[4] <= FILE_LEN){
+		memcpy(cardFile + off, a + 5, a[4]);
+	}
+	else if (iso.inLen == 5 && a[0] == 0x00 && a[1] == 0xB0 && off + len <= FILE_LEN){
+		memcpy(iso.out, cardFile + off, len);
+		iso.outLen = len;
+		cardReads++;
+	}
+	else{
+		iso.out[0] = 0x67;										//wrong length
+		iso.out[1] = 0x00;
+		iso.outLen = 2;
+		return;
+	}
+	iso.out[iso.outLen++] = 0x90;
+	iso.out[iso.outLen++] = 0x00;
+}
+
+/* Block of the reader to the ISO14443-4 card, CRC_A included: answer bits,
+ * -1 no answer. PICC block rules of ISO14443-4, no CID or NAD; a block with
+ * a wrong CRC_A is ignored and the reader times out */
+static int cardIsoBlock(const unsigned char *f, int n, unsigned char *ans){
+	int pcb, num;
+	if (!crcOk(f, n)) return -1;
+	n -= 2;
+	pcb = f[0];
+	num = pcb & 1;
+	if (pcb == PICC_PPS && n == 3 && f[1] == 0x11 && iso.pps){		//answered at the old rates
+		iso.pps = 0;
+		iso.rxRate = f[2] & 0x03;										//DRI
+		iso.txRate = (f[2] >> 2) & 0x03;								//DSI
+		ans[0] = PICC_PPS;
+		return isoSend(ans, 1);
+	}
+	iso.pps = 0;
+	if ((pcb & 0xE2) == 0x02 && !(pcb & 0x0C)){						//I-block
+		if (num == iso.block){ memcpy(ans, iso.last, iso.lastLen); return 8 * iso.lastLen; }
+		iso.block = num;
+		if (iso.inLen + n - 1 > FRAME_MAX){ iso.inLen = 0; return -1; }
+		memcpy(iso.in + iso.inLen, f + 1, n - 1);
+		iso.inLen += n - 1;
+		if (pcb & 0x10){ ans[0] = 0xA2 | iso.block; return isoSend(ans, 1); }	//R(ACK), chaining
+		isoApdu();
+		iso.inLen = 0;
+		if (wtxRate && rndUnit() < wtxRate){							//S(WTX) before the response
+			iso.wtx = 1 + rnd() % 3;
+			ans[0] = 0xF2;
+			ans[1] = (unsigned char)iso.wtx;
+			return isoSend(ans, 2);
+		}
+		return isoNext(ans);
+	}
+	if ((pcb & 0xE6) == 0xA2){										//R-block
+		if (num == iso.block){ memcpy(ans, iso.last, iso.lastLen); return 8 * iso.lastLen; }
+		if (pcb & 0x10){ ans[0] = 0xA2 | iso.block; return isoSend(ans, 1); }	//R(NAK) of a block not received
+		if (iso.outSent >= iso.outLen || iso.wtx) return -1;
+		iso.block = num;
+		return isoNext(ans);
+	}
+	if ((pcb & 0xF7) == 0xF2 && n == 2 && iso.wtx){					//S(WTX) response
+		if ((f[1] & 0x3F) != iso.wtx) return -1;
+		iso.wtx = 0;
+		return isoNext(ans);
+	}
+	if ((pcb & 0xF7) == 0xC2 && n == 1){								//S(DESELECT)
+		card.state = CARD_HALT;
+		card.halted = 1;
+		cardServed();
+		iso.rxRate = iso.txRate = TCL_106KBPS;							//back to 106 kbps, answered at the old rates
+		ans[0] = 0xC2;
+		return isoSend(ans, 1);
+	}
+	return -1;
+}
+
+/* Frame of the reader as the card gets it: answer bits, -1 no answer */
+static int cardFrame(int authent, const unsigned char *f, int n, int txLast, int crypto, unsigned char *ans){
+	if (!cardInField()) return -1;
+	if (txLast == 7 && n == 1 && (f[0] == PICC_REQIDL || f[0] == PICC_REQALL)){
+		if (crypto) breach(BR_PLAIN, "REQA/WUPA with MFCrypto1On set");
+		if (card.state == CARD_TCL) return -1;					//ignored in the protocol state
+		if (card.state == CARD_IDLE || (card.state == CARD_HALT && f[0] == PICC_REQALL)){
+			card.state = CARD_READY;
+			ans[0] = 0x04;
+			ans[1] = 0x00;
+			return 16;
+		}
+		cardSleep();
+		return -1;
+	}
+	if (card.state == CARD_IDLE || card.state == CARD_HALT) return -1;
+	if (card.state == CARD_TCL) return authent || txLast ? -1 : cardIsoBlock(f, n, ans);
+	if (crypto != (card.state == CARD_AUTH)){ cardSleep(); return -1; }		//Crypto1 streams disagree
+	if (authent){
+		if (n == 12 && (f[0] == PICC_AUTHENT1A || f[0] == PICC_AUTHENT1B) && f[1] < 64
+			&& !memcmp(f + 2, cardKey, 6) && !memcmp(f + 8, cardUid, 4)){
+			card.state = CARD_AUTH;
+			card.sector = f[1] / 4;
+			return 0;
+		}
+		cardSleep();
+		return -1;
+	}
+	if (txLast) { cardSleep(); return -1; }
+	switch (card.state){
+	case CARD_READY:
+		if (n == 2 && f[0] == PICC_ANTICOLL && f[1] == 0x20){
+			memcpy(ans, cardMem[0], 5);
+			return 40;
+		}
+		if (n == 9 && f[0] == PICC_SElECTTAG && f[1] == 0x70 && crcOk(f, 9) && !memcmp(f + 2, cardMem[0], 5)){
+			card.state = CARD_ACTIVE;
+			ans[0] = cardIso ? 0x20 : 0x08;
+			crcA(ans, 1, ans + 1);
+			return 24;
+		}
+		break;
+	case CARD_ACTIVE:
+		if (cardIso && n == 4 && f[0] == PICC_RATS && crcOk(f, 4)){	//ATS: FSCI 8, DS and DR 2/4/8, FWI 7
+			card.state = CARD_TCL;
+			iso.fsd = tclFrameSize[(f[1] >> 4) < 8 ? f[1] >> 4 : 8];
+			iso.block = 1;
+			iso.pps = 1;
+			iso.inLen = iso.outLen = iso.outSent = iso.wtx = 0;
+			ans[0] = 0x05; ans[1] = 0x78; ans[2] = 0x77; ans[3] = 0x70; ans[4] = 0x00;
+			return isoSend(ans, 5);
+		}
+		/* fall through */
+	case CARD_AUTH:
+		if (n == 4 && f[0] == PICC_HALT && f[1] == 0 && crcOk(f, 4)){
+			card.state = CARD_HALT;
+			card.halted = 1;
+			cardServed();
+			return -1;
+		}
+		if (card.state == CARD_AUTH && n == 4 && f[0] == PICC_READ){
+			if (!crcOk(f, 4) || f[1] >= 64 || f[1] / 4 != card.sector){
+				ans[0] = crcOk(f, 4) ? 0x04 : 0x05;			//NAK, the card leaves the authenticated state
+				cardSleep();
+				return 4;
+			}
+			memcpy(ans, cardMem[f[1]], 16);
+			crcA(ans, 16, ans + 16);
+			cardReads++;
+			return 144;
+		}
+		break;
+	}
+	cardSleep();
+	return -1;
+}
+
+//------------------------------------------------------------------------------
+//chip
+
+static void chipReset(void){
+	memset(reg, 0, sizeof reg);
+	reg[CommandReg] = 0x20;
+	reg[CommIEnReg] = 0x80;
+	reg[CommIrqReg] = 0x14;
+	reg[Status1Reg] = 0x21;
+	reg[WaterLevelReg] = 0x08;
+	reg[ControlReg] = 0x10;
+	reg[ModeReg] = 0x3F;
+	reg[TxControlReg] = 0x80;
+	reg[VersionReg] = 0x92;
+	fifoHead = fifoLen = 0;
+	memset(&cmd, 0, sizeof cmd);
+	memset(&tx, 0, sizeof tx);
+	cardPowerOff();
+}
+
+static double byteUs(int rate){ return 9 * BIT_US / (1 << rate); }
+
+static unsigned long timerUs(void){
+	unsigned long prescaler = ((reg[TModeReg] & 0x0F) << 8) | reg[TPrescalerReg];
+	unsigned long reload = (reg[TReloadRegH] << 8) | reg[TReloadRegL];
+	return (unsigned long)((2 * prescaler + 1) * (reload + 1) / 13.56);
+}
+
+static void chipExchange(int authent, unsigned char *f, int n, unsigned long t0);
+
+/* Answer bytes received by now go into the FIFO, all of them at the end of the
+ * command; a full FIFO loses the byte (BufferOvfl), HiAlert when almost full */
+static void chipReceive(int all){
+	long due = cmd.ansBytes;
+	if (!all) due = hostMicros < cmd.rxAt ? 0 : (long)((hostMicros - cmd.rxAt) / cmd.rxByteUs);
+	if (due > cmd.ansBytes) due = cmd.ansBytes;
+	for (; cmd.pushed < due; cmd.pushed++){
+		if (fifoLen == FIFO_SIZE){ cmd.err |= 0x10; continue; }
+		fifo[(fifoHead + fifoLen++) % FIFO_SIZE] = cmd.ans[cmd.pushed];
+	}
+	if (FIFO_SIZE - fifoLen <= reg[WaterLevelReg]) reg[CommIrqReg] |= 0x08;
+}
+
+/* Bytes the chip has sent by now leave the FIFO, the frame ends when the FIFO
+ * runs empty; LoAlert while it is almost empty */
+static void chipTransmit(void){
+	long due = (long)((hostMicros - tx.start) / byteUs((reg[TxModeReg] >> 4) & 3)) + 1;
+	while (tx.n < due && fifoLen && tx.n < FRAME_MAX - 2){
+		tx.f[tx.n++] = fifo[fifoHead];
+		fifoHead = (fifoHead + 1) % FIFO_SIZE;
+		fifoLen--;
+	}
+	if (tx.n < due){
+		tx.active = 0;
+		reg[CommIrqReg] |= 0x40;											//TxIRq
+		chipExchange(0, tx.f, tx.n, tx.start);
+	}
+	else if (fifoLen <= reg[WaterLevelReg]) reg[CommIrqReg] |= 0x04;
+}
+
+/* Move the frame on the air and end the command in flight when its time has come */
+static void chipUpdate(void){
+	if (tx.active) chipTransmit();
+	if (!cmd.busy || cmd.stall) return;
+	if (cmd.irq & 0x20) chipReceive(hostMicros >= cmd.doneAt);
+	if (hostMicros < cmd.doneAt) return;
+	cmd.busy = 0;
+	reg[ErrorReg] = cmd.err;
+	reg[CollReg] = cmd.coll;
+	reg[CommIrqReg] |= cmd.irq;
+	if (cmd.crypto) reg[Status2Reg] |= 0x08;
+	if (cmd.irq & 0x20) reg[ControlReg] = (reg[ControlReg] & 0xF8) | cmd.lastBits;
+	if (!(reg[CommandReg] & 0x0F) || (reg[CommandReg] & 0x0F) == PCD_AUTHENT) reg[CommandReg] &= 0xF0;
+}
+
+/* Frame f of n bytes, sent from t0, to the card; schedule the end of the command */
+static void chipFrame(int authent, unsigned char *f, int n, unsigned long t0){
+	int i, bits, txLast, u, e, hear, ansRate, room;
+	double r, txUs, txBit, rxBit;
+	txLast = authent ? 0 : reg[BitFramingReg] & 0x07;
+	if (!authent && !txLast && (reg[TxModeReg] & 0x80)){ crcA(f, n, f + n); n += 2; }	//TxCRCEn
+	txBit = BIT_US / (1 << ((reg[TxModeReg] >> 4) & 3));
+	rxBit = BIT_US / (1 << ((reg[RxModeReg] >> 4) & 3));
+	txUs = ((txLast ? 1 + txLast : 9 * n) + 2) * txBit;
+	frames++;
+	//error of this frame, at most one
+	r = rndUnit();
+	for (e = 0; e < ERR_COUNT && r >= rate[e]; r -= rate[e], e++);
+	if (authent && e != ERR_NOANSWER && e != ERR_STALL) e = ERR_COUNT;
+	if (e == ERR_CRC && n > 3 && crcOk(f, n) && (rnd() & 1)){		//on the way to the card
+		f[rnd() % (n - 2)] ^= 0x11;
+		injected[e]++;
+		e = ERR_COUNT;
+	}
+	memset(&cmd, 0, sizeof cmd);
+	cmd.busy = 1;
+	hear = authent || ((reg[TxModeReg] >> 4) & 3) == iso.rxRate;		//the card listens at its bit rate
+	ansRate = iso.txRate;
+	bits = hear ? cardFrame(authent, f, n, txLast, (reg[Status2Reg] & 0x08) != 0, cmd.ans) : -1;
+	if (ansRate != ((reg[RxModeReg] >> 4) & 3)) bits = -1;				//answer at another rate: noise
+	if (e == ERR_STALL){ cmd.stall = 1; injected[e]++; return; }
+	if (e == ERR_NOANSWER && bits >= 0){ bits = -1; injected[e]++; }
+	if (authent){
+		cmd.doneAt = t0 + (bits < 0 ? AUTH_US / 3 + timerUs() : AUTH_US);
+		cmd.irq = bits < 0 ? 0x01 : 0x10;
+		cmd.crypto = bits >= 0;
+		return;
+	}
+	if (bits < 0){
+		cmd.doneAt = t0 + (unsigned long)txUs + timerUs();
+		cmd.irq = 0x01;
+		return;
+	}
+	cmd.ansBytes = (bits + 7) / 8;
+	cmd.lastBits = bits % 8;
+	switch (e){
+	case ERR_CRC:
+		if (cmd.ansBytes < 1) break;
+		cmd.ans[rnd() % cmd.ansBytes] ^= 0x11;				//two bits of a byte: parity holds
+		injected[e]++;
+		break;
+	case ERR_PARITY:
+		if (cmd.ansBytes < 1) break;
+		cmd.ans[rnd() % cmd.ansBytes] ^= 1 << (rnd() % 8);
+		cmd.err = 0x02;
+		injected[e]++;
+		break;
+	case ERR_COLL:
+		u = rnd() % (bits ? bits : 1);
+		cmd.coll = (u + 1) & 0x1F;
+		cmd.err = 0x08;
+		injected[e]++;
+		break;
+	case ERR_EMPTY:
+		cmd.ansBytes = 0;
+		cmd.lastBits = 1 + rnd() % 7;						//stale from an earlier frame
+		injected[e]++;
+		break;
+	case ERR_LONG:
+		room = (cmd.ansBytes < FIFO_SIZE ? FIFO_SIZE : FRAME_MAX) - cmd.ansBytes;
+		if (room < 1) break;
+		u = 1 + rnd() % room;
+		for (i = 0; i < u; i++) cmd.ans[cmd.ansBytes + i] = (unsigned char)rnd();
+		cmd.ansBytes += u;
+		cmd.lastBits = 0;
+		injected[e]++;
+		break;
+	}
+	if ((reg[RxModeReg] & 0x80) && cmd.ansBytes){			//RxCRCEn: the CRC_A stays out of the FIFO
+		if (cmd.lastBits || !crcOk(cmd.ans, cmd.ansBytes)) cmd.err |= 0x04;
+		if (!cmd.lastBits && cmd.ansBytes > 2) cmd.ansBytes -= 2;
+	}
+	lastBits = cmd.ansBytes * 8 - (cmd.lastBits ? 8 - cmd.lastBits : 0);
+	if (lastBits < 0) lastBits = 0;
+	cmd.irq = 0x20;
+	cmd.rxByteUs = 9 * rxBit;
+	cmd.rxAt = t0 + (unsigned long)(txUs + FDT_US + rxBit);
+	cmd.doneAt = t0 + (unsigned long)(txUs + FDT_US + (cmd.ansBytes * 9 + 1) * rxBit);
+}
+
+/* One frame; an error on an encrypted exchange leaves the Crypto1 streams of
+ * reader and card apart, the card drops to IDLE as a MIFARE Classic does */
+static void chipExchange(int authent, unsigned char *f, int n, unsigned long t0){
+	unsigned long before;
+	int e, crypto;
+	for (e = 0, before = 0; e < ERR_COUNT; e++) before += injected[e];
+	crypto = !authent && (reg[Status2Reg] & 0x08);
+	chipFrame(authent, f, n, t0);
+	for (e = 0; e < ERR_COUNT; e++) before -= injected[e];
+	if (crypto && before && card.state == CARD_AUTH) card.state = CARD_IDLE;
+}
+
+static void chipWrite(unsigned char a, unsigned char v){
+	switch (a){
+	case CommandReg:
+		reg[a] = (reg[a] & 0xF0) | (v & 0x0F);
+		switch (v & 0x0F){
+		case PCD_IDLE:			cmd.busy = tx.active = 0; break;
+		case PCD_RESETPHASE:	chipReset(); break;
+		case PCD_AUTHENT:{
+			unsigned char f[FRAME_MAX];
+			int i, n = fifoLen;
+			for (i = 0; i < n; i++) f[i] = fifo[(fifoHead + i) % FIFO_SIZE];
+			fifoHead = fifoLen = 0;
+			chipExchange(1, f, n, hostMicros);
+			break;	}
+		case PCD_CALCCRC:{
+			unsigned char f[FIFO_SIZE], c[2];
+			int i;
+			for (i = 0; i < fifoLen; i++) f[i] = fifo[(fifoHead + i) % FIFO_SIZE];
+			crcA(f, fifoLen, c);
+			reg[CRCResultRegL] = c[0];
+			reg[CRCResultRegM] = c[1];
+			hostMicros += CRC_US * fifoLen;
+			fifoHead = fifoLen = 0;
+			reg[DivIrqReg] |= 0x04;
+			break;	}
+		default:				break;
+		}
+		break;
+	case CommIrqReg:
+	case DivIrqReg:
+		if (v & 0x80) reg[a] |= v & 0x7F;
+		else reg[a] &= ~v;
+		break;
+	case FIFODataReg:
+		if (fifoLen == FIFO_SIZE){ breach(BR_OVERFLOW, "FIFODataReg written with 64 bytes in the FIFO"); break; }
+		fifo[(fifoHead + fifoLen++) % FIFO_SIZE] = v;
+		break;
+	case FIFOLevelReg:
+		if (v & 0x80) fifoHead = fifoLen = 0;
+		break;
+	case BitFramingReg:
+		reg[a] = v & 0x7F;
+		if ((v & 0x80) && (reg[CommandReg] & 0x0F) == PCD_TRANSCEIVE && !cmd.busy && !tx.active){	//StartSend
+			tx.active = 1;
+			tx.n = 0;
+			tx.start = hostMicros;
+			chipTransmit();
+		}
+		break;
+	case TxControlReg:
+		reg[a] = v;
+		if (!(v & 0x03)) cardPowerOff();							//field off
+		break;
+	default:
+		reg[a] = v;
+		break;
+	}
+}
+
+static unsigned char chipRead(unsigned char a){
+	unsigned char v;
+	chipUpdate();
+	switch (a){
+	case FIFODataReg:
+		if (!fifoLen){ breach(BR_EMPTY, "FIFODataReg read with the FIFO empty"); return 0; }
+		v = fifo[fifoHead];
+		fifoHead = (fifoHead + 1) % FIFO_SIZE;
+		fifoLen--;
+		return v;
+	case FIFOLevelReg:
+		return (unsigned char)fifoLen;
+	default:
+		return reg[a];
+	}
+}
+
+/* Stand-in chip: one SPI byte, address then data of each access */
+static char standinSpi(char out){
+	hostMicros += SPI_BYTE_US;
+	if (endUs && hostMicros >= endUs) longjmp(done, 1);
+	if (phase == 0){
+		spiAddr = ((unsigned char)out >> 1) & 0x3F;
+		spiRead = (out & 0x80) != 0;
+		phase = 1;
+		return 0;
+	}
+	phase = 0;
+	if (spiRead) return (char)chipRead(spiAddr);
+	chipUpdate();
+	chipWrite(spiAddr, (unsigned char)out);
+	return 0;
+}
+
+//------------------------------------------------------------------------------
+//runs
+
+static void windowTick(void){
+	unsigned long rate;
+	while (hostMicros - window.start >= WINDOW_US){
+		rate = window.reads;
+		if (!window.count || rate < window.min) window.min = rate;
+		if (rate > window.max) window.max = rate;
+		window.count++;
+		window.reads = 0;
+		window.start += WINDOW_US;
+	}
+}
+
+/* Trailer read with MFRC522_ToCard: 18 bytes into a MAX_LEN buffer */
+static uchar rawRead(uchar blk){
+	unsigned char buf[MAX_LEN + CANARY_LEN];
+	uint backLen;
+	uchar status;
+	char msg[80];
+	int i;
+	memset(buf, CANARY, sizeof buf);
+	buf[0] = PICC_READ;
+	buf[1] = blk;
+	CalulateCRC(buf, 2, &buf[2]);
+	MFRC522_SetTimeout(TIMEOUT_READ);
+	status = MFRC522_ToCard(PCD_TRANSCEIVE, buf, 4, buf, &backLen);
+	for (i = MAX_LEN; i < MAX_LEN + CANARY_LEN; i++)
+		if (buf[i] != CANARY){ breach(BR_OVERRUN, "MFRC522_ToCard wrote past its MAX_LEN buffer"); break; }
+	if (status == MI_OK && (backLen > 8 * FIFO_SIZE || (int)backLen != lastBits)){
+		snprintf(msg, sizeof msg, "backLen %u, %d bits received", backLen, lastBits);
+		breach(BR_BACKLEN, msg);
+	}
+	return status == MI_OK && backLen == 144 ? MI_OK : MI_ERR;
+}
+
+/* One card: wake, select, read blocks 0..blocks-1 sector by sector, halt */
+static int cycle(int blocks){
+	unsigned char uid[MAX_UID_LEN], atqa[MAX_LEN], data[MAX_LEN];
+	uchar uidLen, sak, status, blk;
+	unsigned long start, t;
+	uint resends;
+	start = hostMicros;
+	status = MFRC522_Request(PICC_REQALL, atqa);
+	if (status == MI_OK) status = MFRC522_SelectCard(uid, &uidLen, &sak);
+	if (status == MI_OK){
+		if (uidLen != 4 || memcmp(uid, cardUid, 4) || sak != 0x08) breach(BR_SILENT, "select returned a UID or SAK the card did not send");
+		if (card.state != CARD_ACTIVE) breach(BR_DESYNC, "select MI_OK, card not selected");
+	}
+	for (blk = 0; status == MI_OK && blk < blocks; blk++){
+		if (!(blk & 3)){
+			status = MFRC522_AuthRom(PICC_AUTHENT1A, blk, keyDefault, uid);
+			if (status == MI_OK && (card.state != CARD_AUTH || card.sector != blk / 4)) breach(BR_DESYNC, "auth MI_OK, card not authenticated");
+			if (status != MI_OK) break;
+		}
+		t = hostMicros;
+		resends = retryCount[TIMEOUT_READ];
+		if ((blk & 3) == 3) status = rawRead(blk);
+		else{
+			status = MFRC522_Read(blk, data);
+			if (status == MI_OK && memcmp(data, cardMem[blk], 16)) breach(BR_SILENT, "MFRC522_Read returned data the card did not send");
+		}
+		if (status == MI_OK && retryCount[TIMEOUT_READ] != resends) breach(BR_DESYNC, "READ MI_OK on a resend under Crypto1");
+		if (status == MI_OK){
+			keep(hostMicros - t, 1);
+			window.reads++;
+		}
+	}
+	MFRC522_Halt();
+	keep(hostMicros - start, 0);
+	windowTick();
+	return status == MI_OK;
+}
+
+/* One ISO14443-4 card: wake, select, activate at up to tclRate, then
+ * APDU_PAIRS times UPDATE BINARY and READ BINARY of apduLen bytes, deselect.
+ * A failed exchange may leave the card in the protocol state, where it ignores
+ * WUPA: the field is switched off and on again, as an application would */
+static int apduCycle(void){
+	unsigned char uid[MAX_UID_LEN], atqa[MAX_LEN], ats[TCL_FSD], apdu[5 + 255], resp[256 + 2];
+	uchar uidLen, sak, status, atsLen;
+	uint respLen;
+	unsigned long start, t;
+	int k, i, off, active;
+	start = hostMicros;
+	status = MFRC522_Request(PICC_REQALL, atqa);
+	if (status == MI_OK) status = MFRC522_SelectCard(uid, &uidLen, &sak);
+	if (status == MI_OK && sak != 0x20) breach(BR_SILENT, "select returned a SAK the card did not send");
+	if (status == MI_OK){
+		status = MFRC522_TCL_Activate(tclRate, ats, &atsLen);
+		active = status == MI_OK;
+		if (status == MI_OK && card.state != CARD_TCL) breach(BR_DESYNC, "activate MI_OK, card not in ISO14443-4");
+		for (k = 0; status == MI_OK && k < APDU_PAIRS; k++){
+			off = k * apduLen % (FILE_LEN - apduLen + 1);
+			apdu[0] = 0x00; apdu[1] = 0xD6; apdu[2] = off >> 8; apdu[3] = off & 0xFF; apdu[4] = apduLen;
+			for (i = 0; i < apduLen; i++) apdu[5 + i] = (unsigned char)rnd();
+			t = hostMicros;
+			status = MFRC522_TCL_Exchange(apdu, 5 + apduLen, resp, sizeof resp, &respLen);
+			if (status == MI_OK && (respLen != 2 || resp[0] != 0x90 || resp[1] || memcmp(cardFile + off, apdu + 5, apduLen)))
+				breach(BR_SILENT, "UPDATE BINARY MI_OK, the card did not write the data");
+			if (status != MI_OK) break;
+			keep(hostMicros - t, 1);
+			window.reads++;
+			apdu[1] = 0xB0;
+			t = hostMicros;
+			status = MFRC522_TCL_Exchange(apdu, 5, resp, sizeof resp, &respLen);
+			if (status == MI_OK && (respLen != apduLen + 2 || memcmp(resp, apdu + 5, apduLen) || resp[apduLen] != 0x90 || resp[apduLen + 1]))
+				breach(BR_SILENT, "READ BINARY MI_OK with data the card did not send");
+			if (status != MI_OK) break;
+			keep(hostMicros - t, 1);
+			window.reads++;
+		}
+		if (active && MFRC522_TCL_Deselect() != MI_OK) status = MI_ERR;	//back to 106 kbps, CRC off
+	}
+	if (status != MI_OK){
+		AntennaOff();
+		Delay1KTCYx(5);
+		AntennaOn();
+	}
+	keep(hostMicros - start, 0);
+	windowTick();
+	return status == MI_OK;
+}
+
+static unsigned long percentile(struct series *s, int p){
+	long i;
+	if (!s->n) return 0;
+	i = (s->n * p + 99) / 100 - 1;
+	return s->v[i < 0 ? 0 : i];
+}
+
+static void latencyLine(const char *name, struct series *s){
+	if (!s->n) return;
+	qsort(s->v, s->n, sizeof *s->v, byValue);
+	printf("%-12s %8ld  p50 %7lu  p90 %7lu  p99 %7lu  max %7lu us\n", name, s->n,
+		percentile(s, 50), percentile(s, 90), percentile(s, 99), s->v[s->n - 1]);
+}
+
+static void usage(const char *prog){
+	int m;
+	fprintf(stderr, "use: %s [-T s] [-c|-p|-k|-t|-e|-l|-x|-r %%] [-b blocks] [-L len] [-R kbps] [-w %%] [-d in,out] [-s seed] [-u file] [-B baud] [mode]\nmodes: cycle apdu", prog);
+	for (m = 0; m < (int)(sizeof modes / sizeof modes[0]); m++) fprintf(stderr, " %s", modes[m].name);
+	fprintf(stderr, "\n");
+	exit(2);
+}
+
+int main(int argc, char **argv){
+	static int m, e;
+	static unsigned long cycles, passed, all;
+	static const char *mode = "cycle";
+	double seconds = 60, simS, wallS;
+	int blocks = 64, i, nModes = sizeof modes / sizeof modes[0];
+	unsigned long dIn = 400, dOut = 200;
+	clock_t wall;
+	char *p;
+	for (i = 1; i < argc; i++){
+		if (argv[i][0] != '-'){ mode = argv[i]; continue; }
+		if (i + 1 >= argc) usage(argv[0]);
+		p = argv[++i];
+		switch (argv[i-1][1]){
+		case 'T':	seconds = strtod(p, 0); break;
+		case 'b':	blocks = atoi(p); break;
+		case 's':	rng = strtoul(p, 0, 0) | 1; break;
+		case 'u':	if (!(hostUsart = fopen(p, "w"))){ perror(p); exit(2); } break;
+		case 'B':	hostBaud = strtoul(p, 0, 0); break;
+		case 'd':	dIn = strtoul(p, &p, 0); dOut = *p == ',' ? strtoul(p + 1, 0, 0) : dOut; break;
+		case 'r':	for (e = 0; e < ERR_STALL; e++) rate[e] = strtod(p, 0) / 100; break;
+		case 'L':	apduLen = atoi(p); break;
+		case 'R':	for (tclRate = TCL_848KBPS; tclRate >= 0 && 106 << tclRate != atoi(p); tclRate--); break;
+		case 'w':	wtxRate = strtod(p, 0) / 100; break;
+		default:
+			for (e = 0; e < ERR_COUNT && errOpt[e] != argv[i-1][1]; e++);
+			if (e == ERR_COUNT) usage(argv[0]);
+			rate[e] = strtod(p, 0) / 100;
+		}
+	}
+	for (m = 0; m < nModes && strcmp(mode, modes[m].name); m++);
+	if ((m == nModes && strcmp(mode, "cycle") && strcmp(mode, "apdu")) || blocks < 1 || blocks > 64 || seconds <= 0
+		|| apduLen < 1 || apduLen > 255 || tclRate < 0) usage(argv[0]);
+	cardIso = !strcmp(mode, "apdu");
+	cardInit();
+	chipReset();
+	hostSpi = standinSpi;
+	wall = clock();
+	if (m < nModes){
+		inUs = dIn * 1000;
+		outUs = dOut * 1000;
+		endUs = (unsigned long)(seconds * 1e6);
+		if (!setjmp(done)) modes[m].run();
+	}
+	else{
+		setup();
+		window.start = hostMicros;
+		while (hostMicros < (unsigned long)(seconds * 1e6)){
+			cycles++;
+			passed += cardIso ? apduCycle() : cycle(blocks);
+		}
+	}
+	wallS = (double)(clock() - wall) / CLOCKS_PER_SEC;
+	simS = hostMicros / 1e6;
+	printf("%s: %.1f s simulated in %.1f s, %lu frames", mode, simS, wallS, frames);
+	for (e = 0; e < ERR_COUNT; e++) all += injected[e];
+	printf(", %lu errors injected (%.2f%%)\n", all, frames ? 100.0 * all / frames : 0);
+	for (e = 0; e < ERR_COUNT; e++) if (injected[e]) printf("  %-12s %8lu\n", errName[e], injected[e]);
+	if (cardIso){
+		printf("cycles %lu, %lu complete (%.1f%%), %.1f cycles/s\n", cycles, passed, cycles ? 100.0 * passed / cycles : 0, cycles / simS);
+		printf("apdus %ld of %d data bytes, %.1f apdus/s, %.0f data bytes/s, per %lu ms window min %lu max %lu\n",
+			readLat.n, apduLen, readLat.n / simS, readLat.n * apduLen / simS, WINDOW_US / 1000, window.min, window.max);
+		latencyLine("cycle", &cycleLat);
+		latencyLine("apdu", &readLat);
+		printf("send underruns %u\n", tclUnderruns);
+	}
+	else if (m == nModes){
+		printf("cycles %lu, %lu complete (%.1f%%), %.1f cycles/s\n", cycles, passed, cycles ? 100.0 * passed / cycles : 0, cycles / simS);
+		printf("reads %ld, %.1f reads/s, per %lu ms window min %lu max %lu\n", readLat.n, readLat.n / simS,
+			WINDOW_US / 1000, window.min, window.max);
+		latencyLine("cycle", &cycleLat);
+		latencyLine("read", &readLat);
+	}
+	else{
+		printf("card reads %lu, %.1f reads/s, %ld of %lu cards in the field served\n", cardReads, cardReads / simS, cardLat.n, presence);
+		latencyLine("card", &cardLat);
+	}
+	printf("driver: retries");
+	for (i = 0; i < TIMEOUT_COUNT; i++) printf(" %u/%u", retrySaved[i], retryCount[i]);
+	printf(", no answer %u, health resets %u/%u\n", errorNoAnswer, healthSoftResets, healthHardResets);
+	for (e = 0, all = 0; e < BR_COUNT; e++) all += breaches[e];
+	printf("breaches %lu", all);
+	for (e = 0; e < BR_COUNT; e++) if (breaches[e]) printf(", %s %lu", breachName[e], breaches[e]);
+	printf("\n");
+	return all != 0;
+}
@@ -6,7 +6,10 @@
 #include <usart.h>
 #include <capture.h>
 #include <timers.h>
-#include "MFRC522-RFID-SPI.h"
+
+void lcdService(void);
+#define TX_POLL_HOOK()	lcdService()		//LCD written from the driver wait loops, not from the tick
+#include "MFRC522-RFID-SPI.h"			//modules of the build profile, see MFRC522-Modules.h
 
 
 
@@ -19,12 +22,101 @@
 #pragma config OSC = INTIO67
 #pragma config PBADEN=OFF
 
+//LCD text queued by main, written one character per tick from TX_Poll:
+//envia_caracter busy-waits about 2 ms, too long for the 1 ms tick ISR
+#define LCD_QUEUE 16		//power of 2
+
+void highISR(void);
+void lowISR(void);
+void lcdPost(const rom char *str);
+
+char lcdQueue[LCD_QUEUE];
+uchar lcdHead;
+uchar lcdTail;
+uint  lcdTick;				//tick of the last character written
+
 extern void _startup( void ); // See c018i.c in your C18 compiler dir 
 #pragma code _RESET_INTERRUPT_VECTOR = 0x000800 
 void _reset( void ) 
 { 
     _asm goto _startup _endasm 
 } 
+#if ISR_ENABLE
+#pragma code _HIGH_INTERRUPT_VECTOR = 0x000808
+void _high_ISR( void )
+{
+    _asm goto highISR _endasm
+}
+#pragma code _LOW_INTERRUPT_VECTOR = 0x000818
+void _low_ISR( void )
+{
+    _asm goto lowISR _endasm
+}
+#pragma code
+
+/*
+ * High priority: USART RX and the MFRC522 IRQ, never behind LCD or TX work.
+ */
+#pragma interrupt highISR save=PROD,section(".tmpdata")
+void highISR(void){
+	uint start;
+	start = ReadTimer1();
+	if (PIE1bits.RCIE && PIR1bits.RCIF){  Isr_Rx();  }
+#if READER_COUNT > 1
+	if (INTCON3bits.INT1IE && INTCON3bits.INT1IF){
+		INTCON3bits.INT1IF = 0;
+		Isr_ReaderEdge(1, start, start);	}
+#endif
+#if READER_COUNT > 2
+	if (PIE1bits.CCP1IE && PIR1bits.CCP1IF){
+		PIR1bits.CCP1IF = 0;
+		Isr_ReaderEdge(2, ((uint)CCPR1H << 8) | CCPR1L, start);	}
+#endif
+	Isr_Done(ISR_HIGH, start);
+}
+
+/*
+ * Low priority: tick and TX drain; the high priority ISR preempts it.
+ */
+#pragma interruptlow lowISR save=PROD,section(".tmpdata")
+void lowISR(void){
+	uchar count;
+	uint start;
+	count = TMR2;
+	start = ReadTimer1();
+	if (PIE1bits.TMR2IE && PIR1bits.TMR2IF){  Isr_Tick(count);  }
+	if (PIE1bits.TXIE && PIR1bits.TXIF){  Isr_Tx();  }
+	Isr_Done(ISR_LOW, start);
+}
+#endif
+
+/*
+ * Queue text for the LCD, shown once the interrupts are on
+ */
+void lcdPost(const rom char *str){
+	uchar next;
+	while (*str){
+		next = (lcdHead + 1) & (LCD_QUEUE-1);
+		if (next == lcdTail){  return;  }
+		lcdQueue[lcdHead] = *str++;
+		lcdHead = next;
+	}
+}
+
+/*
+ * One character of the LCD queue at most per tick, from TX_Poll
+ */
+void lcdService(void){
+#if ISR_ENABLE
+	uint now;
+	if (lcdHead == lcdTail){  return;  }
+	now = Tick_Read();
+	if (now == lcdTick){  return;  }
+	lcdTick = now;
+	envia_caracter(lcdQueue[lcdTail]);
+	lcdTail = (lcdTail + 1) & (LCD_QUEUE-1);
+#endif
+}
 
 
 
@@ -39,6 +131,7 @@ void main(){
 	int x; 
 	char str[16] = "Teste RFID: ";
 	OSCCON=0b01100010;
+	Boot_Start();			//boot to first REQA time, see sendBootReport()
 	ADCON1=0x0F;
 	TRISB = 0b11111110;
 
@@ -46,26 +139,56 @@ void main(){
 	TRISA=0X30;		//RA4,RA5 ARE INPUTS (DIP SWITCHES)
 	TRISC=0X0F;		//RC0,RC1 ARE INPUTS (DIP SWITCHES)
 
-	lcd_configura();
-	lcd_inicializa();
+	lcd_configura();		//printj initializes the LCD
 
 
 
 	printj(str);
 while(1)
 	{
+#if RC522_GATE
+		if((SW1==0) && (SW2==0))
+		{
+			lcdPost("GATE");
+			readDataGate();				//every reader scans its field, sends UID and gate blocks
+		}
+#endif
+#if RC522_TUNE
+		if((SW3==0) && (SW4==0))
+		{
+			lcdPost("TUNE");
+			tuneAntenna();				//sweeps gain, threshold and driver on a reference card, saves the best
+		}
+#endif
+#if RC522_PERSO && RC522_CONFIG
+		if((SW2==0) && (SW3==0))
+		{
+			lcdPost("LINE");
+			encodeLine();				//writes the next card image of the host to each new card, see host/rc522_encode.c
+		}
+#endif
+#if RC522_DUMP
 		if(SW1==0)
 		{
+			lcdPost("UID");
 			showSerialNumber();			//reads serial number and transmit to serial port
 		}
 		if(SW2==0)
 		{
+			lcdPost("HEX");
 			readDataHEX();				//reads all memory in tag (64 lines) and transmits to serial in hex
 		}
 		if(SW3==0)
 		{
+			lcdPost("ASCII");
 			readDataASCII();			//reads all tag (64 lines) and transmits to serial in ASCII
 		}
+		if(SW4==0)
+		{
+			lcdPost("RLE");
+			readDataCompact();			//reads all tag and transmits runs and RLE blocks, see host/rc522_expand.c
+		}
+#endif
 	}
 
 